@@ -0,0 +1,133 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <mpi.h>
+
+#include "CLI/CLI.hpp"
+
+#include "generators.h"
+#include "version.h"
+
+namespace fs = std::filesystem;
+
+using namespace neuron_parquet::benchmarks;
+
+
+int mpi_size, mpi_rank;
+MPI_Comm comm = MPI_COMM_WORLD;
+
+
+///
+/// \brief generate: Writes the files assigned to this rank, reports the total edges
+///
+template <typename Generate>
+void generate(const std::string& kind, const fs::path& directory, unsigned files, Generate&& fn) {
+    if (mpi_rank == 0) {
+        fs::create_directories(directory);
+    }
+    MPI_Barrier(comm);
+
+    const double start = MPI_Wtime();
+    uint64_t local = 0;
+    for (unsigned file = mpi_rank; file < files; file += mpi_size) {
+        local += fn(file);
+    }
+    uint64_t total;
+    MPI_Reduce(&local, &total, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+    if (mpi_rank == 0) {
+        std::cout << "Generated " << total << " " << kind << " in " << files << " file(s) in "
+                  << MPI_Wtime() - start << " seconds." << std::endl;
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(comm, &mpi_size);
+    MPI_Comm_rank(comm, &mpi_rank);
+
+    std::string directory;
+    std::string distribution = "poisson";
+    int version = 3;
+    TouchSpec touches;
+    CircuitSpec circuit;
+
+    CLI::App app{"Generate synthetic touches and edges to benchmark the converters"};
+    app.set_version_flag("-v,--version", neuron_parquet::VERSION);
+    app.require_subcommand(1);
+    app.add_option("-o,--output", directory, "Directory to generate the files in")
+        ->required();
+    app.add_option("--distribution", distribution, "Distribution of the edges per node")
+        ->check(CLI::IsMember({"constant", "uniform", "poisson", "lognormal"}))
+        ->capture_default_str();
+
+    auto touch_app = app.add_subcommand("touches", "TouchDetector output, touchesData.* and touches.*");
+    touch_app->add_option("--version", version, "Touch version")
+        ->check(CLI::Range(1, 3))
+        ->capture_default_str();
+    touch_app->add_option("--neurons", touches.neurons, "Number of neurons")
+        ->capture_default_str();
+    touch_app->add_option("--mean", touches.mean_touches, "Mean touches per pre-synaptic neuron")
+        ->capture_default_str();
+    touch_app->add_option("--files", touches.files, "Number of files")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    touch_app->add_option("--seed", touches.seed, "Seed of the random numbers")
+        ->capture_default_str();
+
+    auto circuit_app = app.add_subcommand("circuit", "Functionalizer output, part-*.parquet");
+    circuit_app->add_option("--source-nodes", circuit.source_nodes, "Number of source nodes")
+        ->capture_default_str();
+    circuit_app->add_option("--target-nodes", circuit.target_nodes, "Number of target nodes")
+        ->capture_default_str();
+    circuit_app->add_option("--mean", circuit.mean_fan_in, "Mean fan-in per target node")
+        ->capture_default_str();
+    circuit_app->add_option("--files", circuit.files, "Number of files")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    circuit_app->add_option("--row-group-size", circuit.row_group_size, "Rows per row group")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    circuit_app->add_option("--source-population", circuit.source_population, "Source population name")
+        ->capture_default_str();
+    circuit_app->add_option("--target-population", circuit.target_population, "Target population name")
+        ->capture_default_str();
+    circuit_app->add_option("--seed", circuit.seed, "Seed of the random numbers")
+        ->capture_default_str();
+
+    try {
+        app.parse(argc, argv);
+    } catch(const CLI::ParseError& e) {
+        if (mpi_rank == 0) {
+            app.exit(e);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    try {
+        if (touch_app->parsed()) {
+            touches.version = static_cast<neuron_parquet::touches::Version>(version - 1);
+            touches.distribution = parse_distribution(distribution);
+            generate("touches", directory, touches.files, [&](unsigned file) {
+                return generate_touch_file(directory, touches, file);
+            });
+        } else {
+            circuit.distribution = parse_distribution(distribution);
+            generate("edges", directory, circuit.files, [&](unsigned file) {
+                return generate_circuit_file(directory, circuit, file);
+            });
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR on rank " << mpi_rank << ": " << e.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
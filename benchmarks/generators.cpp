@@ -0,0 +1,319 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include "generators.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <arrow/util/key_value_metadata.h>
+#include <parquet/arrow/writer.h>
+
+namespace neuron_parquet {
+namespace benchmarks {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+/// Matches the architecture identifier TouchReader expects for native endianness
+constexpr double ARCHITECTURE_IDENTIFIER = 1.001;
+
+/// TouchDetector versions TouchReader maps to the touch versions
+const char* const TOUCH_VERSION_STRINGS[] = {"4.0", "5.0", "6.0"};
+
+/// TouchReader assigns each touch an index within its neuron of 24 bits
+constexpr uint64_t MAX_TOUCHES_PER_NEURON = (1 << 24) - 1;
+
+// TouchDetector index file definitions, see TouchReader
+struct NeuronInfoSerialized {
+    int id;
+    uint32_t count;
+    long long offset;
+};
+
+struct HeaderSerialized {
+    double architectureIdentifier;
+    long long numberOfNeurons;
+    char version[16];
+};
+
+/// Returns the first and one past the last node of \a file
+std::pair<uint64_t, uint64_t> file_nodes(uint64_t nodes, unsigned files, unsigned file) {
+    return {nodes * file / files, nodes * (file + 1) / files};
+}
+
+template <typename Touch>
+void fill_touch(Touch& t, int pre, int post, std::mt19937_64& rng) {
+    std::uniform_int_distribution<int> section(1, 200);
+    std::uniform_int_distribution<int> segment(0, 50);
+    std::uniform_real_distribution<float> unit(0.f, 1.f);
+    std::uniform_real_distribution<float> position(-1000.f, 1000.f);
+
+    t.pre_synapse_ids[touches::NEURON_ID] = pre;
+    t.pre_synapse_ids[touches::SECTION_ID] = section(rng);
+    t.pre_synapse_ids[touches::SEGMENT_ID] = segment(rng);
+    t.post_synapse_ids[touches::NEURON_ID] = post;
+    t.post_synapse_ids[touches::SECTION_ID] = section(rng);
+    t.post_synapse_ids[touches::SEGMENT_ID] = segment(rng);
+    t.branch = segment(rng);
+    t.distance_soma = 500.f * unit(rng);
+    t.pre_offset = unit(rng);
+    t.post_offset = unit(rng);
+    if constexpr (std::is_base_of_v<touches::v2::Touch, Touch>) {
+        t.pre_section_fraction = unit(rng);
+        t.post_section_fraction = unit(rng);
+        for (int i = 0; i < 3; ++i) {
+            t.pre_position[i] = position(rng);
+            t.post_position[i] = position(rng);
+        }
+        t.spine_length = 2.f * unit(rng);
+        // Pre and post branch types packed into one byte, see TouchWriterParquet
+        t.branch_type = static_cast<unsigned char>((rng() % 4) | ((rng() % 4) << 4));
+    }
+    if constexpr (std::is_base_of_v<touches::v3::Touch, Touch>) {
+        for (int i = 0; i < 3; ++i) {
+            t.pre_position_center[i] = position(rng);
+            t.post_position_surface[i] = position(rng);
+        }
+    }
+}
+
+template <typename Touch>
+uint64_t write_touches(const fs::path& directory, const TouchSpec& spec, unsigned file) {
+    const auto [first, last] = file_nodes(spec.neurons, spec.files, file);
+    std::mt19937_64 rng(spec.seed * 7919 + file);
+    FanDistribution touches_per_neuron(spec.distribution, spec.mean_touches, rng());
+    std::uniform_int_distribution<int> post(0, std::max<uint64_t>(1, spec.neurons) - 1);
+
+    std::ofstream data(directory / ("touchesData." + std::to_string(file)), std::ios::binary);
+    std::vector<NeuronInfoSerialized> neurons;
+    neurons.reserve(last - first);
+
+    // Written in blocks to keep the memory bounded
+    std::vector<Touch> block;
+    uint64_t offset = 0;
+    for (uint64_t pre = first; pre < last; ++pre) {
+        const auto count = std::min(touches_per_neuron(), MAX_TOUCHES_PER_NEURON);
+        neurons.push_back({static_cast<int>(pre),
+                           static_cast<uint32_t>(count),
+                           static_cast<long long>(offset * sizeof(Touch))});
+        for (uint64_t i = 0; i < count; ++i) {
+            block.emplace_back();
+            fill_touch(block.back(), pre, post(rng), rng);
+            if (block.size() == 64 * 1024) {
+                data.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(Touch));
+                block.clear();
+            }
+        }
+        offset += count;
+    }
+    data.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(Touch));
+    if (!data) {
+        throw std::runtime_error("could not write touches to " + directory.string());
+    }
+
+    HeaderSerialized header{};
+    header.architectureIdentifier = ARCHITECTURE_IDENTIFIER;
+    header.numberOfNeurons = neurons.size();
+    std::strncpy(header.version, TOUCH_VERSION_STRINGS[spec.version], sizeof(header.version) - 1);
+    std::ofstream index(directory / ("touches." + std::to_string(file)), std::ios::binary);
+    index.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    index.write(reinterpret_cast<const char*>(neurons.data()), neurons.size() * sizeof(NeuronInfoSerialized));
+    if (!index) {
+        throw std::runtime_error("could not write the touch index to " + directory.string());
+    }
+    return offset;
+}
+
+template <typename T>
+T check(arrow::Result<T> result) {
+    if (!result.ok()) {
+        throw std::runtime_error(result.status().ToString());
+    }
+    return std::move(result).ValueOrDie();
+}
+
+void check(const arrow::Status& status) {
+    if (!status.ok()) {
+        throw std::runtime_error(status.ToString());
+    }
+}
+
+/// Columns of a row group, filled edge by edge
+struct EdgeColumns {
+    arrow::Int64Builder source_node_id;
+    arrow::Int64Builder target_node_id;
+    arrow::FloatBuilder delay;
+    arrow::FloatBuilder conductance;
+    arrow::FloatBuilder u_syn;
+    arrow::FloatBuilder depression_time;
+    arrow::FloatBuilder facilitation_time;
+    arrow::FloatBuilder decay_time;
+    arrow::Int16Builder syn_type_id;
+    arrow::Int32Builder morpho_section_id_post;
+    arrow::Int32Builder morpho_segment_id_post;
+    arrow::FloatBuilder morpho_offset_segment_post;
+
+    static std::shared_ptr<arrow::Schema> schema() {
+        return arrow::schema({arrow::field("source_node_id", arrow::int64(), false),
+                              arrow::field("target_node_id", arrow::int64(), false),
+                              arrow::field("delay", arrow::float32(), false),
+                              arrow::field("conductance", arrow::float32(), false),
+                              arrow::field("u_syn", arrow::float32(), false),
+                              arrow::field("depression_time", arrow::float32(), false),
+                              arrow::field("facilitation_time", arrow::float32(), false),
+                              arrow::field("decay_time", arrow::float32(), false),
+                              arrow::field("syn_type_id", arrow::int16(), false),
+                              arrow::field("morpho_section_id_post", arrow::int32(), false),
+                              arrow::field("morpho_segment_id_post", arrow::int32(), false),
+                              arrow::field("morpho_offset_segment_post", arrow::float32(), false)});
+    }
+
+    void append(int64_t source, int64_t target, std::mt19937_64& rng) {
+        std::uniform_real_distribution<float> unit(0.f, 1.f);
+        check(source_node_id.Append(source));
+        check(target_node_id.Append(target));
+        check(delay.Append(0.1f + 5.f * unit(rng)));
+        check(conductance.Append(unit(rng)));
+        check(u_syn.Append(unit(rng)));
+        check(depression_time.Append(1000.f * unit(rng)));
+        check(facilitation_time.Append(100.f * unit(rng)));
+        check(decay_time.Append(10.f * unit(rng)));
+        check(syn_type_id.Append(static_cast<int16_t>(rng() % 128)));
+        check(morpho_section_id_post.Append(static_cast<int32_t>(rng() % 200)));
+        check(morpho_segment_id_post.Append(static_cast<int32_t>(rng() % 50)));
+        check(morpho_offset_segment_post.Append(unit(rng)));
+    }
+
+    int64_t length() const {
+        return source_node_id.length();
+    }
+
+    std::shared_ptr<arrow::Table> finish() {
+        return arrow::Table::Make(schema(),
+                                  {check(source_node_id.Finish()),
+                                   check(target_node_id.Finish()),
+                                   check(delay.Finish()),
+                                   check(conductance.Finish()),
+                                   check(u_syn.Finish()),
+                                   check(depression_time.Finish()),
+                                   check(facilitation_time.Finish()),
+                                   check(decay_time.Finish()),
+                                   check(syn_type_id.Finish()),
+                                   check(morpho_section_id_post.Finish()),
+                                   check(morpho_segment_id_post.Finish()),
+                                   check(morpho_offset_segment_post.Finish())});
+    }
+};
+
+}  // unnamed namespace
+
+
+Distribution parse_distribution(const std::string& name) {
+    if (name == "constant") {
+        return Distribution::Constant;
+    } else if (name == "uniform") {
+        return Distribution::Uniform;
+    } else if (name == "poisson") {
+        return Distribution::Poisson;
+    } else if (name == "lognormal") {
+        return Distribution::LogNormal;
+    }
+    throw std::runtime_error("unknown distribution " + name);
+}
+
+
+FanDistribution::FanDistribution(Distribution distribution, double mean, uint64_t seed)
+    : distribution_(distribution)
+    , mean_(mean)
+    , rng_(seed) {}
+
+
+uint64_t FanDistribution::operator()() {
+    switch (distribution_) {
+        case Distribution::Constant:
+            return static_cast<uint64_t>(mean_);
+        case Distribution::Uniform:
+            return std::uniform_int_distribution<uint64_t>(0, static_cast<uint64_t>(2 * mean_))(rng_);
+        case Distribution::Poisson:
+            return std::poisson_distribution<uint64_t>(mean_)(rng_);
+        case Distribution::LogNormal: {
+            // With sigma 1, a mu of log(mean) - 1/2 keeps the mean
+            const double sigma = 1.0;
+            const double mu = std::log(std::max(mean_, 1e-9)) - 0.5 * sigma * sigma;
+            return static_cast<uint64_t>(std::lognormal_distribution<double>(mu, sigma)(rng_));
+        }
+    }
+    throw std::runtime_error("invalid distribution");
+}
+
+
+uint64_t generate_touch_file(const fs::path& directory, const TouchSpec& spec, unsigned file) {
+    switch (spec.version) {
+        case touches::V1:
+            return write_touches<touches::v1::Touch>(directory, spec, file);
+        case touches::V2:
+            return write_touches<touches::v2::Touch>(directory, spec, file);
+        case touches::V3:
+            return write_touches<touches::v3::Touch>(directory, spec, file);
+    }
+    throw std::runtime_error("invalid touch version");
+}
+
+
+uint64_t generate_circuit_file(const fs::path& directory, const CircuitSpec& spec, unsigned file) {
+    const auto [first, last] = file_nodes(spec.target_nodes, spec.files, file);
+    std::mt19937_64 rng(spec.seed * 7919 + file);
+    FanDistribution fan_in(spec.distribution, spec.mean_fan_in, rng());
+    std::uniform_int_distribution<uint64_t> source(0, std::max<uint64_t>(1, spec.source_nodes) - 1);
+
+    auto metadata = arrow::key_value_metadata(
+        {"source_population_name", "source_population_size",
+         "target_population_name", "target_population_size"},
+        {spec.source_population, std::to_string(spec.source_nodes),
+         spec.target_population, std::to_string(spec.target_nodes)});
+    const auto schema = EdgeColumns::schema()->WithMetadata(metadata);
+
+    const auto path = directory / ("part-" + std::to_string(file) + ".parquet");
+    auto sink = check(arrow::io::FileOutputStream::Open(path.string()));
+    auto props = parquet::WriterProperties::Builder().compression(parquet::Compression::SNAPPY)->build();
+    // The key-value metadata of the schema is only kept when storing the schema
+    auto arrow_props = parquet::ArrowWriterProperties::Builder().store_schema()->build();
+    auto writer = check(parquet::arrow::FileWriter::Open(*schema, arrow::default_memory_pool(),
+                                                         sink, props, arrow_props));
+
+    uint64_t edges = 0;
+    EdgeColumns columns;
+    std::vector<uint64_t> sources;
+    for (uint64_t target = first; target < last; ++target) {
+        sources.resize(fan_in());
+        std::generate(sources.begin(), sources.end(), [&] { return source(rng); });
+        std::sort(sources.begin(), sources.end());
+        for (const auto s: sources) {
+            columns.append(s, target, rng);
+        }
+        edges += sources.size();
+        if (columns.length() >= static_cast<int64_t>(spec.row_group_size)) {
+            check(writer->WriteTable(*columns.finish(), spec.row_group_size));
+        }
+    }
+    if (columns.length() > 0 || edges == 0) {
+        check(writer->WriteTable(*columns.finish(), spec.row_group_size));
+    }
+    check(writer->Close());
+    check(sink->Close());
+    return edges;
+}
+
+}  // namespace benchmarks
+}  // namespace neuron_parquet
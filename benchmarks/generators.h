@@ -0,0 +1,93 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <string>
+
+#include "touches/touch_defs.h"
+
+namespace neuron_parquet {
+namespace benchmarks {
+
+/**
+ * \brief Distributions of the number of edges per node.
+ */
+enum class Distribution { Constant, Uniform, Poisson, LogNormal };
+
+/// Parses "constant", "uniform", "poisson" or "lognormal"
+Distribution parse_distribution(const std::string& name);
+
+/**
+ * \brief Draws the number of edges of successive nodes, with a given mean.
+ *
+ * Uniform draws from [0, 2 * mean], log-normal with a sigma of 1, which
+ * gives the long tail of highly connected nodes found in circuits.
+ */
+class FanDistribution {
+  public:
+    FanDistribution(Distribution distribution, double mean, uint64_t seed);
+
+    uint64_t operator()();
+
+  private:
+    Distribution distribution_;
+    double mean_;
+    std::mt19937_64 rng_;
+};
+
+/**
+ * \brief TouchDetector output to synthesise.
+ *
+ * The neurons are split into contiguous blocks over the files, each file
+ * holding the touches of its neurons grouped by pre-synaptic neuron.
+ */
+struct TouchSpec {
+    touches::Version version = touches::V3;
+    uint64_t neurons = 1000;
+    double mean_touches = 100;
+    Distribution distribution = Distribution::Poisson;
+    unsigned files = 1;
+    uint64_t seed = 0;
+};
+
+/**
+ * \brief Writes `touchesData.<file>` and its index `touches.<file>` to \a directory.
+ *
+ * Returns the number of touches written.  Every file can be generated
+ * independently, e.g. by different ranks.
+ */
+uint64_t generate_touch_file(const std::filesystem::path& directory, const TouchSpec& spec, unsigned file);
+
+/**
+ * \brief Functionalizer-like Parquet edges to synthesise.
+ *
+ * The target nodes are split into contiguous blocks over the files, and the
+ * edges within each file are sorted by target and source node ID.  The
+ * key-value metadata holds the population names and sizes SonataWriter
+ * expects.
+ */
+struct CircuitSpec {
+    uint64_t source_nodes = 1000;
+    uint64_t target_nodes = 1000;
+    double mean_fan_in = 100;
+    Distribution distribution = Distribution::Poisson;
+    unsigned files = 1;
+    uint64_t row_group_size = 512 * 1024;
+    std::string source_population = "All";
+    std::string target_population = "All";
+    uint64_t seed = 0;
+};
+
+/**
+ * \brief Writes `part-<file>.parquet` to \a directory, returns the number of edges written.
+ */
+uint64_t generate_circuit_file(const std::filesystem::path& directory, const CircuitSpec& spec, unsigned file);
+
+}  // namespace benchmarks
+}  // namespace neuron_parquet
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Strong and weak scaling of touch2parquet, parquet2hdf5 and sonata-index.
+
+Generates synthetic touches and edges with `neuron-parquet-generate`, runs
+every tool at increasing rank counts with `--stats-json`, and prints the
+wall time, speedup and parallel efficiency per tool together with the
+slowest rank's time of its main stages.
+
+In strong scaling, the data is the same for all rank counts; in weak
+scaling, it grows with the number of ranks.  The efficiency is `T(1) / (p *
+T(p))` for strong and `T(1) / T(p)` for weak scaling.  With
+`--min-efficiency`, the exit code is non-zero if any efficiency falls below
+it, so that regressions fail the test.
+"""
+
+import argparse
+import json
+import shlex
+import shutil
+import subprocess
+import sys
+import tempfile
+from pathlib import Path
+
+TOOLS = ["neuron-parquet-generate", "touch2parquet", "parquet2hdf5", "sonata-index"]
+
+# The stages shown per tool, see src/stats.hpp
+STAGES = {
+    "touch2parquet": ["read", "transpose", "write_batch", "mpi"],
+    "parquet2hdf5": ["read", "h5_write", "mpi"],
+    "sonata-index": ["index_read", "index_sort", "index_exchange", "index_write"],
+}
+
+
+def launcher_command(args, ranks):
+    command = [args.launcher, args.numproc_flag, str(ranks)]
+    if args.oversubscribe:
+        command.append("--oversubscribe")
+    command.extend(shlex.split(args.launcher_args))
+    return command
+
+
+def run(args, ranks, command, log):
+    full = launcher_command(args, ranks) + [str(c) for c in command]
+    with open(log, "a") as out:
+        out.write("$ " + " ".join(full) + "\n")
+        out.flush()
+        subprocess.run(full, check=True, stdout=out, stderr=subprocess.STDOUT)
+
+
+def measure(args, mode, ranks, workdir):
+    """Runs all tools at `ranks` ranks, returns their statistics by tool."""
+    scale = ranks if mode == "weak" else 1
+    files = ranks if mode == "weak" else max(args.ranks)
+    run_dir = workdir / f"{mode}-{ranks}"
+    run_dir.mkdir(parents=True)
+    log = run_dir / "log.txt"
+    generate = args.tools["neuron-parquet-generate"]
+
+    touches = run_dir / "touches"
+    circuit = run_dir / "circuit"
+    run(args, ranks,
+        [generate, "-o", touches, "touches",
+         "--neurons", args.neurons * scale, "--mean", args.touches, "--files", files],
+        log)
+    run(args, ranks,
+        [generate, "-o", circuit, "circuit",
+         "--source-nodes", args.nodes * scale, "--target-nodes", args.nodes * scale,
+         "--mean", args.fan_in, "--files", files],
+        log)
+
+    stats = {tool: run_dir / f"{tool}.json" for tool in STAGES}
+    run(args, ranks,
+        [args.tools["touch2parquet"], "--stats-json", stats["touch2parquet"],
+         "-o", run_dir / "touches.parquet" / "touches",
+         *sorted(touches.glob("touchesData.*"))],
+        log)
+    edges = run_dir / "edges.h5"
+    run(args, ranks,
+        [args.tools["parquet2hdf5"], "--no-index", "--stats-json", stats["parquet2hdf5"],
+         circuit, edges, "All"],
+        log)
+    run(args, ranks,
+        [args.tools["sonata-index"], "--stats-json", stats["sonata-index"], edges],
+        log)
+
+    result = {}
+    for tool, path in stats.items():
+        with open(path) as fd:
+            result[tool] = json.load(fd)
+    if not args.keep:
+        shutil.rmtree(run_dir)
+    return result
+
+
+def table(mode, results):
+    """Prints the scaling of every tool, returns the lowest efficiency."""
+    lowest = 1.0
+    base_ranks = min(results)
+    for tool, stages in STAGES.items():
+        base = results[base_ranks][tool]["wall_seconds"] * (base_ranks if mode == "strong" else 1)
+        print(f"\n{mode.capitalize()} scaling of {tool}")
+        header = f"{'ranks':>6}{'wall [s]':>11}{'speedup':>9}{'eff.':>7}"
+        header += "".join(f"{s + ' [s]':>20}" for s in stages)
+        print(header)
+        for ranks in sorted(results):
+            stats = results[ranks][tool]
+            wall = stats["wall_seconds"]
+            if mode == "strong":
+                speedup = base / wall
+                efficiency = speedup / ranks
+            else:
+                speedup = ranks * base / wall
+                efficiency = base / wall
+            lowest = min(lowest, efficiency)
+            line = f"{ranks:>6}{wall:>11.3f}{speedup:>9.2f}{efficiency:>7.2f}"
+            for stage in stages:
+                seconds = stats["stages"].get(stage, {}).get("seconds", {}).get("max")
+                line += f"{seconds:>20.3f}" if seconds is not None else f"{'-':>20}"
+            print(line)
+    return lowest
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bin-dir", type=Path,
+                        help="directory containing the tools, searched in PATH if not given")
+    for tool in TOOLS:
+        parser.add_argument(f"--{tool}", dest=tool, type=Path, help=f"path of {tool}")
+    parser.add_argument("--launcher", default="mpirun", help="MPI launcher")
+    parser.add_argument("--numproc-flag", default="-n", help="flag of the launcher for the ranks")
+    parser.add_argument("--launcher-args", default="",
+                        help="additional arguments of the launcher, as one string")
+    parser.add_argument("--oversubscribe", action="store_true",
+                        help="allow more ranks than cores (Open MPI)")
+    parser.add_argument("--ranks", type=int, nargs="+", default=[1, 2, 4],
+                        help="rank counts to run")
+    parser.add_argument("--mode", choices=["strong", "weak", "both"], default="both")
+    parser.add_argument("--neurons", type=int, default=20000,
+                        help="neurons with touches, per rank in weak scaling")
+    parser.add_argument("--touches", type=float, default=100, help="mean touches per neuron")
+    parser.add_argument("--nodes", type=int, default=20000,
+                        help="source and target nodes, per rank in weak scaling")
+    parser.add_argument("--fan-in", type=float, default=100, help="mean edges per target node")
+    parser.add_argument("--workdir", type=Path, help="directory for the data, temporary if not given")
+    parser.add_argument("--keep", action="store_true", help="keep the data and statistics")
+    parser.add_argument("--json", type=Path, help="write the statistics of all runs to this file")
+    parser.add_argument("--min-efficiency", type=float, default=0.0,
+                        help="fail if any parallel efficiency is below this")
+    args = parser.parse_args()
+    args.tools = {}
+    for tool in TOOLS:
+        path = getattr(args, tool)
+        if path is None and args.bin_dir:
+            path = args.bin_dir / tool
+        elif path is None:
+            path = shutil.which(tool)
+        if path is None or not Path(path).exists():
+            parser.error(f"could not find {tool}")
+        args.tools[tool] = path
+
+    modes = ["strong", "weak"] if args.mode == "both" else [args.mode]
+    with tempfile.TemporaryDirectory(dir=args.workdir) as tmp:
+        workdir = Path(tmp)
+        if args.keep:
+            workdir = Path(tempfile.mkdtemp(dir=args.workdir))
+            print(f"Keeping the data in {workdir}")
+        all_results = {}
+        lowest = 1.0
+        for mode in modes:
+            results = {}
+            for ranks in sorted(args.ranks):
+                print(f"Running {mode} scaling with {ranks} rank(s)", flush=True)
+                results[ranks] = measure(args, mode, ranks, workdir)
+            lowest = min(lowest, table(mode, results))
+            all_results[mode] = results
+
+    if args.json:
+        with open(args.json, "w") as fd:
+            json.dump(all_results, fd, indent=2)
+
+    if lowest < args.min_efficiency:
+        print(f"\nLowest parallel efficiency {lowest:.2f} is below {args.min_efficiency:.2f}")
+        return 1
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,314 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include <algorithm>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+#include "CLI/CLI.hpp"
+
+#include "circuit.h"
+#include "generators.h"
+#include "touches.h"
+#include "version.h"
+
+namespace fs = std::filesystem;
+
+using namespace neuron_parquet;
+using namespace neuron_parquet::benchmarks;
+using circuit::CircuitData;
+using circuit::CircuitMultiReaderParquet;
+using circuit::SonataWriter;
+using touches::IndexedTouch;
+using touches::TouchReader;
+using touches::TouchWriterParquet;
+
+
+int mpi_size, mpi_rank;
+MPI_Comm comm = MPI_COMM_WORLD;
+
+
+/// Records and bytes processed by this rank in one repetition
+struct Work {
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+};
+
+/// Seconds of every repetition, bound by the slowest rank, and the work of all ranks
+struct Result {
+    std::string name;
+    std::vector<double> seconds;
+    Work work;
+};
+
+
+///
+/// \brief measure: Runs \a fn \a repetitions times between barriers
+///
+/// Every rank calls \a fn concurrently, the time of a repetition is the
+/// time until the slowest rank is done.
+///
+Result measure(const std::string& name, unsigned repetitions, const std::function<Work()>& fn) {
+    Result result{name, {}, {}};
+    Work local;
+    for (unsigned i = 0; i < repetitions; ++i) {
+        MPI_Barrier(comm);
+        const double start = MPI_Wtime();
+        local = fn();
+        MPI_Barrier(comm);
+        result.seconds.push_back(MPI_Wtime() - start);
+    }
+    MPI_Reduce(&local.records, &result.work.records, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+    MPI_Reduce(&local.bytes, &result.work.bytes, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+    return result;
+}
+
+
+void print(const std::vector<Result>& results, unsigned repetitions) {
+    std::cout << std::endl
+              << "Throughput of " << mpi_size << " rank(s), best and median of "
+              << repetitions << " repetition(s)" << std::endl
+              << std::left << std::setw(16) << "Benchmark" << std::right
+              << std::setw(14) << "records" << std::setw(12) << "MB"
+              << std::setw(14) << "best rec/s" << std::setw(14) << "median rec/s"
+              << std::setw(12) << "best MB/s" << std::setw(14) << "median MB/s" << std::endl;
+    std::cout << std::fixed;
+    for (const auto& r: results) {
+        auto seconds = r.seconds;
+        std::sort(seconds.begin(), seconds.end());
+        const double best = seconds.front();
+        const double median = seconds.size() % 2 == 1
+                                  ? seconds[seconds.size() / 2]
+                                  : (seconds[seconds.size() / 2 - 1] + seconds[seconds.size() / 2]) / 2;
+        const double mb = r.work.bytes / (1024. * 1024.);
+        std::cout << std::left << std::setw(16) << r.name << std::right
+                  << std::setw(14) << r.work.records
+                  << std::setprecision(1) << std::setw(12) << mb
+                  << std::setprecision(0)
+                  << std::setw(14) << r.work.records / best
+                  << std::setw(14) << r.work.records / median
+                  << std::setprecision(1)
+                  << std::setw(12) << mb / best
+                  << std::setw(14) << mb / median << std::endl;
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+}
+
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(comm, &mpi_size);
+    MPI_Comm_rank(comm, &mpi_rank);
+
+    std::string directory = std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+    std::string distribution = "poisson";
+    unsigned repetitions = 5;
+    int version = 3;
+    bool keep = false;
+    std::vector<std::string> selected;
+    TouchSpec touch_spec;
+    CircuitSpec circuit_spec;
+    touch_spec.neurons = 10000;
+    circuit_spec.source_nodes = 10000;
+    circuit_spec.target_nodes = 10000;
+
+    const std::vector<std::string> benchmarks{
+        "touch_read", "touch_write", "circuit_read", "sonata_write", "index_write"};
+
+    CLI::App app{"Measure the throughput of the readers, writers and indexing on synthetic data"};
+    app.set_version_flag("-v,--version", neuron_parquet::VERSION);
+    app.add_option("-d,--directory", directory, "Directory to generate the data in")
+        ->check(CLI::ExistingDirectory)
+        ->capture_default_str();
+    app.add_option("-r,--repetitions", repetitions, "Repetitions of every benchmark")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    app.add_option("-b,--benchmark", selected, "Benchmarks to run, all if not given")
+        ->check(CLI::IsMember(benchmarks));
+    app.add_option("--distribution", distribution, "Distribution of the edges per node")
+        ->check(CLI::IsMember({"constant", "uniform", "poisson", "lognormal"}))
+        ->capture_default_str();
+    app.add_option("--touch-version", version, "Version of the touches")
+        ->check(CLI::Range(1, 3))
+        ->capture_default_str();
+    app.add_option("--neurons", touch_spec.neurons, "Number of neurons with touches")
+        ->capture_default_str();
+    app.add_option("--touches", touch_spec.mean_touches, "Mean touches per neuron")
+        ->capture_default_str();
+    app.add_option("--source-nodes", circuit_spec.source_nodes, "Number of source nodes")
+        ->capture_default_str();
+    app.add_option("--target-nodes", circuit_spec.target_nodes, "Number of target nodes")
+        ->capture_default_str();
+    app.add_option("--fan-in", circuit_spec.mean_fan_in, "Mean edges per target node")
+        ->capture_default_str();
+    app.add_option("--row-group-size", circuit_spec.row_group_size, "Rows per Parquet row group")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    app.add_flag("--keep", keep, "Keep the generated data");
+
+    try {
+        app.parse(argc, argv);
+    } catch(const CLI::ParseError& e) {
+        if (mpi_rank == 0) {
+            app.exit(e);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (selected.empty()) {
+        selected = benchmarks;
+    }
+    auto wanted = [&selected](const std::string& name) {
+        return std::find(selected.begin(), selected.end(), name) != selected.end();
+    };
+
+    // Shared by all ranks, every rank generates and processes a file of its own
+    fs::path scratch = fs::path(directory) / "neuron-parquet-throughput";
+    if (mpi_rank == 0) {
+        fs::remove_all(scratch);
+        fs::create_directories(scratch);
+    }
+    MPI_Barrier(comm);
+
+    std::vector<Result> results;
+    try {
+        touch_spec.version = static_cast<touches::Version>(version - 1);
+        touch_spec.distribution = parse_distribution(distribution);
+        touch_spec.files = mpi_size;
+        circuit_spec.distribution = parse_distribution(distribution);
+        circuit_spec.files = mpi_size;
+
+        if (wanted("touch_read") || wanted("touch_write")) {
+            generate_touch_file(scratch, touch_spec, mpi_rank);
+            TouchReader reader((scratch / ("touchesData." + std::to_string(mpi_rank))).c_str());
+            const uint64_t record_size = reader.record_size();
+            std::vector<IndexedTouch> buffer(Converter<IndexedTouch>::DEFAULT_BUFFER_LEN);
+
+            if (wanted("touch_read")) {
+                results.push_back(measure("touch_read", repetitions, [&]() {
+                    Work work;
+                    reader.seek(0);
+                    uint32_t n;
+                    while ((n = reader.fillBuffer(buffer.data(), buffer.size())) > 0) {
+                        work.records += n;
+                    }
+                    work.bytes = work.records * record_size;
+                    return work;
+                }));
+            }
+
+            if (wanted("touch_write")) {
+                // Read upfront, to time the writer alone
+                std::vector<IndexedTouch> touches(reader.record_count());
+                reader.seek(0);
+                for (uint64_t i = 0; i < touches.size();) {
+                    i += reader.fillBuffer(touches.data() + i, std::min<uint64_t>(buffer.size(), touches.size() - i));
+                }
+                const auto output = scratch / ("touches." + std::to_string(mpi_rank) + ".parquet");
+                results.push_back(measure("touch_write", repetitions, [&]() {
+                    // The destructor writes the last row group and the footer
+                    TouchWriterParquet writer(output, reader.version(), reader.version_string());
+                    for (uint64_t i = 0; i < touches.size(); i += buffer.size()) {
+                        writer.write(touches.data() + i, std::min<uint64_t>(buffer.size(), touches.size() - i));
+                    }
+                    return Work{touches.size(), touches.size() * record_size};
+                }));
+            }
+        }
+
+        if (wanted("circuit_read") || wanted("sonata_write") || wanted("index_write")) {
+            generate_circuit_file(scratch, circuit_spec, mpi_rank);
+            const std::vector<std::string> input{
+                (scratch / ("part-" + std::to_string(mpi_rank) + ".parquet")).string()};
+
+            if (wanted("circuit_read")) {
+                results.push_back(measure("circuit_read", repetitions, [&]() {
+                    CircuitMultiReaderParquet reader(input);
+                    CircuitData data;
+                    Work work;
+                    uint32_t n;
+                    while ((n = reader.fillBuffer(&data, 1)) > 0) {
+                        work.records += n;
+                    }
+                    work.bytes = reader.byte_count();
+                    return work;
+                }));
+            }
+
+            if (wanted("sonata_write") || wanted("index_write")) {
+                // Read upfront, to time the writer alone
+                CircuitMultiReaderParquet reader(input);
+                std::vector<CircuitData> row_groups;
+                CircuitData data;
+                while (reader.fillBuffer(&data, 1) > 0) {
+                    row_groups.push_back(data);
+                }
+                const uint64_t records = reader.record_count();
+                uint64_t offset = 0;
+                uint64_t total;
+                MPI_Exscan(&records, &offset, 1, MPI_UINT64_T, MPI_SUM, comm);
+                MPI_Allreduce(&records, &total, 1, MPI_UINT64_T, MPI_SUM, comm);
+                if (mpi_rank == 0) {
+                    offset = 0;
+                }
+
+                const auto output = scratch / "edges.h5";
+                std::vector<double> write_seconds;
+                std::vector<double> index_seconds;
+                // Indices can only be written once per file, time both stages per repetition
+                for (unsigned i = 0; i < repetitions; ++i) {
+                    SonataWriter writer(output, total, {comm, MPI_INFO_NULL}, offset,
+                                        circuit_spec.target_population);
+                    writer.set_local_records(records);
+                    writer.setup(reader.schema(), reader.metadata());
+                    MPI_Barrier(comm);
+                    double start = MPI_Wtime();
+                    for (const auto& row_group: row_groups) {
+                        writer.write(&row_group, row_group.row_group->num_rows());
+                    }
+                    writer.flush();
+                    MPI_Barrier(comm);
+                    write_seconds.push_back(MPI_Wtime() - start);
+
+                    start = MPI_Wtime();
+                    if (wanted("index_write")) {
+                        writer.write_indices(true);
+                    }
+                    MPI_Barrier(comm);
+                    index_seconds.push_back(MPI_Wtime() - start);
+                }
+
+                if (wanted("sonata_write")) {
+                    results.push_back({"sonata_write", write_seconds, {total, 0}});
+                    const uint64_t bytes = reader.byte_count();
+                    MPI_Reduce(&bytes, &results.back().work.bytes, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+                }
+                if (wanted("index_write")) {
+                    // Both node ID columns are read back
+                    results.push_back({"index_write", index_seconds, {total, 2 * total * sizeof(uint64_t)}});
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR on rank " << mpi_rank << ": " << e.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    if (mpi_rank == 0) {
+        print(results, repetitions);
+        if (!keep) {
+            fs::remove_all(scratch);
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
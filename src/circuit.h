@@ -2,6 +2,10 @@
 
 #include "circuit/circuit_defs.h"
 #include "circuit/parquet_reader.h"
+#include "circuit/parquet_writer.h"
+#include "circuit/population.h"
+#include "circuit/row_filter.h"
 #include "circuit/sonata_file.h"
+#include "circuit/sonata_reader.h"
 #include "circuit/sonata_writer.h"
 #include "converter.h"
@@ -6,7 +6,10 @@
  *
  */
 #include <stdexcept>
+#include <arrow/array.h>
+#include <parquet/statistics.h>
 #include "parquet_reader.h"
+#include "stats.hpp"
 
 namespace {
 
@@ -30,8 +33,12 @@ CircuitReaderParquet::CircuitReaderParquet(const std::string & filename)
     parquet_metadata_(reader_->metadata()),
     column_count_(parquet_metadata_->num_columns()),
     rowgroup_count_(parquet_metadata_->num_row_groups()),
-    record_count_(parquet_metadata_->num_rows())
+    record_count_(parquet_metadata_->num_rows()),
+    byte_count_(0)
 {
+    for (uint32_t rg = 0; rg < rowgroup_count_; ++rg) {
+        byte_count_ += parquet_metadata_->RowGroup(rg)->total_byte_size();
+    }
 }
 
 void CircuitReaderParquet::close() {
@@ -65,15 +72,159 @@ uint32_t CircuitReaderParquet::fillBuffer(CircuitData* buf, uint32_t length) {
     if(!data_reader_) {
         init_data_reader();
     }
-    if( cur_row_group_ >= rowgroup_count_) {
-        return 0;
+    // Returning no rows would end the reading, skip row groups without matches
+    for (; cur_row_group_ < rowgroup_count_; ++cur_row_group_) {
+        if (filter_ && !selected_[cur_row_group_]) {
+            continue;
+        }
+        const auto status = data_reader_->ReadRowGroup(cur_row_group_, &(buf->row_group));
+        if (!status.ok()) {
+            throw std::runtime_error(status.ToString());
+        }
+        utils::stats::count(utils::stats::Stage::Read,
+                            parquet_metadata_->RowGroup(cur_row_group_)->total_byte_size());
+        if (filter_) {
+            buf->row_group = filter_->apply(buf->row_group);
+        }
+        if (buf->row_group->num_rows() > 0) {
+            ++cur_row_group_;
+            return (uint32_t) buf->row_group->num_rows();
+        }
     }
+    return 0;
+}
 
-    const auto status = data_reader_->ReadRowGroup(cur_row_group_++, &(buf->row_group));
-    if (!status.ok()) {
-        throw std::runtime_error(status.ToString());
+
+void CircuitReaderParquet::set_filter(std::shared_ptr<const RowFilter> filter) {
+    filter_ = std::move(filter);
+    selected_.assign(rowgroup_count_, true);
+    if (!filter_) {
+        return;
+    }
+    for (uint32_t rg = 0; rg < rowgroup_count_; ++rg) {
+        selected_[rg] = filter_->may_match(*parquet_metadata_->RowGroup(rg));
+    }
+}
+
+
+uint64_t CircuitReaderParquet::matching_count() {
+    if (!filter_) {
+        return record_count_;
+    }
+    std::vector<int> indices;
+    for (const auto& name: filter_->columns()) {
+        indices.push_back(schema()->ColumnIndex(name));
+    }
+    init_data_reader();
+
+    uint64_t count = 0;
+    for (uint32_t rg = 0; rg < rowgroup_count_; ++rg) {
+        if (!selected_[rg]) {
+            continue;
+        }
+        std::shared_ptr<arrow::Table> table;
+        const auto status = data_reader_->ReadRowGroup(rg, indices, &table);
+        if (!status.ok()) {
+            throw std::runtime_error(status.ToString());
+        }
+        count += filter_->apply(table)->num_rows();
+    }
+    close();
+    return count;
+}
+
+
+void CircuitReaderParquet::unique_values(const std::string& name, std::set<std::string>& values) {
+    const auto idx = schema()->ColumnIndex(name);
+    if (idx < 0) {
+        throw std::runtime_error("column " + name + " not found in " + filename_);
+    }
+    // Only rows matching the filter are converted, see fillBuffer()
+    std::vector<int> indices{idx};
+    if (filter_) {
+        for (const auto& column: filter_->columns()) {
+            const auto i = schema()->ColumnIndex(column);
+            if (i != idx) {
+                indices.push_back(i);
+            }
+        }
+    }
+    init_data_reader();
+
+    auto value_at = [&name](const arrow::Array& array, int64_t i) -> std::string_view {
+        switch (array.type_id()) {
+            case arrow::Type::STRING:
+            case arrow::Type::BINARY:
+                return static_cast<const arrow::BinaryArray&>(array).GetView(i);
+            case arrow::Type::LARGE_STRING:
+            case arrow::Type::LARGE_BINARY:
+                return static_cast<const arrow::LargeBinaryArray&>(array).GetView(i);
+            default:
+                throw std::runtime_error("column " + name + " does not contain strings");
+        }
+    };
+
+    // Read one row group at a time to keep the memory bounded
+    for (uint32_t rg = 0; rg < rowgroup_count_; ++rg) {
+        if (filter_ && !selected_[rg]) {
+            continue;
+        }
+        std::shared_ptr<arrow::Table> table;
+        const auto status = data_reader_->ReadRowGroup(rg, indices, &table);
+        if (!status.ok()) {
+            throw std::runtime_error(status.ToString());
+        }
+        if (filter_) {
+            table = filter_->apply(table);
+        }
+        for (const auto& chunk: table->GetColumnByName(name)->chunks()) {
+            if (chunk->type_id() == arrow::Type::DICTIONARY) {
+                // Dictionaries may hold unused entries, only add referenced ones
+                const auto& dict = static_cast<const arrow::DictionaryArray&>(*chunk);
+                std::vector<bool> used(dict.dictionary()->length());
+                for (int64_t i = 0; i < dict.length(); ++i) {
+                    if (dict.IsValid(i)) {
+                        used[dict.GetValueIndex(i)] = true;
+                    }
+                }
+                for (size_t i = 0; i < used.size(); ++i) {
+                    if (used[i]) {
+                        values.emplace(value_at(*dict.dictionary(), i));
+                    }
+                }
+            } else {
+                for (int64_t i = 0; i < chunk->length(); ++i) {
+                    if (chunk->IsValid(i)) {
+                        values.emplace(value_at(*chunk, i));
+                    }
+                }
+            }
+        }
+    }
+    close();
+}
+
+
+void CircuitReaderParquet::null_columns(std::set<std::string>& columns) const {
+    const auto* parquet_schema = schema();
+    for (uint32_t i = 0; i < column_count_; ++i) {
+        const auto* column = parquet_schema->Column(i);
+        if (column->max_definition_level() == 0) {
+            continue;
+        }
+        const auto name = column->path()->ToDotVector().front();
+        if (columns.count(name) > 0) {
+            continue;
+        }
+        for (uint32_t rg = 0; rg < rowgroup_count_; ++rg) {
+            const auto chunk = parquet_metadata_->RowGroup(rg)->ColumnChunk(i);
+            const auto stats = chunk->is_stats_set() ? chunk->statistics() : nullptr;
+            if (!stats || !stats->HasNullCount() || stats->null_count() > 0) {
+                columns.insert(name);
+                break;
+            }
+        }
     }
-    return (uint32_t) buf->row_group->num_rows();
 }
 
 
@@ -84,6 +235,7 @@ CircuitMultiReaderParquet::CircuitMultiReaderParquet(const std::vector<std::stri
  :
    rowgroup_count_(0),
    record_count_(0),
+   byte_count_(0),
    cur_file_(0)
 {
     if (filenames.empty()) {
@@ -105,6 +257,7 @@ CircuitMultiReaderParquet::CircuitMultiReaderParquet(const std::vector<std::stri
         circuit_readers_.push_back(reader);
         rowgroup_count_ += reader->rowgroup_count_;
         record_count_ += reader->record_count_;
+        byte_count_ += reader->byte_count_;
         // Offsets
         rowgroup_offsets_.push_back(rowgroup_count_);
 
@@ -116,11 +269,15 @@ CircuitMultiReaderParquet::CircuitMultiReaderParquet(const std::vector<std::stri
 }
 
 uint32_t CircuitMultiReaderParquet::fillBuffer(CircuitData *buf, uint length) {
+    if (cur_file_ >= circuit_readers_.size()) {
+        // EOF
+        return 0;
+    }
     uint32_t n = circuit_readers_[cur_file_]->fillBuffer(buf, length);
-    if(n <= 0) {
+    // With a filter, whole files may not have any matching rows
+    while (n == 0) {
         circuit_readers_[cur_file_]->close();
-        cur_file_++;
-        if(cur_file_ >= circuit_readers_.size()) {
+        if (++cur_file_ >= circuit_readers_.size()) {
             // EOF
             return 0;
         }
@@ -130,6 +287,31 @@ uint32_t CircuitMultiReaderParquet::fillBuffer(CircuitData *buf, uint length) {
 }
 
 
+std::vector<std::string> CircuitMultiReaderParquet::unique_values(const std::string& name) {
+    std::set<std::string> values;
+    for (const auto& reader: circuit_readers_) {
+        reader->unique_values(name, values);
+    }
+    return {values.begin(), values.end()};
+}
+
+
+std::vector<std::string> CircuitMultiReaderParquet::null_columns() const {
+    std::set<std::string> columns;
+    for (const auto& reader: circuit_readers_) {
+        reader->null_columns(columns);
+    }
+    return {columns.begin(), columns.end()};
+}
+
+
+void CircuitMultiReaderParquet::set_filter(std::shared_ptr<const RowFilter> filter) {
+    for (const auto& reader: circuit_readers_) {
+        reader->set_filter(filter);
+    }
+}
+
+
 const CircuitData::Schema* CircuitMultiReaderParquet::schema() const {
     return metadata_reader_->schema();
 }
@@ -9,10 +9,12 @@
 
 #include <parquet/api/reader.h>
 #include <parquet/arrow/reader.h>
+#include <set>
 #include <string>
 #include <vector>
 #include "../generic_reader.h"
 #include "./circuit_defs.h"
+#include "./row_filter.h"
 
 namespace neuron_parquet {
 namespace circuit {
@@ -38,12 +40,39 @@ class CircuitReaderParquet : public Reader<CircuitData> {
         return rowgroup_count_;
     }
 
+    /// Uncompressed size of all row groups in bytes
+    uint64_t byte_count() const {
+        return byte_count_;
+    }
+
     void seek(uint64_t pos) override {
         cur_row_group_ = pos;
     }
 
     uint32_t fillBuffer(CircuitData* buf, uint length) override;
 
+    /// Collects the distinct values of the string or dictionary column \a name in the rows matching the filter
+    void unique_values(const std::string& name, std::set<std::string>& values);
+
+    /**
+     * \brief Collects the top-level columns that may contain nulls
+     *
+     * Judging by the statistics of the row groups, columns without null
+     * counts are assumed to contain nulls.
+     */
+    void null_columns(std::set<std::string>& columns) const;
+
+    /**
+     * \brief Only returns the rows matching \a filter from fillBuffer()
+     *
+     * Row groups that cannot match judging by their statistics are skipped
+     * without reading them, as are row groups without any matching rows.
+     */
+    void set_filter(std::shared_ptr<const RowFilter> filter);
+
+    /// Rows matching the filter, reads the filtered columns of the row groups not skipped
+    uint64_t matching_count();
+
     virtual const CircuitData::Schema* schema() const override {
         return parquet_metadata_->schema();
     }
@@ -61,8 +90,13 @@ class CircuitReaderParquet : public Reader<CircuitData> {
     const uint32_t column_count_;
     const uint32_t rowgroup_count_;
     const uint64_t record_count_;
+    uint64_t byte_count_;
     uint32_t cur_row_group_;
 
+    std::shared_ptr<const RowFilter> filter_;
+    /// Row groups that may match the filter
+    std::vector<bool> selected_;
+
     // Functions which might eventually be classed by friend class CircuitMultiReader
     /// Closes the underlying file handler.
     void close();
@@ -94,10 +128,24 @@ class CircuitMultiReaderParquet : public Reader<CircuitData> {
         return rowgroup_count_;
     }
 
+    /// Uncompressed size of the row groups of all files in bytes
+    uint64_t byte_count() const {
+        return byte_count_;
+    }
+
     void seek(uint64_t pos) override;
 
     uint32_t fillBuffer(CircuitData* buf, uint length) override;
 
+    /// Returns the sorted distinct values of the string or dictionary column \a name
+    std::vector<std::string> unique_values(const std::string& name);
+
+    /// Returns the sorted columns of all files that may contain nulls, see CircuitReaderParquet::null_columns
+    std::vector<std::string> null_columns() const;
+
+    /// Filters the rows of all files, see CircuitReaderParquet::set_filter
+    void set_filter(std::shared_ptr<const RowFilter> filter);
+
     virtual const CircuitData::Schema* schema() const override;
 
     virtual const std::shared_ptr<const CircuitData::Metadata> metadata() const override;
@@ -106,6 +154,7 @@ class CircuitMultiReaderParquet : public Reader<CircuitData> {
     std::shared_ptr<CircuitReaderParquet> metadata_reader_;
     uint32_t rowgroup_count_;
     uint64_t record_count_;
+    uint64_t byte_count_;
     std::vector<uint32_t> rowgroup_offsets_;
     uint32_t cur_row_group_;
     unsigned int cur_file_;
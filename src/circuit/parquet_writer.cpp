@@ -0,0 +1,197 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include "parquet_writer.h"
+
+#include <iostream>
+#include <map>
+#include <stdexcept>
+
+#include <arrow/compute/api.h>
+#include <arrow/util/config.h>
+#include <arrow/util/key_value_metadata.h>
+#include <parquet/arrow/schema.h>
+#include <parquet/exception.h>
+
+#include "CLI/CLI.hpp"
+
+#include "stats.hpp"
+
+namespace neuron_parquet {
+namespace circuit {
+
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
+
+namespace {
+
+/// Regenerated by the writer from the schema
+static const std::string ARROW_SCHEMA_KEY = "ARROW:schema";
+
+/// Compression codecs by their name on the command line
+static const std::map<std::string, parquet::Compression::type> CODECS{
+    {"none", parquet::Compression::UNCOMPRESSED},
+    {"snappy", parquet::Compression::SNAPPY},
+    {"gzip", parquet::Compression::GZIP},
+    {"zstd", parquet::Compression::ZSTD},
+    {"lz4", parquet::Compression::LZ4},
+    {"brotli", parquet::Compression::BROTLI}};
+
+}  // unnamed namespace
+
+
+void CircuitWriterParquet::Options::add_options(CLI::App& app, const std::string& row_group_help) {
+    std::string default_codec;
+    for (const auto& [name, codec]: CODECS) {
+        if (codec == compression) {
+            default_codec = name;
+        }
+    }
+    app.add_option("--row-group-size", row_group_size, row_group_help)
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    app.add_option("--compression", compression, "Compression codec")
+        ->transform(CLI::CheckedTransformer(CODECS))
+        ->default_str(default_codec);
+    app.add_option("--compression-level", compression_level,
+                   "Compression level, the default of the codec if 0")
+        ->capture_default_str();
+    app.add_flag("--statistics,!--no-statistics", statistics, "Write column statistics")
+        ->capture_default_str();
+}
+
+
+CircuitWriterParquet::CircuitWriterParquet(const std::string& filename, const Options& options)
+    : filename_(filename)
+    , options_(options)
+{
+    if (options_.row_group_size == 0) {
+        throw std::runtime_error("row groups need at least one row");
+    }
+#if ARROW_VERSION_MAJOR >= 21
+    // Sorting kernels are no longer registered by default
+    if (!options_.sort_by.empty()) {
+        PARQUET_THROW_NOT_OK(arrow::compute::Initialize());
+    }
+#endif
+}
+
+
+CircuitWriterParquet::~CircuitWriterParquet() {
+    if (file_writer_) {
+        try {
+            close();
+        } catch (const std::exception& e) {
+            std::cerr << "ERROR: could not close " << filename_ << ": " << e.what() << std::endl;
+        }
+    }
+}
+
+
+void CircuitWriterParquet::setup(const CircuitData::Schema* schema,
+                                 std::shared_ptr<const CircuitData::Metadata> metadata) {
+    // Restores the Arrow types, e.g. dictionaries, the row groups are read with
+    PARQUET_THROW_NOT_OK(parquet::arrow::FromParquetSchema(
+        schema, parquet::default_arrow_reader_properties(), metadata, &schema_));
+
+    auto kv = std::make_shared<arrow::KeyValueMetadata>();
+    if (metadata) {
+        for (int64_t i = 0; i < metadata->size(); ++i) {
+            if (metadata->key(i) != ARROW_SCHEMA_KEY) {
+                kv->Append(metadata->key(i), metadata->value(i));
+            }
+        }
+    }
+    schema_ = schema_->WithMetadata(kv);
+
+    parquet::WriterProperties::Builder prop_builder;
+    prop_builder.compression(options_.compression);
+    if (options_.compression_level > 0) {
+        prop_builder.compression_level(options_.compression_level);
+    }
+    if (!options_.statistics) {
+        prop_builder.disable_statistics();
+    }
+    prop_builder.max_row_group_length(options_.row_group_size);
+    // The key-value metadata of the schema is only written along with the schema
+    auto arrow_props = parquet::ArrowWriterProperties::Builder().store_schema()->build();
+
+    PARQUET_ASSIGN_OR_THROW(out_file_, arrow::io::FileOutputStream::Open(filename_));
+    PARQUET_ASSIGN_OR_THROW(file_writer_,
+                            parquet::arrow::FileWriter::Open(*schema_,
+                                                             arrow::default_memory_pool(),
+                                                             out_file_,
+                                                             prop_builder.build(),
+                                                             arrow_props));
+}
+
+
+void CircuitWriterParquet::write(const CircuitData* data, uint32_t length) {
+    if (!data || !data->row_group || length == 0) {
+        return;
+    }
+    if (!file_writer_) {
+        throw std::runtime_error("writer for " + filename_ + " has not been set up");
+    }
+    pending_.push_back(data->row_group);
+    pending_rows_ += data->row_group->num_rows();
+    if (options_.sort_by.empty()) {
+        write_pending(false);
+    }
+}
+
+
+void CircuitWriterParquet::close() {
+    if (!file_writer_) {
+        return;
+    }
+    write_pending(true);
+    auto writer = std::move(file_writer_);
+    PARQUET_THROW_NOT_OK(writer->Close());
+    PARQUET_THROW_NOT_OK(out_file_->Close());
+}
+
+
+void CircuitWriterParquet::write_pending(bool all) {
+    const uint64_t rows = all ? pending_rows_
+                              : pending_rows_ - pending_rows_ % options_.row_group_size;
+    if (rows == 0) {
+        return;
+    }
+
+    std::shared_ptr<arrow::Table> table;
+    PARQUET_ASSIGN_OR_THROW(table, arrow::ConcatenateTables(pending_));
+    pending_.clear();
+
+    if (!options_.sort_by.empty()) {
+        std::vector<arrow::compute::SortKey> keys;
+        for (const auto& column: options_.sort_by) {
+            keys.emplace_back(column, arrow::compute::SortOrder::Ascending);
+        }
+        std::shared_ptr<arrow::Array> indices;
+        PARQUET_ASSIGN_OR_THROW(indices,
+                                arrow::compute::SortIndices(arrow::Datum(table),
+                                                            arrow::compute::SortOptions(keys)));
+        arrow::Datum sorted;
+        PARQUET_ASSIGN_OR_THROW(sorted, arrow::compute::Take(table, indices));
+        table = sorted.table();
+    }
+
+    // Keep the remainder for the next row group
+    if (rows < pending_rows_) {
+        pending_.push_back(table->Slice(rows));
+    }
+    pending_rows_ -= rows;
+
+    {
+        ScopedTimer timer(Stage::WriteBatch, 0, rows);
+        PARQUET_THROW_NOT_OK(file_writer_->WriteTable(*table->Slice(0, rows), options_.row_group_size));
+    }
+    written_ += rows;
+}
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
@@ -0,0 +1,96 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <parquet/arrow/writer.h>
+
+#include "../generic_writer.h"
+#include "circuit_defs.h"
+
+namespace CLI {
+class App;
+}
+
+namespace neuron_parquet {
+namespace circuit {
+
+
+///
+/// \brief The CircuitWriterParquet writes row groups of edges into a single Parquet file.
+///
+/// Incoming row groups are gathered until \c row_group_size rows are
+/// available, so that many small inputs result in few large row groups.
+/// When sorting, all rows are kept in memory until close() and then written
+/// ordered by the sort columns.  The key-value metadata of the input is
+/// preserved.
+///
+class CircuitWriterParquet : public Writer<CircuitData>
+{
+public:
+    struct Options {
+        /// Rows per row group written
+        uint64_t row_group_size = 1024 * 1024;
+        /// Compression codec of all columns
+        parquet::Compression::type compression = parquet::Compression::SNAPPY;
+        /// Codec specific compression level, the default of the codec if not set
+        int compression_level = 0;
+        /// Write column statistics, used by readers to skip row groups
+        bool statistics = true;
+        /// Columns to sort the rows by, in order of precedence. Unsorted if empty
+        std::vector<std::string> sort_by;
+
+        /**
+         * \brief Adds the command line options of the Parquet output to \a app
+         *
+         * Parses --row-group-size, --compression, --compression-level and
+         * --statistics into these options, with the current values as default.
+         */
+        void add_options(CLI::App& app, const std::string& row_group_help = "Rows per row group");
+    };
+
+    CircuitWriterParquet(const std::string& filename, const Options& options);
+
+    /// Closes the file if close() was not called, ignoring errors
+    ~CircuitWriterParquet();
+
+    virtual void setup(const CircuitData::Schema* schema,
+                       std::shared_ptr<const CircuitData::Metadata> metadata) override;
+
+    virtual void write(const CircuitData* data, uint32_t length) override;
+
+    /// Writes the remaining rows and the footer
+    void close();
+
+    /// Rows written so far
+    uint64_t record_count() const {
+        return written_;
+    }
+
+private:
+    /// Writes all complete row groups of the pending rows, or all of them if \a all
+    void write_pending(bool all);
+
+    const std::string filename_;
+    const Options options_;
+
+    std::shared_ptr<arrow::Schema> schema_;
+    std::shared_ptr<arrow::io::FileOutputStream> out_file_;
+    std::unique_ptr<parquet::arrow::FileWriter> file_writer_;
+
+    std::vector<std::shared_ptr<arrow::Table>> pending_;
+    uint64_t pending_rows_ = 0;
+    uint64_t written_ = 0;
+};
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
@@ -0,0 +1,56 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include "population.h"
+
+#include <algorithm>
+#include <numeric>
+
+namespace neuron_parquet {
+namespace circuit {
+
+
+void schedule(std::vector<Population>& populations, int n_ranks) {
+    if (populations.size() <= static_cast<size_t>(n_ranks)) {
+        for (auto& p: populations) {
+            p.ranks = 1;
+        }
+        for (int spare = n_ranks - populations.size(); spare > 0; --spare) {
+            Population* neediest = nullptr;
+            for (auto& p: populations) {
+                if (static_cast<size_t>(p.ranks) < p.filenames.size() &&
+                    (!neediest || p.records * neediest->ranks > neediest->records * p.ranks)) {
+                    neediest = &p;
+                }
+            }
+            if (!neediest) {
+                break;
+            }
+            ++neediest->ranks;
+        }
+        int first = 0;
+        for (auto& p: populations) {
+            p.first_rank = first;
+            first += p.ranks;
+        }
+    } else {
+        std::vector<size_t> order(populations.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&populations](size_t a, size_t b) {
+            return populations[a].records > populations[b].records;
+        });
+        std::vector<uint64_t> load(n_ranks, 0);
+        for (const auto i: order) {
+            const auto rank = std::min_element(load.begin(), load.end()) - load.begin();
+            populations[i].first_rank = rank;
+            populations[i].ranks = 1;
+            load[rank] += populations[i].records;
+        }
+    }
+}
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
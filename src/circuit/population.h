@@ -0,0 +1,44 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace neuron_parquet {
+namespace circuit {
+
+
+///
+/// \brief An input directory converted into an edge population of the output
+///
+struct Population {
+    std::string name;
+    std::string metadata_path;
+    std::vector<std::string> filenames;
+    /// Records of every file, and all of them
+    std::vector<uint64_t> file_records;
+    uint64_t records = 0;
+    /// The contiguous ranks converting the population
+    int first_rank = 0;
+    int ranks = 1;
+};
+
+
+/**
+ * \brief Assigns \a n_ranks ranks to the \a populations, proportionally to their records
+ *
+ * With at least as many ranks as populations, every population gets its own
+ * contiguous ranks, at most one per file.  Otherwise, every population is
+ * converted by a single rank, the largest populations first on the least
+ * loaded rank.
+ */
+void schedule(std::vector<Population>& populations, int n_ranks);
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
@@ -0,0 +1,224 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include "row_filter.h"
+
+#include <algorithm>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include <arrow/compute/api.h>
+#include <arrow/util/config.h>
+#include <parquet/exception.h>
+#include <parquet/statistics.h>
+
+namespace neuron_parquet {
+namespace circuit {
+
+namespace {
+
+int64_t parse_value(const std::string& value, const std::string& spec) {
+    size_t end = 0;
+    int64_t result;
+    try {
+        result = std::stoll(value, &end);
+    } catch (const std::logic_error&) {
+        end = 0;
+    }
+    if (value.empty() || end != value.size()) {
+        throw std::invalid_argument("invalid value '" + value + "' in selection " + spec);
+    }
+    return result;
+}
+
+/// The minimum and maximum of the column chunk, false if unknown
+bool statistics_bounds(const parquet::ColumnChunkMetaData& chunk,
+                       const parquet::ColumnDescriptor& column,
+                       int64_t& min,
+                       int64_t& max) {
+    if (!chunk.is_stats_set()) {
+        return false;
+    }
+    const auto stats = chunk.statistics();
+    if (!stats || !stats->HasMinMax()) {
+        return false;
+    }
+    const bool is_unsigned = column.sort_order() == parquet::SortOrder::UNSIGNED;
+    switch (column.physical_type()) {
+        case parquet::Type::INT32: {
+            const auto& typed = static_cast<const parquet::Int32Statistics&>(*stats);
+            min = is_unsigned ? static_cast<uint32_t>(typed.min()) : typed.min();
+            max = is_unsigned ? static_cast<uint32_t>(typed.max()) : typed.max();
+            return true;
+        }
+        case parquet::Type::INT64: {
+            const auto& typed = static_cast<const parquet::Int64Statistics&>(*stats);
+            if (is_unsigned && (typed.min() < 0 || typed.max() < 0)) {
+                // Beyond the values that can be selected
+                return false;
+            }
+            min = typed.min();
+            max = typed.max();
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+}  // unnamed namespace
+
+
+RowFilter::RowFilter(std::vector<Condition> conditions)
+    : conditions_(std::move(conditions))
+{
+#if ARROW_VERSION_MAJOR >= 21
+    // Filter kernels are no longer registered by default
+    PARQUET_THROW_NOT_OK(arrow::compute::Initialize());
+#endif
+    for (const auto& condition: conditions_) {
+        if (condition.values.empty()) {
+            value_sets_.emplace_back();
+            continue;
+        }
+        arrow::Int64Builder builder;
+        PARQUET_THROW_NOT_OK(builder.AppendValues(condition.values));
+        std::shared_ptr<arrow::Array> values;
+        PARQUET_THROW_NOT_OK(builder.Finish(&values));
+        value_sets_.push_back(values);
+    }
+}
+
+
+RowFilter::Condition RowFilter::parse(const std::string& spec) {
+    const auto equals = spec.find('=');
+    if (equals == std::string::npos || equals == 0 || equals + 1 == spec.size()) {
+        throw std::invalid_argument("selection " + spec + " is not of the form COLUMN=SPEC");
+    }
+    Condition condition;
+    condition.column = spec.substr(0, equals);
+    const auto values = spec.substr(equals + 1);
+
+    const auto dash = values.find('-');
+    if (values[0] != '@' && values.find(',') == std::string::npos && dash != std::string::npos) {
+        condition.min = parse_value(values.substr(0, dash), spec);
+        condition.max = parse_value(values.substr(dash + 1), spec);
+        if (condition.min > condition.max) {
+            throw std::invalid_argument("selection " + spec + " has an empty range");
+        }
+        return condition;
+    }
+
+    if (values[0] == '@') {
+        std::ifstream file(values.substr(1));
+        if (!file) {
+            throw std::invalid_argument("cannot read the values of selection " + spec);
+        }
+        std::string value;
+        while (file >> value) {
+            condition.values.push_back(parse_value(value, spec));
+        }
+    } else {
+        std::stringstream ss(values);
+        std::string value;
+        while (std::getline(ss, value, ',')) {
+            condition.values.push_back(parse_value(value, spec));
+        }
+    }
+    if (condition.values.empty()) {
+        throw std::invalid_argument("selection " + spec + " has no values");
+    }
+    std::sort(condition.values.begin(), condition.values.end());
+    condition.values.erase(std::unique(condition.values.begin(), condition.values.end()),
+                           condition.values.end());
+    condition.min = condition.values.front();
+    condition.max = condition.values.back();
+    return condition;
+}
+
+
+std::vector<std::string> RowFilter::columns() const {
+    std::vector<std::string> result;
+    for (const auto& condition: conditions_) {
+        if (std::find(result.begin(), result.end(), condition.column) == result.end()) {
+            result.push_back(condition.column);
+        }
+    }
+    return result;
+}
+
+
+bool RowFilter::may_match(const parquet::RowGroupMetaData& row_group) const {
+    const auto schema = row_group.schema();
+    for (const auto& condition: conditions_) {
+        const auto idx = schema->ColumnIndex(condition.column);
+        if (idx < 0) {
+            throw std::runtime_error("column " + condition.column + " to select by not found");
+        }
+        int64_t min, max;
+        if (!statistics_bounds(*row_group.ColumnChunk(idx), *schema->Column(idx), min, max)) {
+            continue;
+        }
+        if (max < condition.min || min > condition.max) {
+            return false;
+        }
+        if (!condition.values.empty()) {
+            const auto it = std::lower_bound(condition.values.begin(), condition.values.end(), min);
+            if (it == condition.values.end() || *it > max) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+
+std::shared_ptr<arrow::Table> RowFilter::apply(const std::shared_ptr<arrow::Table>& table) const {
+    namespace cp = arrow::compute;
+
+    if (conditions_.empty()) {
+        return table;
+    }
+
+    arrow::Datum mask;
+    for (size_t i = 0; i < conditions_.size(); ++i) {
+        const auto& condition = conditions_[i];
+        const auto column = table->GetColumnByName(condition.column);
+        if (!column) {
+            throw std::runtime_error("column " + condition.column + " to select by not found");
+        }
+        // Compare as signed 64 bit integers, whatever the type of the column
+        arrow::Datum values;
+        PARQUET_ASSIGN_OR_THROW(values, cp::Cast(column, arrow::int64()));
+
+        arrow::Datum selected;
+        if (value_sets_[i]) {
+            PARQUET_ASSIGN_OR_THROW(selected, cp::IsIn(values, cp::SetLookupOptions(value_sets_[i])));
+        } else {
+            arrow::Datum lower, upper;
+            PARQUET_ASSIGN_OR_THROW(lower, cp::CallFunction("greater_equal",
+                                                            {values, arrow::Datum(condition.min)}));
+            PARQUET_ASSIGN_OR_THROW(upper, cp::CallFunction("less_equal",
+                                                            {values, arrow::Datum(condition.max)}));
+            PARQUET_ASSIGN_OR_THROW(selected, cp::And(lower, upper));
+        }
+        if (i == 0) {
+            mask = selected;
+        } else {
+            PARQUET_ASSIGN_OR_THROW(mask, cp::And(mask, selected));
+        }
+    }
+
+    // Nulls in the mask, i.e., null values, are not selected
+    arrow::Datum result;
+    PARQUET_ASSIGN_OR_THROW(result, cp::Filter(table, mask));
+    return result.table();
+}
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <arrow/api.h>
+#include <parquet/metadata.h>
+
+namespace neuron_parquet {
+namespace circuit {
+
+
+///
+/// \brief The RowFilter selects edges by the values of integer columns, e.g., node IDs.
+///
+/// Edges are selected if they fulfill all conditions.  Row groups are
+/// skipped based on the minimum and maximum of the column statistics, the
+/// rows of the remaining ones are filtered with Arrow compute kernels.
+///
+class RowFilter {
+ public:
+    struct Condition {
+        std::string column;
+        /// Inclusive bounds of the values selected
+        int64_t min;
+        int64_t max;
+        /// Sorted values selected, all values within the bounds if empty
+        std::vector<int64_t> values;
+    };
+
+    explicit RowFilter(std::vector<Condition> conditions);
+
+    /**
+     * \brief Parses a condition given as \c COLUMN=SPEC
+     *
+     * The \c SPEC is either an inclusive range \c FIRST-LAST, a list of values
+     * \c VALUE,VALUE,..., or \c @FILE to read whitespace separated values
+     * from a file.
+     */
+    static Condition parse(const std::string& spec);
+
+    const std::vector<Condition>& conditions() const {
+        return conditions_;
+    }
+
+    /// The names of the columns the conditions refer to
+    std::vector<std::string> columns() const;
+
+    /**
+     * \brief Whether rows of the \a row_group may match, judging by its statistics
+     *
+     * Row groups without statistics for a column may always match.
+     */
+    bool may_match(const parquet::RowGroupMetaData& row_group) const;
+
+    /// Returns the rows of \a table that match all conditions
+    std::shared_ptr<arrow::Table> apply(const std::shared_ptr<arrow::Table>& table) const;
+
+ private:
+    std::vector<Condition> conditions_;
+    /// Values of the conditions selecting sets, or null for ranges
+    std::vector<std::shared_ptr<arrow::Array>> value_sets_;
+};
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
@@ -5,47 +5,128 @@
  * @author Fernando Pereira <fernando.pereira@epfl.ch>
  *
  */
+#include <algorithm>
+#include <cstring>
+#include <limits>
 #include <unordered_set>
 #include "index/index.h"
 #include "sonata_file.h"
+#include "stats.hpp"
 
 namespace {
 
-auto create_fapl() {
+auto create_fapl(const MPI_Comm& comm, const MPI_Info& info) {
     HighFive::FileAccessProps fapl;
-    fapl.add(HighFive::MPIOFileAccess{MPI_COMM_WORLD, MPI_INFO_NULL});
+    fapl.add(HighFive::MPIOFileAccess{comm, info});
     return fapl;
 }
 
+/// The communicator \a file was opened with, a duplicate to be freed
+MPI_Comm file_comm(const HighFive::File& file) {
+    const hid_t fapl = H5Fget_access_plist(file.getId());
+    MPI_Comm comm = MPI_COMM_NULL;
+    MPI_Info info = MPI_INFO_NULL;
+    const auto status = H5Pget_fapl_mpio(fapl, &comm, &info);
+    H5Pclose(fapl);
+    if (status < 0) {
+        throw std::runtime_error("file not opened for parallel access");
+    }
+    if (info != MPI_INFO_NULL) {
+        MPI_Info_free(&info);
+    }
+    return comm;
+}
+
+/// The group of all edge populations, created if needed
+HighFive::Group edges_group(HighFive::File& file) {
+    if (file.exist("edges")) {
+        return file.getGroup("edges");
+    }
+    return file.createGroup("edges");
+}
+
 }
 
 namespace neuron_parquet {
 namespace circuit {
 
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
 
-SonataFile::SonataFile(const std::string& filepath, const std::string &population_name, uint64_t n_records)
+
+SonataFile::SonataFile(const std::string& filepath, const std::string &population_name, uint64_t n_records,
+                       const DatasetLayout& layout)
   : parallel_mode_(false),
+    layout_(layout),
     file_(HighFive::File(filepath, HighFive::File::Create|HighFive::File::Truncate)),
-    population_group_(file_.createGroup("edges").createGroup(population_name)),
+    population_group_(edges_group(file_).createGroup(population_name)),
     properties_group_(population_group_.createGroup("0")),
     n_records_(n_records)
 {
 }
 
 SonataFile::SonataFile(const std::string& filepath, const std::string &population_name,
-                                 const MPI_Comm& mpicomm, const MPI_Info& mpiinfo, uint64_t n_records)
+                                 const MPI_Comm& mpicomm, const MPI_Info& mpiinfo, uint64_t n_records,
+                                 const DatasetLayout& layout)
   : parallel_mode_(true),
-    file_(HighFive::File(filepath, HighFive::File::Create|HighFive::File::Truncate, create_fapl())),
-    population_group_(file_.createGroup("edges").createGroup(population_name)),
+    layout_(layout),
+    file_(create(filepath, mpicomm, mpiinfo)),
+    population_group_(edges_group(file_).createGroup(population_name)),
     properties_group_(population_group_.createGroup("0")),
     n_records_(n_records)
 {
 }
 
+SonataFile::SonataFile(const HighFive::File& file, const std::string& population_name, bool parallel,
+                       uint64_t n_records, const DatasetLayout& layout)
+  : parallel_mode_(parallel),
+    layout_(layout),
+    file_(file),
+    n_records_(n_records)
+{
+    auto edges = edges_group(file_);
+    if (!edges.exist(population_name)) {
+        population_group_ = edges.createGroup(population_name);
+        properties_group_ = population_group_.createGroup("0");
+        return;
+    }
+
+    // Appending to an existing population, its datasets are kept
+    population_group_ = edges.getGroup(population_name);
+    properties_group_ = population_group_.exist("0") ? population_group_.getGroup("0")
+                                                     : population_group_.createGroup("0");
+    for (const auto& group: {population_group_, properties_group_}) {
+        for (const auto& name: group.listObjectNames()) {
+            if (group.getObjectType(name) != HighFive::ObjectType::Dataset) {
+                continue;
+            }
+            const auto length = group.getDataSet(name).getDimensions()[0];
+            if (n_records_ > 0 && length != n_records_) {
+                throw std::runtime_error("population " + population_name + " has " +
+                                         std::to_string(length) + " rows in dataset " + name +
+                                         ", but " + std::to_string(n_records_) + " are to be written");
+            }
+            stored_.insert(name);
+        }
+    }
+}
+
+HighFive::File SonataFile::create(const std::string& filepath, const MPI_Comm& mpicomm, const MPI_Info& mpiinfo) {
+    return HighFive::File(filepath, HighFive::File::Create|HighFive::File::Truncate,
+                          create_fapl(mpicomm, mpiinfo));
+}
+
+HighFive::File SonataFile::open(const std::string& filepath, const MPI_Comm& mpicomm, const MPI_Info& mpiinfo) {
+    // Creates the file only if it cannot be opened
+    return HighFive::File(filepath, HighFive::File::ReadWrite|HighFive::File::Create,
+                          create_fapl(mpicomm, mpiinfo));
+}
+
 void SonataFile::create_dataset(const std::string& name,
                                      hid_t h5type,
                                      uint64_t length,
-                                     uint64_t width) {
+                                     uint64_t width,
+                                     bool nullable) {
     const static std::unordered_set<std::string> TOPLEVEL_DATASETS{
         "edge_type_id",
         "source_node_id",
@@ -58,19 +139,43 @@ void SonataFile::create_dataset(const std::string& name,
     }
 
     if (TOPLEVEL_DATASETS.count(name) > 0) {
-        datasets_[name] = Dataset(population_group_.getId(), name, h5type, length, width, parallel_mode_);
+        datasets_[name] = Dataset(population_group_.getId(), name, h5type, length, width, parallel_mode_, layout_, nullable);
     } else {
-        datasets_[name] = Dataset(properties_group_.getId(), name, h5type, length, width, parallel_mode_);
+        datasets_[name] = Dataset(properties_group_.getId(), name, h5type, length, width, parallel_mode_, layout_, nullable);
     }
 }
 
+std::vector<char> SonataFile::fill_value(hid_t h5type) {
+    const auto size = H5Tget_size(h5type);
+    // Two's complement -1 for signed, maximum value for unsigned integers
+    std::vector<char> result(size, static_cast<char>(0xFF));
+    if (H5Tget_class(h5type) == H5T_FLOAT) {
+        if (size == sizeof(float)) {
+            const auto nan = std::numeric_limits<float>::quiet_NaN();
+            std::memcpy(result.data(), &nan, size);
+        } else if (size == sizeof(double)) {
+            const auto nan = std::numeric_limits<double>::quiet_NaN();
+            std::memcpy(result.data(), &nan, size);
+        }
+    }
+    return result;
+}
+
 void SonataFile::create_attribute(const std::string& name, const std::string& value) {
+    // Replaced when appending
+    if (population_group_.hasAttribute(name)) {
+        H5Adelete(population_group_.getId(), name.c_str());
+    }
     auto attr = population_group_.createAttribute<std::string>(name, HighFive::DataSpace::From(value));
     attr.write(value);
 }
 
 void SonataFile::create_dataset_attribute(const std::string& dataset, const std::string& name, const std::string& value) {
-    auto attr = population_group_.getDataSet(dataset).createAttribute<std::string>(name, HighFive::DataSpace::From(value));
+    auto ds = population_group_.getDataSet(dataset);
+    if (ds.hasAttribute(name)) {
+        H5Adelete(ds.getId(), name.c_str());
+    }
+    auto attr = ds.createAttribute<std::string>(name, HighFive::DataSpace::From(value));
     attr.write(value);
 }
 
@@ -78,8 +183,138 @@ void SonataFile::create_library(const std::string& name, const std::vector<std::
     properties_group_.createDataSet("@library/" + name, data);
 }
 
+std::vector<uint64_t> SonataFile::read_node_ids(const std::string& name, uint64_t offset, uint64_t count) const {
+    std::vector<uint64_t> result;
+    population_group_.getDataSet(name).select({offset}, {count}).read(result);
+    return result;
+}
+
 void SonataFile::write_indices(size_t source_size, size_t target_size, bool parallel) {
-    indexing::write(population_group_, source_size, target_size);
+    // Indexing reads the node ids back, make sure they are on disk
+    flush();
+    indexing::write(population_group_, source_size, target_size, 0, layout_.index);
+}
+
+void SonataFile::write_indices(size_t source_size, size_t target_size,
+                               indexing::FlatRawIndex source_ranges,
+                               indexing::FlatRawIndex target_ranges) {
+    // The index datasets are written collectively, staged data first
+    flush();
+    indexing::write(population_group_, source_size, target_size,
+                    std::move(source_ranges), std::move(target_ranges), 0, layout_.index);
+}
+
+WriteCounters SonataFile::write_counters() const {
+    WriteCounters total;
+    for (const auto& p: datasets_) {
+        total += p.second.counters();
+    }
+    return total;
+}
+
+std::vector<std::string> SonataFile::dataset_names(bool collective_only) const {
+    std::vector<std::string> names;
+    names.reserve(datasets_.size());
+    for (const auto& p: datasets_) {
+        if (!collective_only || p.second.collective()) {
+            names.push_back(p.first);
+        }
+    }
+    std::sort(names.begin(), names.end());
+    return names;
+}
+
+hsize_t SonataFile::round_rows() const {
+    size_t widest = 0;
+    for (const auto& p: datasets_) {
+        if (p.second.collective()) {
+            widest = std::max(widest, p.second.row_size());
+        }
+    }
+    if (widest == 0) {
+        return 0;
+    }
+    if (layout_.write_buffer_size >= widest) {
+        return layout_.write_buffer_size / widest;
+    }
+    return layout_.chunk_size > 0 ? layout_.chunk_size : DatasetLayout::DEFAULT_CHUNK_SIZE;
+}
+
+void SonataFile::set_local_records(uint64_t n_records) {
+    if (!parallel_mode_) {
+        return;
+    }
+    MPI_Comm comm = file_comm(file_);
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Allreduce(&n_records, &max_local_records_, 1, MPI_UINT64_T, MPI_MAX, comm);
+    }
+    MPI_Comm_free(&comm);
+    rounds_known_ = true;
+}
+
+void SonataFile::write_rounds() {
+    if (!rounds_known_) {
+        return;
+    }
+    const auto rows = round_rows();
+    if (rows == 0) {
+        return;
+    }
+    // Collective, every rank writes its k-th round of the datasets in the same order
+    const auto names = dataset_names(true);
+    auto full_round = [&]() {
+        return std::all_of(names.begin(), names.end(), [&](const std::string& name) {
+            return datasets_[name].staged_rows() >= rows;
+        });
+    };
+    while (full_round()) {
+        for (const auto& name: names) {
+            datasets_[name].write_round(rows);
+        }
+        ++rounds_written_;
+    }
+}
+
+void SonataFile::flush() {
+    // Flushing may be collective, iterate in the same order on all ranks
+    for (const auto& name: dataset_names()) {
+        if (!datasets_[name].collective()) {
+            datasets_[name].flush();
+        }
+    }
+
+    const auto rows = round_rows();
+    if (rows == 0) {
+        return;
+    }
+    const auto names = dataset_names(true);
+    hsize_t staged = 0;
+    for (const auto& name: names) {
+        staged = std::max(staged, datasets_[name].staged_rows());
+    }
+
+    hsize_t rounds;
+    if (rounds_known_) {
+        rounds = (max_local_records_ + rows - 1) / rows;
+        if (rounds_written_ + (staged + rows - 1) / rows > rounds) {
+            throw std::runtime_error("more rows written than set with set_local_records");
+        }
+    } else {
+        // Agree on the rounds needed by the rank with the most rows staged
+        MPI_Comm comm = file_comm(file_);
+        {
+            ScopedTimer timer(Stage::MPI);
+            MPI_Allreduce(MPI_IN_PLACE, &staged, 1, MPI_UINT64_T, MPI_MAX, comm);
+        }
+        MPI_Comm_free(&comm);
+        rounds = rounds_written_ + (staged + rows - 1) / rows;
+    }
+    for (; rounds_written_ < rounds; ++rounds_written_) {
+        for (const auto& name: names) {
+            datasets_[name].write_round(rows);
+        }
+    }
 }
 
 SonataFile::Dataset::Dataset(hid_t h5_loc,
@@ -87,21 +322,78 @@ SonataFile::Dataset::Dataset(hid_t h5_loc,
                                   hid_t h5type,
                                   uint64_t length,
                                   uint64_t w,
-                                  bool parallel)
+                                  bool parallel,
+                                  const DatasetLayout& layout,
+                                  bool nullable)
         : width(w) {
     std::vector<hsize_t> dims{length};
     if (width > 1)
         dims.push_back(width);
     dspace = H5Screate_simple(dims.size(), dims.data(), NULL);
+
+    hid_t dcpl = H5P_DEFAULT;
+    if (layout.chunked() || nullable) {
+        dcpl = H5Pcreate(H5P_DATASET_CREATE);
+        // We always write the full dataset, skip initializing it
+        H5Pset_fill_time(dcpl, H5D_FILL_TIME_NEVER);
+    }
+    if (nullable) {
+        fill_ = SonataFile::fill_value(h5type);
+        H5Pset_fill_value(dcpl, h5type, fill_.data());
+    }
+    if (layout.chunked()) {
+        auto chunk = layout.chunk_size > 0 ? layout.chunk_size : DatasetLayout::DEFAULT_CHUNK_SIZE;
+        // Chunks may not exceed fixed dimensions, and need to be non-empty
+        std::vector<hsize_t> chunk_dims{std::max<hsize_t>(1, std::min<hsize_t>(chunk, length))};
+        if (width > 1)
+            chunk_dims.push_back(width);
+
+        H5Pset_chunk(dcpl, chunk_dims.size(), chunk_dims.data());
+        if (layout.shuffle) {
+            H5Pset_shuffle(dcpl);
+        }
+        if (layout.deflate > 0) {
+            H5Pset_deflate(dcpl, layout.deflate);
+        }
+        for (const auto& [id, values]: layout.filters) {
+            if (H5Zfilter_avail(id) <= 0) {
+                H5Pclose(dcpl);
+                H5Sclose(dspace);
+                throw std::runtime_error("HDF5 filter " + std::to_string(id) + " is not available");
+            }
+            H5Pset_filter(dcpl, id, H5Z_FLAG_MANDATORY, values.size(), values.data());
+        }
+    }
+
+    if (parallel && layout.filtered()) {
+#if H5_VERSION_GE(1, 10, 2)
+        collective_ = true;
+#else
+        if (dcpl != H5P_DEFAULT) {
+            H5Pclose(dcpl);
+        }
+        H5Sclose(dspace);
+        throw std::runtime_error("parallel compression requires HDF5 1.10.2 or newer");
+#endif
+    }
+
     ds = H5Dcreate2(h5_loc, name.c_str(), h5type, dspace,
-                    H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+                    H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    if (dcpl != H5P_DEFAULT) {
+        H5Pclose(dcpl);
+    }
     if(parallel) {
         plist = H5Pcreate(H5P_DATASET_XFER);
-        H5Pset_dxpl_mpio(plist, H5FD_MPIO_INDEPENDENT);
+        H5Pset_dxpl_mpio(plist, collective_ ? H5FD_MPIO_COLLECTIVE : H5FD_MPIO_INDEPENDENT);
     } else {
         plist = H5P_DEFAULT;
     }
     dtype = h5type;
+    row_size_ = H5Tget_size(dtype) * width;
+    buffer_capacity_ = layout.write_buffer_size;
+    stripe_size_ = layout.stripe_size;
+    // Contiguous storage may only be allocated with the first write
+    file_address_ = HADDR_UNDEF;
     valid_.reset(new bool);
 }
 
@@ -112,6 +404,13 @@ SonataFile::Dataset::~Dataset() {
         return;
     }
 
+    if (!collective_) {
+        flush();
+    } else if (staged_length_ > 0) {
+        std::cerr << "WARNING: discarding " << staged_length_
+                  << " rows of a collective dataset that was not flushed" << std::endl;
+    }
+
     H5Sclose(dspace);
     H5Dclose(ds);
     if(plist != H5P_DEFAULT) {
@@ -123,23 +422,217 @@ SonataFile::Dataset::~Dataset() {
 void SonataFile::Dataset::write(const void *buffer,
                                      const hsize_t length,
                                      const hsize_t offset) {
-    hid_t memspace = H5Screate_simple(1, &length, NULL);
-    H5Sselect_hyperslab(dspace, H5S_SELECT_SET, &offset, NULL, &length, NULL);
-    H5Dwrite(ds, dtype, memspace, dspace, plist, buffer);
-    H5Sclose(memspace);
+    counters_.requests++;
+    if (length == 0) {
+        return;
+    }
+    const size_t bytes = length * row_size_;
+
+    if (collective_) {
+        // Staged until written in a round, see SonataFile::write_rounds
+        if (!segments_.empty() && segments_.back().first + segments_.back().second == offset) {
+            segments_.back().second += length;
+        } else {
+            segments_.emplace_back(offset, length);
+        }
+        const size_t start = staged_.size();
+        staged_.resize(start + bytes);
+        std::memcpy(staged_.data() + start, buffer, bytes);
+        staged_length_ += length;
+        return;
+    }
+
+    if (buffer_capacity_ == 0) {
+        write_rows(buffer, length, offset);
+        return;
+    }
+
+    if (staged_length_ > 0 && staged_offset_ + staged_length_ != offset) {
+        // Not an append: write out what we have and start over
+        flush();
+    }
+
+    if (staged_length_ == 0 && bytes >= buffer_capacity_) {
+        // Large enough on its own, avoid the copy
+        write_rows(buffer, length, offset);
+        return;
+    }
+
+    if (staged_length_ == 0) {
+        staged_offset_ = offset;
+        staged_.reserve(buffer_capacity_ + stripe_size_);
+    }
+    const size_t start = staged_.size();
+    staged_.resize(start + bytes);
+    std::memcpy(staged_.data() + start, buffer, bytes);
+    staged_length_ += length;
+
+    if (staged_.size() >= buffer_capacity_) {
+        write_staged_aligned();
+    }
 }
 
 void SonataFile::Dataset::write(const void *buffer,
                                      const hsize_t column,
                                      const hsize_t length,
                                      const hsize_t offset) {
+    if (collective_) {
+        throw std::runtime_error("column writes are not supported for collective datasets");
+    }
+    counters_.requests++;
+    // Keep the order of writes intact
+    flush();
+
     std::array<hsize_t, 2> sizes{length, 1};
     std::array<hsize_t, 2> start{offset, column};
 
     hid_t memspace = H5Screate_simple(2, sizes.data(), NULL);
     H5Sselect_hyperslab(dspace, H5S_SELECT_SET, start.data(), NULL, sizes.data(), NULL);
-    H5Dwrite(ds, dtype, memspace, dspace, plist, buffer);
+    {
+        ScopedTimer timer(Stage::H5Write, length * H5Tget_size(dtype), length);
+        H5Dwrite(ds, dtype, memspace, dspace, plist, buffer);
+    }
     H5Sclose(memspace);
+
+    counters_.writes++;
+    counters_.bytes += length * H5Tget_size(dtype);
+}
+
+void SonataFile::Dataset::write_rows(const void *buffer,
+                                     const hsize_t length,
+                                     const hsize_t offset) {
+    std::array<hsize_t, 2> sizes{length, width};
+    std::array<hsize_t, 2> start{offset, 0};
+    const int rank = width > 1 ? 2 : 1;
+
+    hid_t memspace = H5Screate_simple(rank, sizes.data(), NULL);
+    if (length > 0) {
+        H5Sselect_hyperslab(dspace, H5S_SELECT_SET, start.data(), NULL, sizes.data(), NULL);
+    } else {
+        H5Sselect_none(memspace);
+        H5Sselect_none(dspace);
+    }
+    {
+        ScopedTimer timer(Stage::H5Write, length * row_size_, length);
+        H5Dwrite(ds, dtype, memspace, dspace, plist, buffer);
+    }
+    H5Sclose(memspace);
+
+    counters_.writes++;
+    counters_.bytes += length * row_size_;
+}
+
+void SonataFile::Dataset::write_staged_aligned() {
+    if (file_address_ == HADDR_UNDEF) {
+        file_address_ = H5Dget_offset(ds);
+    }
+
+    hsize_t rows = staged_length_;
+    if (stripe_size_ > 0) {
+        // Chunked or not yet allocated datasets are aligned relative to their start
+        const haddr_t base = file_address_ == HADDR_UNDEF ? 0 : file_address_;
+        const haddr_t begin = base + staged_offset_ * row_size_;
+        const haddr_t end = begin + staged_.size();
+        const haddr_t aligned_end = end - end % stripe_size_;
+        if (aligned_end > begin && (aligned_end - begin) / row_size_ > 0) {
+            rows = (aligned_end - begin) / row_size_;
+        }
+    }
+
+    write_rows(staged_.data(), rows, staged_offset_);
+
+    // Keep the unaligned remainder for the next write
+    const size_t written = rows * row_size_;
+    std::memmove(staged_.data(), staged_.data() + written, staged_.size() - written);
+    staged_.resize(staged_.size() - written);
+    staged_offset_ += rows;
+    staged_length_ -= rows;
+}
+
+void SonataFile::Dataset::flush() {
+    if (!collective_) {
+        if (staged_length_ > 0) {
+            write_rows(staged_.data(), staged_length_, staged_offset_);
+            staged_.clear();
+            staged_length_ = 0;
+        }
+        return;
+    }
+
+    // Every rank needs to participate, even with nothing to write
+    write_round(staged_length_);
+
+    std::vector<char> empty;
+    std::swap(staged_, empty);
+}
+
+void SonataFile::Dataset::write_round(hsize_t rows) {
+    rows = std::min(rows, staged_length_);
+
+    // The staged writes making up the round, as offset and length in the
+    // file, and position in the staging buffer
+    struct Piece {
+        hsize_t offset;
+        hsize_t length;
+        size_t position;
+    };
+    std::vector<Piece> pieces;
+    size_t position = 0;
+    for (hsize_t remaining = rows; remaining > 0;) {
+        auto& [offset, length] = segments_.front();
+        const auto n = std::min(remaining, length);
+        pieces.push_back({offset, n, position});
+        position += n * row_size_;
+        remaining -= n;
+        if (n == length) {
+            segments_.pop_front();
+        } else {
+            offset += n;
+            length -= n;
+        }
+    }
+
+    // HDF5 transfers the elements of a selection in file order
+    const auto by_offset = [](const Piece& a, const Piece& b) { return a.offset < b.offset; };
+    const char* buffer = staged_.data();
+    std::vector<char> sorted;
+    if (!std::is_sorted(pieces.begin(), pieces.end(), by_offset)) {
+        std::sort(pieces.begin(), pieces.end(), by_offset);
+        sorted.resize(rows * row_size_);
+        size_t start = 0;
+        for (const auto& piece: pieces) {
+            std::memcpy(sorted.data() + start, staged_.data() + piece.position, piece.length * row_size_);
+            start += piece.length * row_size_;
+        }
+        buffer = sorted.data();
+    }
+
+    std::array<hsize_t, 2> sizes{rows, width};
+    const int rank = width > 1 ? 2 : 1;
+    hid_t memspace = H5Screate_simple(rank, sizes.data(), NULL);
+    if (rows > 0) {
+        for (size_t i = 0; i < pieces.size(); ++i) {
+            std::array<hsize_t, 2> start{pieces[i].offset, 0};
+            std::array<hsize_t, 2> count{pieces[i].length, width};
+            H5Sselect_hyperslab(dspace, i == 0 ? H5S_SELECT_SET : H5S_SELECT_OR,
+                                start.data(), NULL, count.data(), NULL);
+        }
+    } else {
+        // Every rank needs to participate, even with nothing to write
+        H5Sselect_none(memspace);
+        H5Sselect_none(dspace);
+    }
+    {
+        ScopedTimer timer(Stage::H5Write, rows * row_size_, rows);
+        H5Dwrite(ds, dtype, memspace, dspace, plist, buffer);
+    }
+    H5Sclose(memspace);
+
+    counters_.writes++;
+    counters_.bytes += rows * row_size_;
+
+    staged_.erase(staged_.begin(), staged_.begin() + rows * row_size_);
+    staged_length_ -= rows;
 }
 
 
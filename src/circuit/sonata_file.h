@@ -7,35 +7,180 @@
  */
 #pragma once
 
+#include <deque>
 #include <iostream>
 #include <stdexcept>
 #include <string>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
 #include <hdf5.h>
 #include <highfive/H5File.hpp>
 #include <mpi.h>
 
+#include "index/flat_index.h"
+#include "index/index.h"
+
 namespace neuron_parquet {
 namespace circuit {
 
 
+/**
+ * \brief Storage layout to use when creating the datasets of a SonataFile.
+ *
+ * Default constructed, datasets are contiguous, matching previous behavior.
+ * Any filter requires chunking; if no chunk size is given but a filter is
+ * requested, \c DEFAULT_CHUNK_SIZE rows are used per chunk.
+ *
+ * In parallel mode, filtered datasets can only be written collectively
+ * (requires HDF5 >= 1.10.2). Writes are then staged per rank and issued in
+ * rounds, each writing up to \c write_buffer_size bytes of the widest dataset
+ * per rank, or a chunk if that is less than a row, see
+ * SonataFile::set_local_records().
+ *
+ * Otherwise, contiguous appends to a dataset are combined in a buffer of
+ * \c write_buffer_size bytes, and written out in pieces ending on multiples of
+ * \c stripe_size within the file.
+ */
+struct DatasetLayout {
+    static constexpr hsize_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
+    /// Rows per chunk, 0 for contiguous datasets
+    hsize_t chunk_size = 0;
+    /// Deflate compression level (1-9), 0 to disable
+    unsigned deflate = 0;
+    /// Enable the byte shuffle filter (applied before compression)
+    bool shuffle = false;
+    /// Additional filters as pairs of filter id and client data values
+    std::vector<std::pair<H5Z_filter_t, std::vector<unsigned int>>> filters;
+
+    /// Bytes to accumulate per dataset before writing, 0 to write immediately
+    size_t write_buffer_size = 0;
+    /// File system stripe size to align buffered writes to, 0 to not align
+    size_t stripe_size = 0;
+
+    /// Storage of the index datasets, independent of the other datasets
+    indexing::IndexLayout index;
+
+    inline bool filtered() const {
+        return deflate > 0 || shuffle || !filters.empty();
+    }
+
+    inline bool chunked() const {
+        return chunk_size > 0 || filtered();
+    }
+};
+
+
+/**
+ * \brief Counters for the writes to a dataset.
+ */
+struct WriteCounters {
+    /// Number of write requests received
+    uint64_t requests = 0;
+    /// Number of calls to H5Dwrite issued
+    uint64_t writes = 0;
+    /// Bytes passed to H5Dwrite
+    uint64_t bytes = 0;
+
+    inline WriteCounters& operator+=(const WriteCounters& o) {
+        requests += o.requests;
+        writes += o.writes;
+        bytes += o.bytes;
+        return *this;
+    }
+};
+
+
 class SonataFile {
 public:
     class Dataset;
 
-    SonataFile(const std::string& filepath, const std::string& population_name, uint64_t n_records=0);
+    SonataFile(const std::string& filepath, const std::string& population_name, uint64_t n_records=0,
+               const DatasetLayout& layout = {});
     SonataFile(const std::string& filepath, const std::string& population_name,
-                    const MPI_Comm& mpicomm, const MPI_Info& mpiinfo, uint64_t n_records=0);
+                    const MPI_Comm& mpicomm, const MPI_Info& mpiinfo, uint64_t n_records=0,
+                    const DatasetLayout& layout = {});
+
+    /**
+     * \brief Adds the population \a population_name to an open \a file
+     *
+     * Allows several populations to be written to the same file, see
+     * SonataFile::create.  In \a parallel mode, construction is collective.
+     *
+     * If the population exists already, e.g., in a file opened with
+     * SonataFile::open, new datasets are added to it.  All of its datasets
+     * have to have \a n_records rows, and are kept as they are.
+     */
+    SonataFile(const HighFive::File& file, const std::string& population_name, bool parallel,
+               uint64_t n_records=0, const DatasetLayout& layout = {});
+
+    /// Collectively creates the file \a filepath for parallel writing, truncating it
+    static HighFive::File create(const std::string& filepath, const MPI_Comm& mpicomm, const MPI_Info& mpiinfo);
+
+    /// Collectively opens the file \a filepath for parallel writing, creating it if needed
+    static HighFive::File open(const std::string& filepath, const MPI_Comm& mpicomm, const MPI_Info& mpiinfo);
 
     SonataFile(SonataFile&&) = default;
     ~SonataFile() = default;
 
     void write_indices(size_t source_size, size_t target_size, bool parallel=false);
+    /// Writes the indices from node ranges collected during the conversion
+    void write_indices(size_t source_size, size_t target_size,
+                       indexing::FlatRawIndex source_ranges,
+                       indexing::FlatRawIndex target_ranges);
+
+    /**
+     * \brief Sets the number of rows this rank writes to every dataset
+     *
+     * Collective in parallel mode, to agree on the number of rounds in which
+     * collective datasets are written.  Rounds are then written as soon as
+     * every dataset has a full round staged, see write_rounds(), otherwise
+     * all rows are staged until flush().
+     */
+    void set_local_records(uint64_t n_records);
+
+    /**
+     * \brief Collectively writes the full rounds staged by every collective dataset
+     *
+     * All datasets have to have received the same rows, i.e., this has to be
+     * called after writing the same rows to every dataset.  No-op if the
+     * number of rounds is not known, see set_local_records().
+     */
+    void write_rounds();
+
+    /**
+     * \brief Writes out any data staged by the datasets.
+     *
+     * Collective in parallel mode: every rank has to call this, with the
+     * same datasets created.  Ranks that wrote fewer rows take part in the
+     * remaining rounds of others without writing.
+     */
+    void flush();
+
+    /// Sum of the write counters of all datasets
+    WriteCounters write_counters() const;
 
     void create_attribute(const std::string& name, const std::string& value);
     void create_dataset_attribute(const std::string& dataset, const std::string& name, const std::string& value);
 
-    void create_dataset(const std::string& name, hid_t h5type, uint64_t length=0, uint64_t width=1);
+    /**
+     * \brief Creates a dataset named \a name
+     *
+     * Nullable datasets record SonataFile::fill_value for their type as the
+     * HDF5 fill value, to be written in place of missing values.
+     */
+    void create_dataset(const std::string& name, hid_t h5type, uint64_t length=0, uint64_t width=1,
+                        bool nullable=false);
+
+    /**
+     * \brief The value used to represent nulls for \a h5type
+     *
+     * NaN for floating point types, all bits set (i.e., -1 or the maximum)
+     * for integers.
+     */
+    static std::vector<char> fill_value(hid_t h5type);
 
     /**
      * \brief Creates a library dataset under \c @library named \a name, with \a data as
@@ -51,6 +196,18 @@ public:
         return datasets_.count(name) > 0;
     }
 
+    /// Whether \a name was stored in the population before it was opened
+    inline bool stored_dataset(const std::string& name) const {
+        return stored_.count(name) > 0;
+    }
+
+    /// Reads \a count values of the stored node IDs \a name, starting at row \a offset
+    std::vector<uint64_t> read_node_ids(const std::string& name, uint64_t offset, uint64_t count) const;
+
+    inline bool has_indices() const {
+        return population_group_.exist("indices");
+    }
+
     inline Dataset& operator[](const std::string& name) {
         return datasets_.at(name);
     }
@@ -63,7 +220,8 @@ public:
     class Dataset {
     public:
         Dataset(hid_t h5_loc, const std::string& name, hid_t h5type, uint64_t length,
-                uint64_t width=1, bool parallel=false);
+                uint64_t width=1, bool parallel=false, const DatasetLayout& layout = {},
+                bool nullable=false);
         Dataset() {}
         ~Dataset();
 
@@ -82,9 +240,72 @@ public:
                    const hsize_t length,
                    const hsize_t h5offset);
 
+        /**
+         * \brief Writes staged data to disk
+         *
+         * For collective datasets, all ranks have to call this method, and
+         * all staged rows are written at once.  Buffered data of other
+         * datasets is also flushed on destruction.
+         */
+        void flush();
+
+        /**
+         * \brief Collectively writes the first \a rows staged rows
+         *
+         * Ranks with fewer rows staged write all of them, possibly none.
+         */
+        void write_round(hsize_t rows);
+
+        inline bool collective() const {
+            return collective_;
+        }
+
+        /// Rows staged and not written yet
+        inline hsize_t staged_rows() const {
+            return staged_length_;
+        }
+
+        /// Size in bytes of a full row
+        inline size_t row_size() const {
+            return row_size_;
+        }
+
+        inline const WriteCounters& counters() const {
+            return counters_;
+        }
+
+        /// Size in bytes of a single element
+        inline size_t element_size() const {
+            return row_size_ / width;
+        }
+
+        /// Bytes of the fill value to use for nulls, empty if not nullable
+        inline const std::vector<char>& fill_value() const {
+            return fill_;
+        }
+
     protected:
+        /// Writes \a length full rows to the file, starting at row \a offset
+        void write_rows(const void* buffer, hsize_t length, hsize_t offset);
+        /// Writes the largest part of the staged rows that ends on a stripe boundary
+        void write_staged_aligned();
+
         hid_t ds, plist, dspace, dtype;
         uint64_t width;
+        size_t row_size_ = 0;
+        std::vector<char> fill_;
+        // Collective writes are staged in memory until written in a round,
+        // independent ones until the buffer capacity is reached
+        bool collective_ = false;
+        size_t buffer_capacity_ = 0;
+        size_t stripe_size_ = 0;
+        haddr_t file_address_ = 0;
+        std::vector<char> staged_;
+        hsize_t staged_offset_ = 0;
+        hsize_t staged_length_ = 0;
+        // Offset and length of the staged collective writes, in order
+        std::deque<std::pair<hsize_t, hsize_t>> segments_;
+        WriteCounters counters_;
         // Keep control after moves if this is a valid object
         // unique_ptr's work, they init as "false" and become "false" after moved.
         std::unique_ptr<bool> valid_;
@@ -94,12 +315,23 @@ public:
 protected:
     SonataFile() = default;
 
+    /// The sorted names of the datasets, optionally only the collective ones
+    std::vector<std::string> dataset_names(bool collective_only = false) const;
+    /// Rows per rank and round of the collective datasets, 0 if there are none
+    hsize_t round_rows() const;
+
     bool parallel_mode_;
+    DatasetLayout layout_;
     HighFive::File file_;
     HighFive::Group population_group_;
     HighFive::Group properties_group_;
     uint64_t n_records_;
     std::unordered_map<std::string, Dataset> datasets_;
+    std::unordered_set<std::string> stored_;
+    /// Rounds to write the collective datasets in, if known, and written so far
+    bool rounds_known_ = false;
+    uint64_t max_local_records_ = 0;
+    hsize_t rounds_written_ = 0;
 };
 
 }} //NS
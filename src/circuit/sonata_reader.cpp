@@ -0,0 +1,421 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include "sonata_reader.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <stdexcept>
+
+#include <arrow/ipc/writer.h>
+#include <arrow/util/base64.h>
+#include <arrow/util/bit_util.h>
+#include <arrow/util/key_value_metadata.h>
+#include <nlohmann/json.hpp>
+#include <parquet/arrow/schema.h>
+#include <parquet/exception.h>
+
+#include "stats.hpp"
+
+namespace neuron_parquet {
+namespace circuit {
+
+namespace {
+
+static const std::string SPARK_METADATA = "org.apache.spark.sql.parquet.row.metadata";
+
+/// Datasets of the population group that are stored as columns
+static const std::vector<std::string> TOPLEVEL_DATASETS{
+    "source_node_id", "target_node_id", "edge_type_id"};
+
+auto create_fapl(MPI_Comm comm, MPI_Info info) {
+    HighFive::FileAccessProps fapl;
+    fapl.add(HighFive::MPIOFileAccess{comm, info});
+    return fapl;
+}
+
+std::shared_ptr<arrow::DataType> h5_to_arrow_type(hid_t h5type) {
+    const auto size = H5Tget_size(h5type);
+    switch (H5Tget_class(h5type)) {
+        case H5T_INTEGER: {
+            const bool is_signed = H5Tget_sign(h5type) == H5T_SGN_2;
+            switch (size) {
+                case 1:
+                    return is_signed ? arrow::int8() : arrow::uint8();
+                case 2:
+                    return is_signed ? arrow::int16() : arrow::uint16();
+                case 4:
+                    return is_signed ? arrow::int32() : arrow::uint32();
+                case 8:
+                    return is_signed ? arrow::int64() : arrow::uint64();
+                default:
+                    break;
+            }
+            break;
+        }
+        case H5T_FLOAT:
+            if (size == sizeof(float)) {
+                return arrow::float32();
+            } else if (size == sizeof(double)) {
+                return arrow::float64();
+            }
+            break;
+        default:
+            break;
+    }
+    return nullptr;
+}
+
+/// The type Spark reads a Parquet column of \a type as
+nlohmann::json spark_type(const arrow::DataType& type) {
+    switch (type.id()) {
+        case arrow::Type::INT8:
+            return "byte";
+        case arrow::Type::INT16:
+        case arrow::Type::UINT8:
+            return "short";
+        case arrow::Type::INT32:
+        case arrow::Type::UINT16:
+            return "integer";
+        case arrow::Type::INT64:
+        case arrow::Type::UINT32:
+            return "long";
+        case arrow::Type::UINT64:
+            return "decimal(20,0)";
+        case arrow::Type::FLOAT:
+            return "float";
+        case arrow::Type::DOUBLE:
+            return "double";
+        case arrow::Type::DICTIONARY:
+            return "string";
+        case arrow::Type::FIXED_SIZE_LIST: {
+            const auto& list = static_cast<const arrow::FixedSizeListType&>(type);
+            return {{"type", "array"},
+                    {"elementType", spark_type(*list.value_type())},
+                    {"containsNull", list.value_field()->nullable()}};
+        }
+        default:
+            throw std::runtime_error("no Spark type for " + type.ToString());
+    }
+}
+
+}  // unnamed namespace
+
+
+SonataReader::SonataReader(const std::string& filename,
+                           const std::string& population,
+                           MPI_Comm comm,
+                           MPI_Info info,
+                           uint64_t rows_per_block)
+    : comm_(comm)
+    , file_(filename, HighFive::File::ReadOnly, create_fapl(comm, info))
+    , rows_per_block_(rows_per_block)
+{
+    if (rows_per_block_ == 0) {
+        throw std::runtime_error("blocks need at least one row");
+    }
+    int rank, size;
+    MPI_Comm_rank(comm_, &rank);
+    MPI_Comm_size(comm_, &size);
+
+    const auto group = file_.getGroup("edges/" + population);
+    total_ = group.getDataSet("source_node_id").getDimensions()[0];
+    offset_ = total_ * rank / size;
+    count_ = total_ * (rank + 1) / size - offset_;
+
+    for (const auto& name: TOPLEVEL_DATASETS) {
+        if (group.exist(name)) {
+            add_column(group, name, nullptr);
+        }
+    }
+    if (group.exist("0")) {
+        const auto properties = group.getGroup("0");
+        std::unique_ptr<HighFive::Group> library;
+        if (properties.exist("@library")) {
+            library = std::make_unique<HighFive::Group>(properties.getGroup("@library"));
+        }
+        auto names = properties.listObjectNames();
+        std::sort(names.begin(), names.end());
+        for (const auto& name: names) {
+            if (properties.getObjectType(name) != HighFive::ObjectType::Dataset) {
+                continue;
+            }
+            if (properties.getDataSet(name).getDimensions()[0] != total_) {
+                if (rank == 0) {
+                    std::cerr << "WARNING: skipping dataset " << name
+                              << ", its length differs from the edge count" << std::endl;
+                }
+                continue;
+            }
+            add_column(properties, name, library.get());
+        }
+    }
+
+    std::vector<std::shared_ptr<arrow::Field>> fields;
+    for (const auto& column: columns_) {
+        const bool nullable = !column.fill.empty() && column.width == 1;
+        fields.push_back(arrow::field(column.name, column.type, nullable));
+    }
+    schema_ = arrow::schema(fields);
+
+    const auto source_nodes = node_count(group, "source_to_target", "source_node_id");
+    const auto target_nodes = node_count(group, "target_to_source", "target_node_id");
+    create_metadata(group, source_nodes, target_nodes);
+
+    PARQUET_THROW_NOT_OK(parquet::arrow::ToParquetSchema(schema_.get(),
+                                                         *parquet::default_writer_properties(),
+                                                         *parquet::default_arrow_writer_properties(),
+                                                         &parquet_schema_));
+}
+
+
+SonataReader::~SonataReader() {
+    for (auto& column: columns_) {
+        H5Tclose(column.memtype);
+        H5Dclose(column.dataset);
+    }
+}
+
+
+void SonataReader::add_column(const HighFive::Group& group,
+                              const std::string& name,
+                              const HighFive::Group* library) {
+    Column column;
+    column.name = name;
+    column.dataset = H5Dopen2(group.getId(), name.c_str(), H5P_DEFAULT);
+    if (column.dataset < 0) {
+        throw std::runtime_error("could not open dataset " + name);
+    }
+
+    const hid_t space = H5Dget_space(column.dataset);
+    hsize_t dims[2] = {0, 1};
+    const int rank = H5Sget_simple_extent_ndims(space);
+    if (rank < 1 || rank > 2) {
+        H5Sclose(space);
+        H5Dclose(column.dataset);
+        throw std::runtime_error("dataset " + name + " has to be one or two dimensional");
+    }
+    H5Sget_simple_extent_dims(space, dims, nullptr);
+    H5Sclose(space);
+    column.width = rank == 2 ? dims[1] : 1;
+
+    const hid_t filetype = H5Dget_type(column.dataset);
+    column.memtype = H5Tget_native_type(filetype, H5T_DIR_ASCEND);
+    H5Tclose(filetype);
+    column.element_size = H5Tget_size(column.memtype);
+    const auto value_type = h5_to_arrow_type(column.memtype);
+    if (!value_type) {
+        H5Tclose(column.memtype);
+        H5Dclose(column.dataset);
+        throw std::runtime_error("dataset " + name + " has an unsupported type");
+    }
+
+    // Only nullable columns are written with a fill value
+    const hid_t dcpl = H5Dget_create_plist(column.dataset);
+    H5D_fill_value_t fill_status;
+    H5Pfill_value_defined(dcpl, &fill_status);
+    if (fill_status == H5D_FILL_VALUE_USER_DEFINED) {
+        column.fill.resize(column.element_size);
+        H5Pget_fill_value(dcpl, column.memtype, column.fill.data());
+    }
+    H5Pclose(dcpl);
+
+    if (column.width == 1 && library && library->exist(name)) {
+        std::vector<std::string> values;
+        library->getDataSet(name).read(values);
+        arrow::StringBuilder builder;
+        PARQUET_THROW_NOT_OK(builder.AppendValues(values));
+        PARQUET_THROW_NOT_OK(builder.Finish(&column.dictionary));
+        column.type = arrow::dictionary(arrow::int32(), arrow::utf8());
+    } else if (column.width > 1) {
+        column.type = arrow::fixed_size_list(arrow::field("item", value_type, !column.fill.empty()),
+                                             column.width);
+    } else {
+        column.type = value_type;
+    }
+    columns_.push_back(std::move(column));
+}
+
+
+uint64_t SonataReader::node_count(const HighFive::Group& population,
+                                  const std::string& direction,
+                                  const std::string& dataset) {
+    if (population.exist("indices") && population.getGroup("indices").exist(direction)) {
+        return population.getGroup("indices/" + direction)
+            .getDataSet("node_id_to_ranges")
+            .getDimensions()[0];
+    }
+
+    // Not indexed, every rank scans its share of the node IDs
+    const auto node_ids = population.getDataSet(dataset);
+    const hid_t ds = node_ids.getId();
+    const hid_t filespace = H5Dget_space(ds);
+    std::vector<uint64_t> ids;
+    uint64_t local = 0;
+    for (uint64_t start = 0; start < count_; start += rows_per_block_) {
+        const hsize_t offset = offset_ + start;
+        const hsize_t rows = std::min(rows_per_block_, count_ - start);
+        ids.resize(rows);
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, &offset, nullptr, &rows, nullptr);
+        const hid_t memspace = H5Screate_simple(1, &rows, nullptr);
+        const auto status = H5Dread(ds, H5T_NATIVE_UINT64, memspace, filespace, H5P_DEFAULT, ids.data());
+        H5Sclose(memspace);
+        if (status < 0) {
+            H5Sclose(filespace);
+            throw std::runtime_error("could not read dataset " + dataset);
+        }
+        for (const auto id: ids) {
+            local = std::max(local, id + 1);
+        }
+    }
+    H5Sclose(filespace);
+
+    uint64_t global;
+    MPI_Allreduce(&local, &global, 1, MPI_UINT64_T, MPI_MAX, comm_);
+    return global;
+}
+
+
+void SonataReader::create_metadata(const HighFive::Group& population,
+                                   uint64_t source_nodes,
+                                   uint64_t target_nodes) {
+    auto kv = std::make_shared<arrow::KeyValueMetadata>();
+
+    // Other key-value pairs are stored by SonataWriter::setup as attributes
+    for (const auto& name: population.listAttributeNames()) {
+        const auto attr = population.getAttribute(name);
+        if (name == "parquet2hdf5_version" || H5Tget_class(attr.getDataType().getId()) != H5T_STRING) {
+            continue;
+        }
+        std::string value;
+        attr.read(value);
+        kv->Append(name, value);
+    }
+    for (const auto& direction: {"source", "target"}) {
+        const std::string dataset = std::string(direction) + "_node_id";
+        const auto ds = population.getDataSet(dataset);
+        if (ds.hasAttribute("node_population")) {
+            std::string value;
+            ds.getAttribute("node_population").read(value);
+            kv->Append(std::string(direction) + "_population_name", value);
+        }
+    }
+    kv->Append("source_population_size", std::to_string(source_nodes));
+    kv->Append("target_population_size", std::to_string(target_nodes));
+
+    nlohmann::json fields = nlohmann::json::array();
+    for (size_t i = 0; i < columns_.size(); ++i) {
+        const auto& field = schema_->field(i);
+        nlohmann::json metadata = nlohmann::json::object();
+        if (columns_[i].dictionary) {
+            const auto& values = static_cast<const arrow::StringArray&>(*columns_[i].dictionary);
+            std::vector<std::string> enumeration;
+            for (int64_t j = 0; j < values.length(); ++j) {
+                enumeration.emplace_back(values.GetView(j));
+            }
+            metadata["enumeration_values"] = enumeration;
+        }
+        fields.push_back({{"name", field->name()},
+                          {"type", spark_type(*field->type())},
+                          {"nullable", field->nullable()},
+                          {"metadata", metadata}});
+    }
+    kv->Append(SPARK_METADATA, nlohmann::json{{"type", "struct"}, {"fields", fields}}.dump());
+
+    // Restores dictionaries, lists and unsigned types from the Parquet schema,
+    // as stored by Arrow's own Parquet writer
+    PARQUET_ASSIGN_OR_THROW(auto serialized, arrow::ipc::SerializeSchema(*schema_));
+    kv->Append("ARROW:schema", arrow::util::base64_encode(serialized->ToString()));
+
+    metadata_ = kv;
+}
+
+
+std::shared_ptr<arrow::Array> SonataReader::read(const Column& column, uint64_t offset, uint64_t rows) {
+    const uint64_t n = rows * column.width;
+    PARQUET_ASSIGN_OR_THROW(std::shared_ptr<arrow::Buffer> data,
+                            arrow::AllocateBuffer(n * column.element_size));
+
+    const hsize_t start[2] = {offset, 0};
+    const hsize_t count[2] = {rows, column.width};
+    const hsize_t elements = n;
+    const hid_t filespace = H5Dget_space(column.dataset);
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, nullptr, count, nullptr);
+    const hid_t memspace = H5Screate_simple(1, &elements, nullptr);
+    const auto status = H5Dread(column.dataset, column.memtype, memspace, filespace,
+                                H5P_DEFAULT, data->mutable_data());
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    if (status < 0) {
+        throw std::runtime_error("could not read dataset " + column.name);
+    }
+
+    std::shared_ptr<arrow::Buffer> validity;
+    int64_t nulls = 0;
+    if (!column.fill.empty()) {
+        PARQUET_ASSIGN_OR_THROW(validity, arrow::AllocateEmptyBitmap(n));
+        const char* values = reinterpret_cast<const char*>(data->data());
+        for (uint64_t i = 0; i < n; ++i) {
+            if (std::memcmp(values + i * column.element_size, column.fill.data(), column.element_size) != 0) {
+                arrow::bit_util::SetBit(validity->mutable_data(), i);
+            } else {
+                ++nulls;
+            }
+        }
+        if (nulls == 0) {
+            validity.reset();
+        }
+    }
+
+    if (column.dictionary) {
+        // Stored as unsigned 32 bit integers, all below the library size
+        auto indices = reinterpret_cast<int32_t*>(data->mutable_data());
+        if (nulls > 0) {
+            for (uint64_t i = 0; i < n; ++i) {
+                if (!arrow::bit_util::GetBit(validity->data(), i)) {
+                    indices[i] = 0;
+                }
+            }
+        }
+        const auto index_array = arrow::MakeArray(
+            arrow::ArrayData::Make(arrow::int32(), n, {validity, data}, nulls));
+        return std::make_shared<arrow::DictionaryArray>(column.type, index_array, column.dictionary);
+    }
+
+    const auto value_type = column.width > 1
+        ? static_cast<const arrow::FixedSizeListType&>(*column.type).value_type()
+        : column.type;
+    auto values = arrow::ArrayData::Make(value_type, n, {validity, data}, nulls);
+    if (column.width == 1) {
+        return arrow::MakeArray(values);
+    }
+    return arrow::MakeArray(arrow::ArrayData::Make(column.type, rows, {nullptr}, {values}, 0));
+}
+
+
+uint32_t SonataReader::fillBuffer(CircuitData* buf, uint32_t length) {
+    (void) length;  // the client always gets a full block, as for Parquet
+    const uint64_t start = block_ * rows_per_block_;
+    if (start >= count_) {
+        return 0;
+    }
+    const uint64_t rows = std::min(rows_per_block_, count_ - start);
+
+    std::vector<std::shared_ptr<arrow::Array>> arrays;
+    uint64_t bytes = 0;
+    for (const auto& column: columns_) {
+        arrays.push_back(read(column, offset_ + start, rows));
+        bytes += rows * column.width * column.element_size;
+    }
+    buf->row_group = arrow::Table::Make(schema_, arrays, rows);
+    utils::stats::count(utils::stats::Stage::Read, bytes);
+    ++block_;
+    return rows;
+}
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
@@ -0,0 +1,132 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <hdf5.h>
+#include <highfive/H5File.hpp>
+#include <mpi.h>
+
+#include <arrow/api.h>
+#include <parquet/schema.h>
+
+#include "../generic_reader.h"
+#include "circuit_defs.h"
+
+namespace neuron_parquet {
+namespace circuit {
+
+
+///
+/// \brief The SonataReader reads an edge population of a SONATA file as row groups.
+///
+/// Every rank of the communicator reads a contiguous share of the edges in
+/// blocks of \c rows_per_block rows, as hyperslabs of all datasets.  The
+/// schema and key-value metadata follow what SonataWriter::setup consumes:
+///  - \c @library enumerations become dictionary columns, with their values
+///    also listed as \c enumeration_values in the Spark row metadata,
+///  - 2D datasets become fixed size lists,
+///  - fill values of nullable datasets become nulls,
+///  - the \c node_population attributes and node counts become
+///    \c {source,target}_population_{name,size},
+///  - other string attributes of the population are kept as they are.
+///
+/// The node counts are taken from the dimensions of the indices, or from
+/// the largest node IDs if the population is not indexed.  Construction is
+/// collective.
+///
+class SonataReader : public Reader<CircuitData> {
+ public:
+    static constexpr uint64_t DEFAULT_ROWS_PER_BLOCK = 1024 * 1024;
+
+    SonataReader(const std::string& filename,
+                 const std::string& population,
+                 MPI_Comm comm,
+                 MPI_Info info,
+                 uint64_t rows_per_block = DEFAULT_ROWS_PER_BLOCK);
+
+    ~SonataReader();
+
+    bool is_chunked() const override {
+        return true;
+    }
+
+    /// Edges read by this rank
+    uint64_t record_count() const override {
+        return count_;
+    }
+
+    uint32_t block_count() const override {
+        return (count_ + rows_per_block_ - 1) / rows_per_block_;
+    }
+
+    /// Edges of the population on all ranks
+    uint64_t population_size() const {
+        return total_;
+    }
+
+    void seek(uint64_t pos) override {
+        block_ = pos;
+    }
+
+    uint32_t fillBuffer(CircuitData* buf, uint32_t length) override;
+
+    virtual const CircuitData::Schema* schema() const override {
+        return parquet_schema_.get();
+    }
+
+    virtual const std::shared_ptr<const CircuitData::Metadata> metadata() const override {
+        return metadata_;
+    }
+
+    /// The Arrow schema of the row groups read
+    std::shared_ptr<arrow::Schema> arrow_schema() const {
+        return schema_;
+    }
+
+ private:
+    struct Column {
+        std::string name;
+        hid_t dataset;
+        /// Memory type to read into
+        hid_t memtype;
+        uint64_t width;
+        size_t element_size;
+        /// Fill value bytes of nullable datasets, empty otherwise
+        std::vector<char> fill;
+        /// Values of @library enumerations, stored as indices
+        std::shared_ptr<arrow::Array> dictionary;
+        std::shared_ptr<arrow::DataType> type;
+    };
+
+    /// Adds a column for a dataset, an enumeration if listed in \a library
+    void add_column(const HighFive::Group& group, const std::string& name,
+                    const HighFive::Group* library);
+    uint64_t node_count(const HighFive::Group& population, const std::string& direction,
+                        const std::string& dataset);
+    void create_metadata(const HighFive::Group& population,
+                         uint64_t source_nodes, uint64_t target_nodes);
+    std::shared_ptr<arrow::Array> read(const Column& column, uint64_t offset, uint64_t rows);
+
+    MPI_Comm comm_;
+    HighFive::File file_;
+    std::vector<Column> columns_;
+    std::shared_ptr<arrow::Schema> schema_;
+    std::shared_ptr<parquet::SchemaDescriptor> parquet_schema_;
+    std::shared_ptr<const CircuitData::Metadata> metadata_;
+
+    const uint64_t rows_per_block_;
+    uint64_t total_ = 0;
+    uint64_t offset_ = 0;
+    uint64_t count_ = 0;
+    uint64_t block_ = 0;
+};
+
+
+}  // namespace circuit
+}  // namespace neuron_parquet
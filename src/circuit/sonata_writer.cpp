@@ -7,12 +7,17 @@
  */
 #include "sonata_writer.h"
 
+#include <array>
+#include <cstring>
 #include <functional>
 #include <thread>
 #include <iostream>
 #include <unordered_set>
 
+#include <arrow/util/bit_util.h>
+#include <arrow/util/endian.h>
 #include <nlohmann/json.hpp>
+#include <parquet/arrow/schema.h>
 #include <range/v3/view.hpp>
 
 #include "version.h"
@@ -27,12 +32,131 @@ using namespace std;
 
 
 static const unordered_set<string> COLUMNS_TO_SKIP{"synapse_id", "__index_level_0__"};
+static const string SPARK_METADATA = "org.apache.spark.sql.parquet.row.metadata";
+
+/// Type used to store the indices of string columns into their enumeration
+static const hid_t ENUMERATION_H5_TYPE = H5T_STD_U32LE;
+
+
+namespace {
+
+shared_ptr<Schema> to_arrow_schema(const CircuitData::Schema* schema,
+                                   const shared_ptr<const CircuitData::Metadata>& metadata) {
+    // The Arrow schema also restores types such as fixed size lists or
+    // dictionaries from the stored Arrow metadata
+    shared_ptr<Schema> arrow_schema;
+    const auto status = parquet::arrow::FromParquetSchema(
+        schema, parquet::default_arrow_reader_properties(), metadata, &arrow_schema);
+    if (!status.ok()) {
+        throw std::runtime_error(status.ToString());
+    }
+    return arrow_schema;
+}
+
+/// Extracts the enumeration values from Spark's column metadata
+std::map<string, vector<string>> spark_enumerations(const shared_ptr<const CircuitData::Metadata>& metadata) {
+    std::map<string, vector<string>> result;
+    const auto idx = metadata ? metadata->FindKey(SPARK_METADATA) : -1;
+    if (idx < 0) {
+        return result;
+    }
+    auto j = nlohmann::json::parse(metadata->value(idx));
+    for (const auto& field: j["fields"]) {
+        const auto metadata = field["metadata"];
+        const auto name = field["name"];
+        if (metadata.contains("enumeration_values")) {
+            result[name] = metadata["enumeration_values"].get<vector<string>>();
+        }
+    }
+    return result;
+}
+
+inline bool is_string_like(const DataType& type) {
+    switch (type.id()) {
+        case Type::STRING:
+        case Type::LARGE_STRING:
+        case Type::BINARY:
+        case Type::LARGE_BINARY:
+            return true;
+        case Type::DICTIONARY:
+            return is_string_like(*static_cast<const DictionaryType&>(type).value_type());
+        default:
+            return false;
+    }
+}
+
+inline std::string_view string_at(const Array& array, int64_t i) {
+    switch (array.type_id()) {
+        case Type::STRING:
+        case Type::BINARY:
+            return static_cast<const BinaryArray&>(array).GetView(i);
+        case Type::LARGE_STRING:
+        case Type::LARGE_BINARY:
+            return static_cast<const LargeBinaryArray&>(array).GetView(i);
+        default:
+            throw std::runtime_error("cannot read strings from " + array.type()->ToString());
+    }
+}
+
+/// Unpacks \a length bits starting at bit \a offset into one byte per bit
+void unpack_bits(const uint8_t* bitmap, int64_t offset, int64_t length, uint8_t* out) {
+    // Each byte of the bitmap expands into 8 bytes, bit i going to byte i
+    static const auto table = [] {
+        std::array<uint64_t, 256> t{};
+        for (uint64_t b = 0; b < 256; ++b) {
+            for (int k = 0; k < 8; ++k) {
+                t[b] |= ((b >> k) & 1) << (8 * k);
+            }
+        }
+        return t;
+    }();
+    static_assert(ARROW_LITTLE_ENDIAN, "unpacking bits assumes a little endian layout");
+
+    int64_t i = 0;
+    for (; i < length && (offset + i) % 8 != 0; ++i) {
+        out[i] = bit_util::GetBit(bitmap, offset + i);
+    }
+    const uint8_t* bytes = bitmap + (offset + i) / 8;
+    for (; i + 8 <= length; i += 8, ++bytes) {
+        std::memcpy(out + i, &table[*bytes], 8);
+    }
+    for (; i < length; ++i) {
+        out[i] = bit_util::GetBit(bitmap, offset + i);
+    }
+}
+
+/// Calls \a f with the values and the length of a chunk of node IDs
+template <typename F>
+void visit_node_ids(const Array& chunk, F&& f) {
+    if (chunk.null_count() > 0) {
+        throw std::runtime_error("node ids must not be null");
+    }
+    switch (chunk.type_id()) {
+        case Type::INT32:
+            f(static_cast<const Int32Array&>(chunk).raw_values(), chunk.length());
+            break;
+        case Type::UINT32:
+            f(static_cast<const UInt32Array&>(chunk).raw_values(), chunk.length());
+            break;
+        case Type::INT64:
+            f(static_cast<const Int64Array&>(chunk).raw_values(), chunk.length());
+            break;
+        case Type::UINT64:
+            f(static_cast<const UInt64Array&>(chunk).raw_values(), chunk.length());
+            break;
+        default:
+            throw std::runtime_error("node ids of type " + chunk.type()->ToString() + " are not supported");
+    }
+}
+
+}  // anonymous namespace
 
 
 SonataWriter::SonataWriter(const string & filepath,
                                      uint64_t n_records,
-                                     const string& population_name)
-  : sonata_file_(filepath, population_name, n_records),
+                                     const string& population_name,
+                                     const DatasetLayout& layout)
+  : sonata_file_(filepath, population_name, n_records, layout),
     total_records_(n_records),
     population_name_(population_name),
     output_file_offset_(0)
@@ -42,8 +166,20 @@ SonataWriter::SonataWriter(const string & filepath,
                                      uint64_t n_records,
                                      const MPI_Params& mpi_params,
                                      uint64_t output_offset,
-                                     const string& population_name)
-  : sonata_file_(filepath, population_name, mpi_params.comm, mpi_params.info, n_records),
+                                     const string& population_name,
+                                     const DatasetLayout& layout)
+  : sonata_file_(filepath, population_name, mpi_params.comm, mpi_params.info, n_records, layout),
+    total_records_(n_records),
+    population_name_(population_name),
+    output_file_offset_(output_offset)
+{ }
+
+SonataWriter::SonataWriter(const HighFive::File& file,
+                                     uint64_t n_records,
+                                     uint64_t output_offset,
+                                     const string& population_name,
+                                     const DatasetLayout& layout)
+  : sonata_file_(file, population_name, true, n_records, layout),
     total_records_(n_records),
     population_name_(population_name),
     output_file_offset_(output_offset)
@@ -69,20 +205,92 @@ void throw_invalid_column(const std::string& col_name,
 }
 
 
+std::vector<std::string> SonataWriter::unenumerated_columns(const CircuitData::Schema* schema,
+                                                            std::shared_ptr<const CircuitData::Metadata> metadata) {
+    const auto enumerations = spark_enumerations(metadata);
+    std::vector<std::string> result;
+    // Keep the schema alive, the loop would only hold on to its fields
+    const auto arrow_schema = to_arrow_schema(schema, metadata);
+    for (const auto& field: arrow_schema->fields()) {
+        if (is_string_like(*field->type()) && enumerations.count(field->name()) == 0 &&
+            COLUMNS_TO_SKIP.count(field->name()) == 0) {
+            result.push_back(field->name());
+        }
+    }
+    return result;
+}
+
+
 void SonataWriter::setup(const CircuitData::Schema* schema, std::shared_ptr<const CircuitData::Metadata> metadata) {
-    for (int i = 0; i < schema->num_columns(); ++i) {
-        const auto& col = schema->Column(i);
-        const auto col_name = col->name();
+    for (auto& [name, values]: spark_enumerations(metadata)) {
+        enumerations_[name] = std::move(values);
+    }
+
+    const auto arrow_schema = to_arrow_schema(schema, metadata);
+    for (const auto& field: arrow_schema->fields()) {
+        const auto& col_name = field->name();
         if (COLUMNS_TO_SKIP.count(col_name) > 0) {
             continue;
         }
-
-        const auto col_type = parquet_types_to_h5(col->physical_type(), col->converted_type());
-        if (col_type < 0) {
-            throw std::runtime_error("column " + col_name + " cannot be converted");
-        }
-        if (!sonata_file_.has_dataset(col_name)) {
-            sonata_file_.create_dataset(col_name, col_type, 0, 1);
+        const bool nullable = nullable_.count(col_name) > 0;
+
+        if (field->type()->id() == Type::STRUCT) {
+            // Structs of primitives are split into one dataset per field,
+            // i.e., `position` with fields `x`, `y` becomes `position_x`, …
+            for (const auto& child: field->type()->fields()) {
+                const auto name = col_name + "_" + child->name();
+                const auto child_type = arrow_types_to_h5(*child->type());
+                if (child_type < 0) {
+                    throw std::runtime_error("column " + col_name + "." + child->name() + " cannot be converted");
+                }
+                if (sonata_file_.stored_dataset(name)) {
+                    kept_.insert(name);
+                } else if (!sonata_file_.has_dataset(name)) {
+                    sonata_file_.create_dataset(name, child_type, 0, 1, nullable);
+                }
+            }
+        } else if (field->type()->id() == Type::FIXED_SIZE_LIST) {
+            // Fixed size lists become 2D datasets with one list per row
+            const auto& list_type = static_cast<const FixedSizeListType&>(*field->type());
+            const auto col_type = arrow_types_to_h5(*list_type.value_type());
+            if (col_type < 0) {
+                throw std::runtime_error("column " + col_name + " cannot be converted");
+            }
+            if (sonata_file_.stored_dataset(col_name)) {
+                kept_.insert(col_name);
+            } else if (!sonata_file_.has_dataset(col_name)) {
+                sonata_file_.create_dataset(col_name, col_type, 0, list_type.list_size(), nullable);
+            }
+        } else if (is_string_like(*field->type())) {
+            // Strings are stored as indices into an @library enumeration
+            const auto it = enumerations_.find(col_name);
+            if (it == enumerations_.end()) {
+                throw std::runtime_error("column " + col_name + " has no enumeration values");
+            }
+            auto& lookup = enumeration_lookup_[col_name];
+            for (uint32_t i = 0; i < it->second.size(); ++i) {
+                lookup.emplace(it->second[i], i);
+            }
+            if (sonata_file_.stored_dataset(col_name)) {
+                kept_.insert(col_name);
+            } else if (!sonata_file_.has_dataset(col_name)) {
+                sonata_file_.create_dataset(col_name, ENUMERATION_H5_TYPE, 0, 1, nullable);
+            }
+        } else {
+            const auto idx = schema->ColumnIndex(col_name);
+            if (idx < 0) {
+                throw std::runtime_error("column " + col_name + " has an unsupported nesting");
+            }
+            const auto col = schema->Column(idx);
+            const auto col_type = parquet_types_to_h5(col->physical_type(), col->converted_type());
+            if (col_type < 0) {
+                throw std::runtime_error("column " + col_name + " cannot be converted");
+            }
+            if (sonata_file_.stored_dataset(col_name)) {
+                kept_.insert(col_name);
+            } else if (!sonata_file_.has_dataset(col_name)) {
+                sonata_file_.create_dataset(col_name, col_type, 0, 1, nullable);
+            }
         }
     }
 
@@ -99,24 +307,20 @@ void SonataWriter::setup(const CircuitData::Schema* schema, std::shared_ptr<cons
             source_size_ = std::stoul(p.second);
         } else if (p.first == "target_population_size") {
             target_size_ = std::stoul(p.second);
-        } else if (p.first == "org.apache.spark.sql.parquet.row.metadata") {
-            auto j = nlohmann::json::parse(p.second);
-            for (const auto& field: j["fields"]) {
-                const auto metadata = field["metadata"];
-                const auto name = field["name"];
-                if (metadata.contains("enumeration_values")) {
-                    std::vector<std::string> enum_values = metadata["enumeration_values"];
-                    sonata_file_.create_library(name, enum_values);
-                }
-            }
         } else if (p.first.rfind("org.apache", 0) != std::string::npos) {
-            // rfind is poor man's `starts_with`
+            // rfind is poor man's `starts_with`; Spark enumerations are handled above
         } else if (p.first == "parquet2hdf5_version") {
             // we set this below; ideally we would keep this, too, under a different name
         } else {
             sonata_file_.create_attribute(p.first, p.second);
         }
     }
+    for (const auto& [name, values]: enumerations_) {
+        // The library of a kept dataset is kept, too
+        if (kept_.count(name) == 0) {
+            sonata_file_.create_library(name, values);
+        }
+    }
     sonata_file_.create_attribute("parquet2hdf5_version", neuron_parquet::VERSION);
 }
 
@@ -140,11 +344,48 @@ void SonataWriter::write(const CircuitData * data, uint length) {
         if (COLUMNS_TO_SKIP.count(names[i]) > 0) {
             continue;
         }
-        write_data(sonata_file_[names[i]], output_file_offset_, col);
+        if (col->type()->id() == Type::STRUCT) {
+            // Write each field as a separate dataset, see setup()
+            const auto& fields = col->type()->fields();
+            for (size_t j = 0; j < fields.size(); ++j) {
+                const auto name = names[i] + "_" + fields[j]->name();
+                if (kept_.count(name) > 0) {
+                    continue;
+                }
+                ArrayVector children;
+                children.reserve(col->num_chunks());
+                for (const auto& chunk: col->chunks()) {
+                    // Flattening merges the validity of the struct into the field
+                    auto child = static_cast<const StructArray&>(*chunk).GetFlattenedField(static_cast<int>(j));
+                    if (!child.ok()) {
+                        throw std::runtime_error(child.status().ToString());
+                    }
+                    children.push_back(*child);
+                }
+                write_data(name,
+                           sonata_file_[name],
+                           output_file_offset_,
+                           std::make_shared<ChunkedArray>(children, fields[j]->type()));
+            }
+        } else if (kept_.count(names[i]) > 0) {
+            if (names[i] == "source_node_id" || names[i] == "target_node_id") {
+                check_node_ids(names[i], *col);
+            }
+            continue;
+        } else {
+            write_data(names[i], sonata_file_[names[i]], output_file_offset_, col);
+        }
+        if (collect_ranges_ && names[i] == "source_node_id") {
+            collect_ranges(source_ranges_, output_file_offset_, *col);
+        } else if (collect_ranges_ && names[i] == "target_node_id") {
+            collect_ranges(target_ranges_, output_file_offset_, *col);
+        }
     }
 
     output_file_offset_ += row_group->num_rows();
 
+    // Every dataset received the same rows, full rounds can be written
+    sonata_file_.write_rounds();
 }
 
 
@@ -170,6 +411,8 @@ inline hid_t parquet_types_to_h5(parquet::Type::type t, parquet::ConvertedType::
             break;
     }
     switch (t) {
+        case parquet::Type::BOOLEAN:
+            return H5T_STD_U8LE;
         case parquet::Type::INT32:
             return H5T_STD_I32LE;
         case parquet::Type::INT64:
@@ -186,9 +429,41 @@ inline hid_t parquet_types_to_h5(parquet::Type::type t, parquet::ConvertedType::
 }
 
 
+hid_t arrow_types_to_h5(const arrow::DataType& t) {
+    switch (t.id()) {
+        case Type::BOOL:
+        case Type::UINT8:
+            return H5T_STD_U8LE;
+        case Type::UINT16:
+            return H5T_STD_U16LE;
+        case Type::UINT32:
+            return H5T_STD_U32LE;
+        case Type::UINT64:
+            return H5T_STD_U64LE;
+        case Type::INT8:
+            return H5T_STD_I8LE;
+        case Type::INT16:
+            return H5T_STD_I16LE;
+        case Type::INT32:
+            return H5T_STD_I32LE;
+        case Type::INT64:
+            return H5T_STD_I64LE;
+        case Type::FLOAT:
+            return H5T_IEEE_F32LE;
+        case Type::DOUBLE:
+            return H5T_IEEE_F64LE;
+        default:
+            break;
+    }
+    std::cerr << "attempt to convert an unknown datatype " << t.ToString() << "!" << std::endl;
+    return -1;
+}
+
+
 // ================================================================================================
 
-void SonataWriter::write_data(SonataFile::Dataset& dataset,
+void SonataWriter::write_data(const std::string& name,
+                              SonataFile::Dataset& dataset,
                               uint64_t offset,
                               const shared_ptr<const ChunkedArray>& col_data) {
 
@@ -196,17 +471,228 @@ void SonataWriter::write_data(SonataFile::Dataset& dataset,
     cerr << "Writing data... " <<  col_data->length() << " records." << endl;
     #endif
 
-    if (col_data->type()->id() != Type::STRUCT) {
-        // get chunks and retrieve the raw data from the buffer
-        for (const shared_ptr<Array> & chunk : col_data->chunks()) {
-            auto buffer = static_cast<PrimitiveArray*>(chunk.get())->values();
-            dataset.write(buffer->data(), chunk->length(), offset);
-            offset += chunk->length();
+    for (const shared_ptr<Array> & chunk : col_data->chunks()) {
+        switch (chunk->type_id()) {
+            case Type::STRUCT:
+                std::cerr << "ERROR: unsupported column type" << std::endl;
+                throw std::runtime_error("Unsupported dataset");
+            case Type::FIXED_SIZE_LIST: {
+                if (chunk->null_count() > 0) {
+                    throw std::runtime_error("column " + name + " contains null lists");
+                }
+                // lists are stored contiguously, write them as full rows;
+                // values() ignores the offset of the list array itself
+                const auto& list = static_cast<const FixedSizeListArray&>(*chunk);
+                const auto values = list.values()->Slice(list.value_offset(0),
+                                                          list.length() * list.value_length());
+                if (values->type_id() == Type::BOOL) {
+                    write_boolean(dataset, offset, *values, chunk->length());
+                } else {
+                    write_primitive(dataset, offset, *values, chunk->length());
+                }
+                break;
+            }
+            case Type::BOOL:
+                write_boolean(dataset, offset, *chunk, chunk->length());
+                break;
+            case Type::STRING:
+            case Type::LARGE_STRING:
+            case Type::BINARY:
+            case Type::LARGE_BINARY:
+                write_enumeration(dataset, offset, *chunk, enumeration_lookup_.at(name));
+                break;
+            case Type::DICTIONARY:
+                if (is_string_like(*chunk->type())) {
+                    write_enumeration(dataset, offset, *chunk, enumeration_lookup_.at(name));
+                } else {
+                    write_dictionary(dataset, offset, static_cast<const DictionaryArray&>(*chunk));
+                }
+                break;
+            default:
+                write_primitive(dataset, offset, *chunk, chunk->length());
+                break;
+        }
+        offset += chunk->length();
+    }
+}
+
+
+void SonataWriter::check_node_ids(const std::string& name, const ChunkedArray& node_ids) const {
+    // Kept node IDs are not written, the input has to have the same edges
+    const auto stored = sonata_file_.read_node_ids(name, output_file_offset_, node_ids.length());
+    uint64_t row = 0;
+    for (const auto& chunk: node_ids.chunks()) {
+        visit_node_ids(*chunk, [&](const auto* values, int64_t length) {
+            for (int64_t i = 0; i < length; ++i, ++row) {
+                if (static_cast<uint64_t>(values[i]) != stored[row]) {
+                    throw std::runtime_error("population " + population_name_ + " has " + name + " " +
+                                             std::to_string(stored[row]) + " in row " +
+                                             std::to_string(output_file_offset_ + row) +
+                                             ", but the input has " + std::to_string(values[i]));
+                }
+            }
+        });
+    }
+}
+
+
+void SonataWriter::collect_ranges(indexing::FlatRawIndex& ranges,
+                                  uint64_t offset,
+                                  const ChunkedArray& node_ids) {
+    for (const auto& chunk: node_ids.chunks()) {
+        visit_node_ids(*chunk, [&](const auto* values, int64_t length) {
+            indexing::appendNodeRanges(ranges, values, length, offset);
+        });
+        offset += chunk->length();
+    }
+}
+
+
+/// Returns the start of the values of a primitive array
+///
+/// Arrays may be slices of larger ones, so the values are located at the
+/// array offset of the underlying buffer.  The element width has to match
+/// the \a dataset, to not write garbage when Arrow and HDF5 types disagree.
+static const uint8_t* raw_values(const SonataFile::Dataset& dataset, const Array& values) {
+    const auto* type = dynamic_cast<const FixedWidthType*>(values.type().get());
+    if (type == nullptr || type->bit_width() % 8 != 0) {
+        throw std::runtime_error("cannot write values of type " + values.type()->ToString());
+    }
+    const size_t byte_width = type->bit_width() / 8;
+    if (byte_width != dataset.element_size()) {
+        throw std::runtime_error("values of type " + values.type()->ToString() +
+                                 " do not match the dataset element size");
+    }
+    return values.data()->GetValues<uint8_t>(1, values.offset() * byte_width);
+}
+
+
+/// Copies \a values into \a buffer, replacing nulls with the dataset's fill value
+template <typename T>
+static void fill_nulls(const SonataFile::Dataset& dataset, const Array& values, T* buffer) {
+    const auto& fill = dataset.fill_value();
+    if (fill.size() != sizeof(T)) {
+        throw std::runtime_error("cannot write nulls to a non-nullable dataset");
+    }
+    T fill_value;
+    std::memcpy(&fill_value, fill.data(), sizeof(T));
+    for (int64_t i = 0; i < values.length(); ++i) {
+        if (values.IsNull(i)) {
+            buffer[i] = fill_value;
+        }
+    }
+}
+
+
+/// Replaces nulls in \a buffer, holding one dataset element per value, with the fill value
+static void fill_null_elements(const SonataFile::Dataset& dataset, const Array& values, uint8_t* buffer) {
+    switch (dataset.element_size()) {
+        case 1:
+            fill_nulls(dataset, values, buffer);
+            break;
+        case 2:
+            fill_nulls(dataset, values, reinterpret_cast<uint16_t*>(buffer));
+            break;
+        case 4:
+            fill_nulls(dataset, values, reinterpret_cast<uint32_t*>(buffer));
+            break;
+        case 8:
+            fill_nulls(dataset, values, reinterpret_cast<uint64_t*>(buffer));
+            break;
+        default:
+            throw std::runtime_error("cannot write nulls to a non-nullable dataset");
+    }
+}
+
+
+void SonataWriter::write_primitive(SonataFile::Dataset& dataset,
+                                   uint64_t offset,
+                                   const Array& values,
+                                   int64_t rows) {
+    if (values.null_count() == 0) {
+        dataset.write(raw_values(dataset, values), rows, offset);
+        return;
+    }
+
+    // Only copy data that needs to have nulls replaced
+    const auto* data = raw_values(dataset, values);
+    std::vector<uint8_t> buffer(data, data + values.length() * dataset.element_size());
+    fill_null_elements(dataset, values, buffer.data());
+    dataset.write(buffer.data(), rows, offset);
+}
+
+
+void SonataWriter::write_dictionary(SonataFile::Dataset& dataset,
+                                    uint64_t offset,
+                                    const DictionaryArray& values) {
+    // Dictionaries of numbers are stored with their values looked up
+    const auto width = dataset.element_size();
+    const auto* dict_values = raw_values(dataset, *values.dictionary());
+    std::vector<uint8_t> buffer(values.length() * width);
+    for (int64_t i = 0; i < values.length(); ++i) {
+        if (values.IsValid(i)) {
+            std::memcpy(buffer.data() + i * width, dict_values + values.GetValueIndex(i) * width, width);
+        }
+    }
+    if (values.null_count() > 0) {
+        fill_null_elements(dataset, values, buffer.data());
+    }
+    dataset.write(buffer.data(), values.length(), offset);
+}
+
+
+void SonataWriter::write_boolean(SonataFile::Dataset& dataset,
+                                 uint64_t offset,
+                                 const Array& values,
+                                 int64_t rows) {
+    std::vector<uint8_t> buffer(values.length());
+    unpack_bits(values.data()->buffers[1]->data(), values.offset(), values.length(), buffer.data());
+    if (values.null_count() > 0) {
+        fill_nulls(dataset, values, buffer.data());
+    }
+    dataset.write(buffer.data(), rows, offset);
+}
+
+
+void SonataWriter::write_enumeration(SonataFile::Dataset& dataset,
+                                     uint64_t offset,
+                                     const Array& values,
+                                     const std::unordered_map<std::string_view, uint32_t>& lookup) {
+    auto index_of = [&lookup](std::string_view value) {
+        const auto it = lookup.find(value);
+        if (it == lookup.end()) {
+            throw std::runtime_error("value '" + std::string(value) + "' missing from enumeration");
+        }
+        return it->second;
+    };
+
+    std::vector<uint32_t> buffer(values.length());
+    if (values.type_id() == Type::DICTIONARY) {
+        // Only translate the dictionary, then map the indices
+        const auto& dict = static_cast<const DictionaryArray&>(values);
+        const auto& dict_values = *dict.dictionary();
+        std::vector<uint32_t> mapping(dict_values.length());
+        for (int64_t i = 0; i < dict_values.length(); ++i) {
+            if (dict_values.IsValid(i)) {
+                mapping[i] = index_of(string_at(dict_values, i));
+            }
+        }
+        for (int64_t i = 0; i < values.length(); ++i) {
+            if (values.IsValid(i)) {
+                buffer[i] = mapping[dict.GetValueIndex(i)];
+            }
         }
     } else {
-        std::cerr << "ERROR: unsupported column type" << std::endl;
-        throw std::runtime_error("Unsupported dataset");
+        for (int64_t i = 0; i < values.length(); ++i) {
+            if (values.IsValid(i)) {
+                buffer[i] = index_of(string_at(values, i));
+            }
+        }
+    }
+    if (values.null_count() > 0) {
+        fill_nulls(dataset, values, buffer.data());
     }
+    dataset.write(buffer.data(), values.length(), offset);
 }
 
 
@@ -7,9 +7,13 @@
  */
 #pragma once
 
+#include <map>
+#include <set>
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <memory>
+#include <vector>
 #include <mpi.h>
 #include <hdf5.h>
 
@@ -42,13 +46,29 @@ public:
 
     SonataWriter(const std::string& filepath,
                       uint64_t n_records,
-                      const std::string& population_name);
+                      const std::string& population_name,
+                      const DatasetLayout& layout = {});
 
     SonataWriter(const std::string& filepath,
                       uint64_t n_records,
                       const MPI_Params& mpi_params,
                       uint64_t output_offset,
-                      const std::string& population_name);
+                      const std::string& population_name,
+                      const DatasetLayout& layout = {});
+
+    /**
+     * \brief Writes the population \a population_name to a file opened for
+     * parallel writing by SonataFile::create
+     *
+     * Construction and setup() are collective on the communicator of the
+     * file, as are flush() and write_indices().  Only the ranks converting
+     * edges of the population need to call write().
+     */
+    SonataWriter(const HighFive::File& file,
+                      uint64_t n_records,
+                      uint64_t output_offset,
+                      const std::string& population_name,
+                      const DatasetLayout& layout = {});
 
     ~SonataWriter() = default;
 
@@ -56,23 +76,142 @@ public:
 
     virtual void write(const CircuitData* data, uint length) override;
 
+    /**
+     * \brief Sets the values of the enumeration for the string column \a name
+     *
+     * String and dictionary columns are stored as indices into an \c @library
+     * enumeration.  Columns without \c enumeration_values in their Spark
+     * metadata need to have them set here, on all ranks identically, before
+     * calling setup().
+     */
+    void set_enumeration(const std::string& name, const std::vector<std::string>& values) {
+        enumerations_[name] = values;
+    }
+
+    /**
+     * \brief Sets the columns that may contain nulls
+     *
+     * Only the datasets of these columns get a fill value, which is written
+     * for nulls, as the Parquet fields of most writers are nullable even
+     * without any nulls.  Has to be called on all ranks identically before
+     * calling setup(), writing nulls to other columns fails.
+     */
+    void set_nullable_columns(const std::vector<std::string>& names) {
+        nullable_.insert(names.begin(), names.end());
+    }
+
+    /**
+     * \brief Returns the string or dictionary columns of \a schema that have
+     * no enumeration values in the \a metadata
+     */
+    static std::vector<std::string> unenumerated_columns(const CircuitData::Schema* schema,
+                                                         std::shared_ptr<const CircuitData::Metadata> metadata);
+
+    /**
+     * \brief Sets the number of records written by this rank
+     *
+     * Collective, allows collective datasets to be written in rounds while
+     * converting instead of staging all records, see SonataFile::set_local_records.
+     */
+    void set_local_records(uint64_t n_records) {
+        sonata_file_.set_local_records(n_records);
+    }
+
+    /// Collectively writes any data still staged, see SonataFile::flush
+    void flush() {
+        sonata_file_.flush();
+    }
+
+    WriteCounters write_counters() const {
+        return sonata_file_.write_counters();
+    }
+
+    /**
+     * \brief Collect the node ranges of the source and target node IDs in write()
+     *
+     * Allows write_indices() to skip reading the node IDs back from the file,
+     * at the cost of keeping the ranges in memory during the conversion.
+     */
+    void collect_index_ranges(bool collect = true) {
+        collect_ranges_ = collect;
+    }
+
+    /**
+     * \brief Datasets of an existing population that are also columns of the input
+     *
+     * These are not written, see SonataFile::stored_dataset.
+     */
+    const std::set<std::string>& kept_datasets() const {
+        return kept_;
+    }
+
+    /**
+     * \brief Whether the population lacks indices
+     *
+     * The node IDs of an existing population are kept, its indices only need
+     * to be written if there are none yet.
+     */
+    bool needs_indices() const {
+        return !sonata_file_.has_indices();
+    }
+
     void write_indices(bool parallel = false) {
-        sonata_file_.write_indices(source_size_, target_size_, parallel);
+        // Kept node IDs are read back, the input is not necessarily identical
+        if (collect_ranges_ && kept_.count("source_node_id") == 0 &&
+            kept_.count("target_node_id") == 0) {
+            sonata_file_.write_indices(source_size_, target_size_,
+                                       std::move(source_ranges_), std::move(target_ranges_));
+        } else {
+            sonata_file_.write_indices(source_size_, target_size_, parallel);
+        }
     }
 
 private:
-    static void write_data(SonataFile::Dataset& ds,
-                           uint64_t r_offset,
-                           const std::shared_ptr<const arrow::ChunkedArray>& r_col_data);
+    void write_data(const std::string& name,
+                    SonataFile::Dataset& ds,
+                    uint64_t r_offset,
+                    const std::shared_ptr<const arrow::ChunkedArray>& r_col_data);
+
+    void check_node_ids(const std::string& name, const arrow::ChunkedArray& node_ids) const;
+
+    static void collect_ranges(indexing::FlatRawIndex& ranges,
+                               uint64_t offset,
+                               const arrow::ChunkedArray& node_ids);
+
+    static void write_primitive(SonataFile::Dataset& ds,
+                                uint64_t offset,
+                                const arrow::Array& values,
+                                int64_t rows);
+    static void write_boolean(SonataFile::Dataset& ds,
+                              uint64_t offset,
+                              const arrow::Array& values,
+                              int64_t rows);
+    static void write_dictionary(SonataFile::Dataset& ds,
+                                 uint64_t offset,
+                                 const arrow::DictionaryArray& values);
+    static void write_enumeration(SonataFile::Dataset& ds,
+                                  uint64_t offset,
+                                  const arrow::Array& values,
+                                  const std::unordered_map<std::string_view, uint32_t>& lookup);
 
     SonataFile sonata_file_;
 
+    std::map<std::string, std::vector<std::string>> enumerations_;
+    std::set<std::string> kept_;
+    std::set<std::string> nullable_;
+    // keys point into the values of enumerations_
+    std::unordered_map<std::string, std::unordered_map<std::string_view, uint32_t>> enumeration_lookup_;
+
     const uint64_t total_records_;
     const std::string population_name_;
     uint64_t output_file_offset_;
 
     size_t source_size_ = 0;
     size_t target_size_ = 0;
+
+    bool collect_ranges_ = false;
+    indexing::FlatRawIndex source_ranges_;
+    indexing::FlatRawIndex target_ranges_;
 };
 
 
@@ -83,5 +222,11 @@ private:
 /// plain `Type` for generic integer and floating point numbers.
 inline hid_t parquet_types_to_h5(parquet::Type::type, parquet::ConvertedType::type);
 
+/// \brief Map from Arrow datatypes to HDF5 ones
+///
+/// Used for the primitive children of nested columns, where the Parquet
+/// types do not necessarily determine the in-memory layout.
+hid_t arrow_types_to_h5(const arrow::DataType&);
+
 
 }}  // namespace neuron_parquet::circuit EOF
@@ -11,12 +11,15 @@
 #include <functional>
 
 #include "progress.hpp"
+#include "stats.hpp"
 #include "generic_reader.h"
 #include "generic_writer.h"
 
 namespace neuron_parquet {
 
 using ::utils::ProgressMonitor;
+using ::utils::stats::ScopedTimer;
+using ::utils::stats::Stage;
 
 
 /**
@@ -42,7 +45,7 @@ class Converter {
         , reader_(reader)
         , writer_(writer)
         , n_records_(reader_.record_count())
-        , progress_handler_([](){})
+        , progress_handler_([](uint32_t){})
     {
         if (reader_.is_chunked()) {
             // Buffer is a single chunk
@@ -82,14 +85,14 @@ class Converter {
         int remaining = n % BUFFER_LEN;
 
         for (int i = 0; i < n_buffers; i++) {
-            reader_.fillBuffer(buffer_, BUFFER_LEN);
-            writer_.write(buffer_, BUFFER_LEN);
-            progress_handler_();
+            read(BUFFER_LEN);
+            write(BUFFER_LEN);
+            progress_handler_(BUFFER_LEN);
         }
         if (remaining > 0) {
-            reader_.fillBuffer(buffer_, remaining);
-            writer_.write(buffer_, remaining);
-            progress_handler_();
+            read(remaining);
+            write(remaining);
+            progress_handler_(remaining);
         }
         return n;
     }
@@ -104,9 +107,9 @@ class Converter {
         reader_.seek(0);
         uint32_t n;
 
-        while ((n = reader_.fillBuffer(buffer_, BUFFER_LEN)) > 0) {
-            writer_.write(buffer_, n);
-            progress_handler_();
+        while ((n = read(BUFFER_LEN)) > 0) {
+            write(n);
+            progress_handler_(n);
         }
         return size;
     }
@@ -115,11 +118,16 @@ class Converter {
     // T shall have += operator overloaded
     template<class P>
     void setProgressHandler(P& progress, int factor = 1) {
-        progress_handler_ = [&progress, factor]() {
+        progress_handler_ = [&progress, factor](uint32_t) {
             progress += factor;
         };
     }
 
+    /// Calls \a handler with the number of records after every buffer written
+    void setRecordHandler(std::function<void(uint32_t)> handler) {
+        progress_handler_ = std::move(handler);
+    }
+
     /**
      *  \brief number_of_buffers Calculates the number of record buffers from the filesize, buffer len and record type
      *         NOTE: This function only makes sense for record buffers, not data chunks
@@ -133,13 +141,26 @@ class Converter {
     const uint32_t BUFFER_LEN;
 
  private:
+    /// Fills the buffer, timed. Chunked readers count their own bytes
+    inline uint32_t read(uint32_t length) {
+        ScopedTimer timer(Stage::Read);
+        const uint32_t n = reader_.fillBuffer(buffer_, length);
+        timer.add(reader_.is_chunked() ? 0 : n * sizeof(T), n);
+        return n;
+    }
+
+    inline void write(uint32_t length) {
+        ScopedTimer timer(Stage::Write, reader_.is_chunked() ? 0 : length * sizeof(T));
+        writer_.write(buffer_, length);
+    }
+
     ConverterFormat mode_;
     Reader<T>& reader_;
     Writer<T>& writer_;
     T* buffer_;
 
     const uint64_t n_records_;
-    std::function<void()> progress_handler_;
+    std::function<void(uint32_t)> progress_handler_;
 };
 
 
@@ -0,0 +1,147 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <mpi.h>
+
+#include "CLI/CLI.hpp"
+
+#include "circuit.h"
+#include "mpi_progress.hpp"
+#include "stats.hpp"
+#include "version.h"
+
+using namespace neuron_parquet::circuit;
+
+using neuron_parquet::Converter;
+using utils::MPIProgress;
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
+
+namespace fs = std::filesystem;
+
+
+int mpi_size, mpi_rank;
+MPI_Comm comm = MPI_COMM_WORLD;
+MPI_Info info = MPI_INFO_NULL;
+
+
+///
+/// \brief convert: Writes the share of the population read by this rank into one Parquet file
+///
+void convert(const std::string& input,
+             const std::string& population,
+             const fs::path& output_directory,
+             const CircuitWriterParquet::Options& options) {
+    SonataReader reader(input, population, comm, info, options.row_group_size);
+    if (mpi_rank == 0) {
+        std::cout << "Converting " << reader.population_size() << " edges of population "
+                  << population << " into " << mpi_size << " file(s)" << std::endl;
+    }
+
+    uint64_t record_size = 0;
+    for (const auto& field: reader.arrow_schema()->fields()) {
+        const auto& type = *field->type();
+        if (type.id() == arrow::Type::DICTIONARY) {
+            record_size += sizeof(uint32_t);
+        } else if (type.id() == arrow::Type::FIXED_SIZE_LIST) {
+            const auto& list = static_cast<const arrow::FixedSizeListType&>(type);
+            record_size += list.list_size() * list.value_type()->byte_width();
+        } else {
+            record_size += type.byte_width();
+        }
+    }
+
+    char name[32];
+    snprintf(name, sizeof(name), "part-%05d.parquet", mpi_rank);
+    CircuitWriterParquet writer(output_directory / name, options);
+
+    MPIProgress progress(comm, reader.population_size());
+    {
+        Converter<CircuitData> converter(reader, writer);
+        converter.setRecordHandler([&progress, record_size](uint32_t n) {
+            progress.add(n, n * record_size);
+        });
+        converter.exportAll();
+    }
+    writer.close();
+    progress.finish();
+}
+
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(comm, &mpi_size);
+    MPI_Comm_rank(comm, &mpi_rank);
+
+    std::string input;
+    std::string population;
+    std::string output_directory;
+    std::string stats_json;
+    std::string trace_json;
+    CircuitWriterParquet::Options options;
+
+    CLI::App app{"Convert an edge population of a SONATA file back to Parquet"};
+    app.set_version_flag("-v,--version", neuron_parquet::VERSION);
+    options.add_options(app, "Rows per row group, also the rows read at once");
+    app.add_option("--stats-json", stats_json,
+                   "Time the conversion stages and write a summary over all ranks to this file");
+    app.add_option("--trace-json", trace_json,
+                   "Record a timeline of the conversion stages of all ranks to this Chrome trace file");
+    app.add_option("input", input, "SONATA file to read the edges from")
+        ->check(CLI::ExistingFile)
+        ->required();
+    app.add_option("population", population, "Name of the edge population to convert")
+        ->required();
+    app.add_option("output_directory", output_directory, "Directory to write the Parquet files to")
+        ->required();
+
+    try {
+        app.parse(argc, argv);
+    } catch(const CLI::ParseError& e) {
+        if (mpi_rank == 0) {
+            app.exit(e);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (mpi_rank == 0) {
+        fs::create_directories(output_directory);
+    }
+    MPI_Barrier(comm);
+
+    if (!stats_json.empty()) {
+        utils::stats::enable();
+    }
+    if (!trace_json.empty()) {
+        utils::trace::enable(comm);
+    }
+
+    const double start = MPI_Wtime();
+    try {
+        convert(input, population, output_directory, options);
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR on rank " << mpi_rank << ": " << e.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Barrier(comm);
+    }
+    if (mpi_rank == 0) {
+        std::cout << "Conversion complete in " << MPI_Wtime() - start << " seconds." << std::endl;
+    }
+
+    utils::stats::report(comm, stats_json, "hdf52parquet");
+    utils::trace::write(comm, trace_json);
+
+    MPI_Finalize();
+
+    return 0;
+}
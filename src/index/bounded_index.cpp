@@ -0,0 +1,413 @@
+#include "index.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <numeric>
+#include <queue>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#include <unistd.h>
+
+#include <mpi.h>
+
+#include <highfive/H5DataSet.hpp>
+#include <highfive/H5File.hpp>
+
+#include "exchange.h"
+#include "flat_index.h"
+#include "layout.h"
+#include "stats.hpp"
+
+namespace indexing {
+
+namespace {
+
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
+
+using Range = FlatRawIndex::value_type;
+
+const char* const SOURCE_NODE_ID_DSET = "source_node_id";
+const char* const TARGET_NODE_ID_DSET = "target_node_id";
+
+const char* const INDEX_GROUP = "indices";
+const char* const SOURCE_INDEX_GROUP = "indices/source_to_target";
+const char* const TARGET_INDEX_GROUP = "indices/target_to_source";
+const char* const NODE_ID_TO_RANGES_DSET = "node_id_to_ranges";
+const char* const RANGE_TO_EDGE_ID_DSET = "range_to_edge_id";
+
+/// Bytes of memory per range held by a rank: ranges to send, received
+/// ranges, merge buffers and the grouped output
+constexpr uint64_t BYTES_PER_RANGE = 128;
+
+/// Granularity of the histogram of ranges used to plan the passes
+constexpr uint64_t MAX_BUCKETS = 1 << 20;
+
+/// Rows per chunk of the extendable range_to_edge_id dataset
+constexpr hsize_t RANGE_CHUNK_ROWS = 1 << 16;
+
+
+/**
+ * \brief A temporary file holding sorted runs of ranges.
+ *
+ * The file is removed from the file system right away, and deleted once
+ * closed.
+ */
+class SpillFile {
+  public:
+    explicit SpillFile(const std::string& directory) {
+        std::string name = directory + "/sonata-index-XXXXXX";
+        fd_ = mkstemp(name.data());
+        if (fd_ < 0) {
+            throw std::system_error(errno, std::generic_category(), "cannot create a file in " + directory);
+        }
+        unlink(name.c_str());
+    }
+
+    ~SpillFile() {
+        close(fd_);
+    }
+
+    SpillFile(const SpillFile&) = delete;
+    SpillFile& operator=(const SpillFile&) = delete;
+
+    /// Appends a run of ranges, which have to be sorted
+    void append(const FlatRawIndex& run) {
+        if (run.empty()) {
+            return;
+        }
+        const auto* data = reinterpret_cast<const char*>(run.data());
+        size_t remaining = run.size() * sizeof(Range);
+        off_t position = size_ * sizeof(Range);
+        while (remaining > 0) {
+            const auto written = pwrite(fd_, data, remaining, position);
+            if (written < 0) {
+                throw std::system_error(errno, std::generic_category(), "cannot write spill file");
+            }
+            data += written;
+            position += written;
+            remaining -= written;
+        }
+        runs_.push_back({size_, run.size()});
+        size_ += run.size();
+    }
+
+    /// Reads \a count ranges starting at range \a position
+    void read(uint64_t position, Range* out, size_t count) const {
+        auto* data = reinterpret_cast<char*>(out);
+        size_t remaining = count * sizeof(Range);
+        off_t offset = position * sizeof(Range);
+        while (remaining > 0) {
+            const auto read = pread(fd_, data, remaining, offset);
+            if (read <= 0) {
+                throw std::system_error(errno, std::generic_category(), "cannot read spill file");
+            }
+            data += read;
+            offset += read;
+            remaining -= read;
+        }
+    }
+
+    /// The start and length of every run
+    const std::vector<std::pair<uint64_t, uint64_t>>& runs() const {
+        return runs_;
+    }
+
+    uint64_t size() const {
+        return size_;
+    }
+
+  private:
+    int fd_;
+    uint64_t size_ = 0;
+    std::vector<std::pair<uint64_t, uint64_t>> runs_;
+};
+
+
+/**
+ * \brief Reads a single run of a spill file through a small buffer.
+ */
+class RunReader {
+  public:
+    RunReader(const SpillFile& file, uint64_t start, uint64_t count, size_t bufferSize)
+        : file_(&file)
+        , next_(start)
+        , end_(start + count)
+        , bufferSize_(bufferSize) {
+        fill();
+    }
+
+    bool empty() const {
+        return position_ == buffer_.size();
+    }
+
+    const Range& front() const {
+        return buffer_[position_];
+    }
+
+    void pop() {
+        if (++position_ == buffer_.size()) {
+            fill();
+        }
+    }
+
+  private:
+    void fill() {
+        buffer_.resize(std::min<uint64_t>(bufferSize_, end_ - next_));
+        file_->read(next_, buffer_.data(), buffer_.size());
+        next_ += buffer_.size();
+        position_ = 0;
+    }
+
+    const SpillFile* file_;
+    uint64_t next_;
+    uint64_t end_;
+    size_t bufferSize_;
+    size_t position_ = 0;
+    FlatRawIndex buffer_;
+};
+
+
+/**
+ * \brief Merges all runs of a spill file in order.
+ *
+ * As the runs are sorted by node ID, ranges can be taken for increasing
+ * blocks of node IDs, reading every run only once.
+ */
+class RunMerger {
+  public:
+    RunMerger(const SpillFile& file, size_t bufferRanges) {
+        const auto& runs = file.runs();
+        const size_t perRun = std::max<size_t>(16, bufferRanges / std::max<size_t>(1, runs.size()));
+        readers_.reserve(runs.size());
+        for (const auto& [start, count]: runs) {
+            readers_.emplace_back(file, start, count, perRun);
+            heap_.push({readers_.back().front(), readers_.size() - 1});
+        }
+    }
+
+    /**
+     * \brief Appends up to \a limit ranges of nodes before \a end to \a out.
+     *
+     * Returns true if ranges of nodes before \a end remain.
+     */
+    bool take(NodeID end, size_t limit, FlatRawIndex& out) {
+        while (!heap_.empty() && heap_.top().first[0] < end && out.size() < limit) {
+            const auto [range, idx] = heap_.top();
+            heap_.pop();
+            out.push_back(range);
+            auto& reader = readers_[idx];
+            reader.pop();
+            if (!reader.empty()) {
+                heap_.push({reader.front(), idx});
+            }
+        }
+        return !heap_.empty() && heap_.top().first[0] < end;
+    }
+
+  private:
+    using Entry = std::pair<Range, size_t>;
+
+    std::vector<RunReader> readers_;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap_;
+};
+
+
+/**
+ * \brief Reads the node IDs of the local partition of edges in windows, and
+ * spills them as sorted runs of ranges.
+ *
+ * Returns the largest node ID encountered.
+ */
+NodeID _spillNodeRanges(const HighFive::Group& h5Root,
+                        const std::string& name,
+                        uint64_t window,
+                        SpillFile& spill) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    auto dataset = h5Root.getDataSet(name);
+    const auto [offset, count] = partitionCount(dataset.getElementCount(), rank, size);
+
+    NodeID maxID = 0;
+    std::vector<NodeID> nodeIDs;
+    FlatRawIndex run;
+    for (uint64_t start = offset; start < offset + count; start += window) {
+        const auto n = std::min(window, offset + count - start);
+        {
+            ScopedTimer timer(Stage::IndexRead, n * sizeof(NodeID), n);
+            dataset.select({start}, {n}).read(nodeIDs);
+        }
+        run.clear();
+        appendNodeRanges(run, nodeIDs.data(), nodeIDs.size(), start);
+        {
+            ScopedTimer timer(Stage::IndexSort, run.size() * sizeof(Range), run.size());
+            std::sort(run.begin(), run.end());
+        }
+        maxID = std::max(maxID, run.back()[0]);
+        spill.append(run);
+    }
+    return maxID;
+}
+
+
+/**
+ * \brief Counts the spilled ranges per bucket of \a bucketWidth nodes, over all ranks.
+ */
+std::vector<uint64_t> _countRanges(const SpillFile& spill, uint64_t bucketWidth, uint64_t nodeCount, size_t bufferRanges) {
+    std::vector<uint64_t> counts((nodeCount + bucketWidth - 1) / bucketWidth, 0);
+    FlatRawIndex buffer(std::min<uint64_t>(bufferRanges, spill.size()));
+    for (uint64_t start = 0; start < spill.size(); start += buffer.size()) {
+        const auto n = std::min<uint64_t>(buffer.size(), spill.size() - start);
+        spill.read(start, buffer.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            if (buffer[i][0] >= nodeCount) {
+                throw std::runtime_error("node ID exceeds the node count");
+            }
+            counts[buffer[i][0] / bucketWidth]++;
+        }
+    }
+    MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    return counts;
+}
+
+
+/**
+ * \brief Writes the index of \a source in passes over blocks of nodes.
+ *
+ * In every pass, each rank is responsible for one block of nodes, and receives
+ * the ranges of these from all other ranks in rounds of bounded size.
+ */
+void _writeBoundedIndexGroup(const std::string& source,
+                             uint64_t nodeCount,
+                             HighFive::Group& h5Root,
+                             const std::string& name,
+                             uint64_t capacity,
+                             const std::string& spillDirectory,
+                             const IndexLayout& layout) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    SpillFile spill(spillDirectory);
+    NodeID maxID = _spillNodeRanges(h5Root, source, capacity, spill);
+    MPI_Allreduce(MPI_IN_PLACE, &maxID, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+    if (nodeCount == 0) {
+        nodeCount = maxID + 1;
+    }
+
+    const uint64_t bucketWidth = std::max<uint64_t>(1, (nodeCount + MAX_BUCKETS - 1) / MAX_BUCKETS);
+    const auto slots = planNodeSlots(_countRanges(spill, bucketWidth, nodeCount, capacity),
+                                     bucketWidth, nodeCount, capacity);
+    const uint64_t passes = (slots.size() + size - 1) / size;
+    if (rank == 0) {
+        std::cout << "Indexing " << source << " in " << passes << " pass(es) over "
+                  << slots.size() << " block(s) of nodes" << std::endl;
+    }
+
+    auto indexGroup = h5Root.createGroup(name);
+    auto primary = createIndexDataset(indexGroup, NODE_ID_TO_RANGES_DSET, layout, nodeCount);
+    auto secondary = createIndexDataset(indexGroup, RANGE_TO_EDGE_ID_DSET, layout, 0, RANGE_CHUNK_ROWS);
+
+    RunMerger merger(spill, capacity / 4);
+    uint64_t writtenRanges = 0;
+    for (uint64_t pass = 0; pass < passes; ++pass) {
+        // Blocks are consecutive, pad the last pass with empty ones
+        std::vector<NodeID> boundaries(size + 1, nodeCount);
+        for (int i = 0; i <= size && pass * size + i < slots.size(); ++i) {
+            boundaries[i] = slots[pass * size + i].begin;
+        }
+        const NodeSlot slot{boundaries[rank], boundaries[rank + 1]};
+
+        // Exchange in rounds until all ranks sent the ranges of this pass
+        FlatRawIndex received;
+        std::vector<uint64_t> runOffsets{0};
+        int remaining = 1;
+        while (remaining) {
+            FlatRawIndex toSend;
+            int more = merger.take(boundaries[size], capacity, toSend);
+            const auto sendCounts = countPerPartition(toSend, boundaries);
+
+            FlatRawIndex round;
+            std::vector<uint64_t> recvCounts;
+            ScopedTimer timer(Stage::IndexExchange, toSend.size() * sizeof(Range), toSend.size());
+            mpi::alltoallv(toSend, sendCounts, round, recvCounts, MPI_COMM_WORLD);
+            for (const auto count: recvCounts) {
+                runOffsets.push_back(runOffsets.back() + count);
+            }
+            received.insert(received.end(), round.begin(), round.end());
+
+            MPI_Allreduce(&more, &remaining, 1, MPI_INT, MPI_LOR, MPI_COMM_WORLD);
+        }
+
+        ScopedTimer timer(Stage::IndexWrite, received.size() * sizeof(Range), received.size());
+        mergeSortedRuns(received, std::move(runOffsets));
+        const auto grouped = groupSortedRanges(received, slot.begin, slot.end - slot.begin);
+        received = FlatRawIndex();
+
+        const uint64_t rangeCount = grouped.ranges.size();
+        std::vector<uint64_t> allRangeCounts(size);
+        MPI_Allgather(&rangeCount, 1, MPI_UINT64_T,
+                      allRangeCounts.data(), 1, MPI_UINT64_T,
+                      MPI_COMM_WORLD);
+        const uint64_t rangeOffset = std::accumulate(allRangeCounts.begin(), allRangeCounts.begin() + rank, writtenRanges);
+        const uint64_t passRanges = std::accumulate(allRangeCounts.begin(), allRangeCounts.end(), uint64_t{0});
+
+        RawIndex primaryIndex;
+        primaryIndex.reserve(grouped.nodeCount());
+        for (uint64_t i = 0; i < grouped.nodeCount(); ++i) {
+            const auto start = grouped.offsets[i];
+            const auto end = grouped.offsets[i + 1];
+            if (start == end) {
+                primaryIndex.push_back({0, 0});
+            } else {
+                primaryIndex.push_back({rangeOffset + start, rangeOffset + end});
+            }
+        }
+
+        secondary.resize({writtenRanges + passRanges, 2});
+        writeIndexRows(secondary, grouped.ranges, rangeOffset, layout);
+        writeIndexRows(primary, primaryIndex, slot.begin, layout);
+        writtenRanges += passRanges;
+    }
+}
+
+}  // unnamed namespace
+
+
+void writeBounded(HighFive::Group& h5Root,
+                  uint64_t sourceNodeCount,
+                  uint64_t targetNodeCount,
+                  uint64_t memoryBudget,
+                  const std::string& spillDirectory,
+                  const IndexLayout& layout) {
+    if (h5Root.exist(INDEX_GROUP)) {
+        throw std::runtime_error("Index group already exists");
+    }
+    const uint64_t capacity = std::max<uint64_t>(1, memoryBudget / BYTES_PER_RANGE);
+    const auto resolved = resolveLayout(layout, h5Root.getDataSet(SOURCE_NODE_ID_DSET).getElementCount());
+
+    _writeBoundedIndexGroup(SOURCE_NODE_ID_DSET,
+                            sourceNodeCount,
+                            h5Root,
+                            SOURCE_INDEX_GROUP,
+                            capacity,
+                            spillDirectory,
+                            resolved);
+    _writeBoundedIndexGroup(TARGET_NODE_ID_DSET,
+                            targetNodeCount,
+                            h5Root,
+                            TARGET_INDEX_GROUP,
+                            capacity,
+                            spillDirectory,
+                            resolved);
+}
+
+}  // namespace indexing
@@ -0,0 +1,264 @@
+#include "check.h"
+
+#include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include <highfive/H5DataSet.hpp>
+#include <highfive/H5File.hpp>
+
+#include "exchange.h"
+#include "flat_index.h"
+
+namespace indexing {
+
+namespace {
+
+const char* const NODE_ID_TO_RANGES_DSET = "node_id_to_ranges";
+const char* const RANGE_TO_EDGE_ID_DSET = "range_to_edge_id";
+
+/// Errors reported in detail per rank
+constexpr size_t MAX_MESSAGES = 10;
+
+/**
+ * \brief Rows of a dataset to read, as sorted blocks.
+ */
+class RowBlocks {
+  public:
+    void add(uint64_t begin, uint64_t end) {
+        if (begin < end) {
+            blocks_.push_back({begin, end});
+        }
+    }
+
+    /// Sorts and merges the blocks, returns the number of rows
+    uint64_t merge() {
+        std::sort(blocks_.begin(), blocks_.end());
+        RawIndex merged;
+        for (const auto& block: blocks_) {
+            if (!merged.empty() && block[0] <= merged.back()[1]) {
+                merged.back()[1] = std::max(merged.back()[1], block[1]);
+            } else {
+                merged.push_back(block);
+            }
+        }
+        blocks_.swap(merged);
+        offsets_.assign(1, 0);
+        for (const auto& [begin, end]: blocks_) {
+            offsets_.push_back(offsets_.back() + end - begin);
+        }
+        return offsets_.back();
+    }
+
+    /// Reads the merged rows of a dataset with two columns
+    RawIndex read(const HighFive::DataSet& dataset) const {
+        RawIndex result;
+        if (blocks_.empty()) {
+            return result;
+        }
+        HighFive::HyperSlab slab;
+        for (const auto& [begin, end]: blocks_) {
+            slab |= HighFive::RegularHyperSlab({begin, 0}, {end - begin, 2});
+        }
+        std::vector<uint64_t> values;
+        dataset.select(slab).read(values);
+        result.resize(values.size() / 2);
+        for (size_t i = 0; i < result.size(); ++i) {
+            result[i] = {values[2 * i], values[2 * i + 1]};
+        }
+        return result;
+    }
+
+    /// Returns the position of \a row among the merged rows
+    uint64_t position(uint64_t row) const {
+        const auto it = std::upper_bound(blocks_.begin(), blocks_.end(), row,
+                                         [](uint64_t r, const auto& block) { return r < block[0]; });
+        const auto b = static_cast<size_t>(it - blocks_.begin()) - 1;
+        return offsets_[b] + row - blocks_[b][0];
+    }
+
+  private:
+    RawIndex blocks_;
+    std::vector<uint64_t> offsets_;
+};
+
+/**
+ * \brief Sorts edge ranges and merges adjacent ones.
+ */
+RawIndex _mergeEdgeRanges(RawIndex ranges) {
+    std::sort(ranges.begin(), ranges.end());
+    RawIndex result;
+    for (const auto& range: ranges) {
+        if (!result.empty() && range[0] <= result.back()[1]) {
+            result.back()[1] = std::max(result.back()[1], range[1]);
+        } else {
+            result.push_back(range);
+        }
+    }
+    return result;
+}
+
+/**
+ * \brief Returns the edge ranges of the given rows of node_id_to_ranges.
+ */
+RawIndex _lookupRows(const HighFive::Group& index, const RowBlocks& nodeRows) {
+    const auto nodeToRanges = nodeRows.read(index.getDataSet(NODE_ID_TO_RANGES_DSET));
+    RowBlocks rangeRows;
+    for (const auto& [begin, end]: nodeToRanges) {
+        rangeRows.add(begin, end);
+    }
+    rangeRows.merge();
+    return _mergeEdgeRanges(rangeRows.read(index.getDataSet(RANGE_TO_EDGE_ID_DSET)));
+}
+
+}  // unnamed namespace
+
+
+VerifyResult verify(const HighFive::Group& h5Root,
+                    const std::string& indexName,
+                    const std::string& nodeIDName) {
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    VerifyResult result;
+    auto report = [&result](const std::string& message) {
+        ++result.errors;
+        if (result.messages.size() < MAX_MESSAGES) {
+            result.messages.push_back(message);
+        }
+    };
+
+    const auto index = h5Root.getGroup(indexName);
+    const auto primary = index.getDataSet(NODE_ID_TO_RANGES_DSET);
+    const auto secondary = index.getDataSet(RANGE_TO_EDGE_ID_DSET);
+    const auto nodeIDs = h5Root.getDataSet(nodeIDName);
+    result.nodes = primary.getDimensions()[0];
+    result.ranges = secondary.getDimensions()[0];
+    result.edges = nodeIDs.getElementCount();
+
+    // Read the rows of the local nodes, and all ranges they refer to
+    const auto [nodeOffset, nodeCount] = partitionCount(result.nodes, rank, size);
+    RawIndex nodeToRanges;
+    primary.select({nodeOffset, 0}, {nodeCount, 2}).read(nodeToRanges);
+
+    RowBlocks rangeRows;
+    for (uint64_t i = 0; i < nodeCount; ++i) {
+        const auto [begin, end] = nodeToRanges[i];
+        if (begin > end || end > result.ranges) {
+            report("node " + std::to_string(nodeOffset + i) + " refers to invalid ranges [" +
+                   std::to_string(begin) + ", " + std::to_string(end) + ")");
+            nodeToRanges[i] = {0, 0};
+        }
+        rangeRows.add(nodeToRanges[i][0], nodeToRanges[i][1]);
+    }
+    rangeRows.merge();
+    const auto rangeToEdges = rangeRows.read(secondary);
+
+    // Every node needs sorted, disjoint ranges of edges.  Split them where
+    // the edges change ranks, to check them on the ranks holding the edges
+    std::vector<uint64_t> boundaries(size + 1, result.edges);
+    for (int r = 0; r < size; ++r) {
+        boundaries[r] = partitionCount(result.edges, r, size).first;
+    }
+
+    FlatRawIndex edgeRanges;
+    for (uint64_t i = 0; i < nodeCount; ++i) {
+        const NodeID node = nodeOffset + i;
+        uint64_t previousEnd = 0;
+        for (uint64_t row = nodeToRanges[i][0]; row < nodeToRanges[i][1]; ++row) {
+            auto [start, end] = rangeToEdges[rangeRows.position(row)];
+            if (start >= end || end > result.edges) {
+                report("node " + std::to_string(node) + " has invalid edge range [" +
+                       std::to_string(start) + ", " + std::to_string(end) + ")");
+                continue;
+            }
+            if (start < previousEnd) {
+                report("node " + std::to_string(node) + " has unsorted or overlapping edge ranges");
+            }
+            previousEnd = end;
+            while (start < end) {
+                const auto partition = std::upper_bound(boundaries.begin(), boundaries.end(), start) - 1;
+                const auto cut = std::min(end, *(partition + 1));
+                edgeRanges.push_back({start, cut, node});
+                start = cut;
+            }
+        }
+    }
+
+    std::sort(edgeRanges.begin(), edgeRanges.end());
+    const auto rangesToSend = countPerPartition(edgeRanges, boundaries);
+    FlatRawIndex received;
+    std::vector<uint64_t> rangesToReceive;
+    mpi::alltoallv(edgeRanges, rangesToSend, received, rangesToReceive, MPI_COMM_WORLD);
+    {
+        FlatRawIndex empty;
+        std::swap(edgeRanges, empty);
+    }
+    std::vector<uint64_t> offsetsToReceive(size + 1, 0);
+    std::partial_sum(rangesToReceive.begin(), rangesToReceive.end(), offsetsToReceive.begin() + 1);
+    mergeSortedRuns(received, std::move(offsetsToReceive));
+
+    // The ranges of the local edges have to cover them exactly once, with
+    // matching node IDs
+    const auto [edgeOffset, edgeCount] = partitionCount(result.edges, rank, size);
+    std::vector<NodeID> ids;
+    nodeIDs.select({edgeOffset}, {edgeCount}).read(ids);
+
+    uint64_t covered = edgeOffset;
+    for (const auto& [start, end, node]: received) {
+        if (start > covered) {
+            report("edges [" + std::to_string(covered) + ", " + std::to_string(start) + ") are not indexed");
+        } else if (start < covered) {
+            report("edges [" + std::to_string(start) + ", " + std::to_string(std::min(end, covered)) +
+                   ") are indexed more than once");
+        }
+        const auto mismatch = std::find_if(ids.begin() + (start - edgeOffset),
+                                           ids.begin() + (end - edgeOffset),
+                                           [node = node](NodeID id) { return id != node; });
+        if (mismatch != ids.begin() + (end - edgeOffset)) {
+            report("edge " + std::to_string(edgeOffset + (mismatch - ids.begin())) +
+                   " is indexed for node " + std::to_string(node) + " but belongs to node " +
+                   std::to_string(*mismatch));
+        }
+        covered = std::max(covered, end);
+    }
+    if (covered < edgeOffset + edgeCount) {
+        report("edges [" + std::to_string(covered) + ", " + std::to_string(edgeOffset + edgeCount) +
+               ") are not indexed");
+    }
+
+    uint64_t localErrors = result.errors;
+    MPI_Allreduce(&localErrors, &result.errors, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+
+    return result;
+}
+
+
+RawIndex lookup(const HighFive::Group& index, const std::vector<NodeID>& nodeIDs) {
+    RowBlocks nodeRows;
+    for (size_t i = 0; i < nodeIDs.size();) {
+        // Batch consecutive node IDs into one block
+        size_t j = i + 1;
+        while (j < nodeIDs.size() && nodeIDs[j] == nodeIDs[j - 1] + 1) {
+            ++j;
+        }
+        nodeRows.add(nodeIDs[i], nodeIDs[j - 1] + 1);
+        i = j;
+    }
+    nodeRows.merge();
+    return _lookupRows(index, nodeRows);
+}
+
+
+RawIndex lookupRange(const HighFive::Group& index, NodeID begin, NodeID end) {
+    RowBlocks nodeRows;
+    nodeRows.add(begin, end);
+    nodeRows.merge();
+    return _lookupRows(index, nodeRows);
+}
+
+} // namespace indexing
@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <highfive/H5Group.hpp>
+
+#include "flat_index.h"
+
+namespace indexing {
+
+/**
+ * \brief Outcome of verifying an index.
+ *
+ * The counts cover all ranks, while \c messages holds the first errors found
+ * by the local rank.
+ */
+struct VerifyResult {
+    uint64_t nodes = 0;
+    uint64_t ranges = 0;
+    uint64_t edges = 0;
+    uint64_t errors = 0;
+    std::vector<std::string> messages;
+};
+
+/**
+ * \brief Verifies an index of the edges in \a h5Root against their node IDs.
+ *
+ * \arg \c indexName The index group, e.g. "indices/source_to_target"
+ * \arg \c nodeIDName The node IDs indexed, e.g. "source_node_id"
+ *
+ * Checks that the ranges of every node are valid, sorted and do not overlap,
+ * and that every edge is covered by exactly one range of the node it belongs
+ * to.  The nodes and edges are split over all ranks, and the ranges
+ * exchanged to the ranks holding their edges.  Collective.
+ */
+VerifyResult verify(const HighFive::Group& h5Root,
+                    const std::string& indexName,
+                    const std::string& nodeIDName);
+
+/**
+ * \brief Returns the sorted and merged edge ranges of the sorted node IDs \a nodeIDs.
+ *
+ * Reads the rows of consecutive node IDs and ranges as one union of
+ * hyperslabs each, as a reader of the index would.
+ */
+RawIndex lookup(const HighFive::Group& index, const std::vector<NodeID>& nodeIDs);
+
+/**
+ * \brief Returns the sorted and merged edge ranges of the nodes from \a begin to before \a end.
+ */
+RawIndex lookupRange(const HighFive::Group& index, NodeID begin, NodeID end);
+
+} // namespace indexing
@@ -0,0 +1,308 @@
+#pragma once
+
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <mpi.h>
+
+namespace indexing {
+namespace mpi {
+
+/**
+ * \brief Helper class to get a RAII-style MPI type
+ */
+template <typename T>
+class DataType {
+  public:
+    DataType() {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "Only trivially copyable types are supported.");
+        MPI_Type_contiguous(sizeof(T), MPI_BYTE, &kind_);
+        MPI_Type_commit(&kind_);
+
+    }
+    ~DataType() {
+        MPI_Type_free(&kind_);
+    }
+
+    MPI_Datatype& type() {
+        return kind_;
+    }
+  private:
+    MPI_Datatype kind_;
+};
+
+namespace detail {
+
+/**
+ * \brief Offsets of the data to exchange, and whether they fit into an int on all ranks.
+ */
+struct ExchangeLayout {
+    std::vector<uint64_t> sendOffsets;
+    std::vector<uint64_t> recvOffsets;
+    bool fitsInt;
+};
+
+/**
+ * \brief Exchanges the counts of elements to send, and sizes \c recv accordingly.
+ *
+ * All ranks have to agree on the way to exchange data, hence whether int
+ * counts suffice is decided over all of them.
+ */
+template <typename T>
+ExchangeLayout exchangeCounts(const std::vector<uint64_t>& sendCounts,
+                              std::vector<T>& recv,
+                              std::vector<uint64_t>& recvCounts,
+                              MPI_Comm comm,
+                              uint64_t limit) {
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    recvCounts.assign(size, 0);
+    MPI_Alltoall(sendCounts.data(), 1, MPI_UINT64_T,
+                 recvCounts.data(), 1, MPI_UINT64_T,
+                 comm);
+
+    ExchangeLayout layout;
+    layout.sendOffsets.assign(size + 1, 0);
+    std::partial_sum(sendCounts.begin(), sendCounts.end(), layout.sendOffsets.begin() + 1);
+    layout.recvOffsets.assign(size + 1, 0);
+    std::partial_sum(recvCounts.begin(), recvCounts.end(), layout.recvOffsets.begin() + 1);
+
+    recv.resize(layout.recvOffsets.back());
+
+    uint64_t localMax = std::max(layout.sendOffsets.back(), layout.recvOffsets.back());
+    uint64_t globalMax;
+    MPI_Allreduce(&localMax, &globalMax, 1, MPI_UINT64_T, MPI_MAX, comm);
+    layout.fitsInt = globalMax <= limit;
+
+    return layout;
+}
+
+/**
+ * \brief Exchanges data in rounds of at most \c limit elements per rank.
+ */
+template <typename T>
+void alltoallvRounds(const std::vector<T>& send,
+                     const std::vector<uint64_t>& sendCounts,
+                     std::vector<T>& recv,
+                     const std::vector<uint64_t>& recvCounts,
+                     const ExchangeLayout& layout,
+                     MPI_Comm comm,
+                     uint64_t limit) {
+    int size;
+    MPI_Comm_size(comm, &size);
+
+    // Every pair of ranks exchanges at most perPeer elements per round, so
+    // that each rank sends and receives at most limit elements per round
+    const uint64_t perPeer = std::max<uint64_t>(1, limit / size);
+    uint64_t localRounds = 0;
+    for (int i = 0; i < size; ++i) {
+        localRounds = std::max(localRounds, (sendCounts[i] + perPeer - 1) / perPeer);
+    }
+    uint64_t rounds;
+    MPI_Allreduce(&localRounds, &rounds, 1, MPI_UINT64_T, MPI_MAX, comm);
+
+    DataType<T> dt;
+    std::vector<T> sendBuffer(std::min(layout.sendOffsets.back(), perPeer * size));
+    std::vector<T> recvBuffer(std::min(layout.recvOffsets.back(), perPeer * size));
+    std::vector<int> sc(size), sd(size), rc(size), rd(size);
+
+    for (uint64_t round = 0; round < rounds; ++round) {
+        const uint64_t done = round * perPeer;
+        int sendTotal = 0;
+        int recvTotal = 0;
+        for (int i = 0; i < size; ++i) {
+            sc[i] = std::min(perPeer, sendCounts[i] - std::min(sendCounts[i], done));
+            sd[i] = sendTotal;
+            if (sc[i] > 0) {
+                std::copy_n(send.begin() + layout.sendOffsets[i] + done, sc[i], sendBuffer.begin() + sendTotal);
+            }
+            sendTotal += sc[i];
+
+            rc[i] = std::min(perPeer, recvCounts[i] - std::min(recvCounts[i], done));
+            rd[i] = recvTotal;
+            recvTotal += rc[i];
+        }
+        MPI_Alltoallv(sendBuffer.data(), sc.data(), sd.data(), dt.type(),
+                      recvBuffer.data(), rc.data(), rd.data(), dt.type(),
+                      comm);
+        for (int i = 0; i < size; ++i) {
+            if (rc[i] > 0) {
+                std::copy_n(recvBuffer.begin() + rd[i], rc[i], recv.begin() + layout.recvOffsets[i] + done);
+            }
+        }
+    }
+}
+
+} // namespace detail
+
+/**
+ * \brief Exchanges data between all ranks, with 64 bit counts.
+ *
+ * Sends \c sendCounts[i] elements of \c send to rank i, where the elements for
+ * each rank follow the ones for the previous rank.  Returns the received
+ * elements ordered by sending rank in \c recv, and their number per rank in
+ * \c recvCounts.
+ *
+ * If all counts and displacements fit into an \c int and do not exceed
+ * \c maxRoundCount elements, a single \c MPI_Alltoallv is used.  Otherwise, with
+ * MPI 4 and no explicit \c maxRoundCount, the large count variant is used.
+ * As a fallback, the data is exchanged in rounds of at most \c maxRoundCount
+ * elements per rank, staged in buffers of that size.
+ */
+template <typename T>
+void alltoallv(const std::vector<T>& send,
+               const std::vector<uint64_t>& sendCounts,
+               std::vector<T>& recv,
+               std::vector<uint64_t>& recvCounts,
+               MPI_Comm comm,
+               uint64_t maxRoundCount = 0) {
+    const uint64_t limit = maxRoundCount > 0 ? std::min<uint64_t>(maxRoundCount, INT_MAX) : INT_MAX;
+    const auto layout = detail::exchangeCounts(sendCounts, recv, recvCounts, comm, limit);
+
+    DataType<T> dt;
+
+    if (layout.fitsInt) {
+        std::vector<int> sc(sendCounts.begin(), sendCounts.end());
+        std::vector<int> sd(layout.sendOffsets.begin(), layout.sendOffsets.end() - 1);
+        std::vector<int> rc(recvCounts.begin(), recvCounts.end());
+        std::vector<int> rd(layout.recvOffsets.begin(), layout.recvOffsets.end() - 1);
+        MPI_Alltoallv(send.data(), sc.data(), sd.data(), dt.type(),
+                      recv.data(), rc.data(), rd.data(), dt.type(),
+                      comm);
+        return;
+    }
+
+#if MPI_VERSION >= 4
+    if (maxRoundCount == 0) {
+        std::vector<MPI_Count> sc(sendCounts.begin(), sendCounts.end());
+        std::vector<MPI_Aint> sd(layout.sendOffsets.begin(), layout.sendOffsets.end() - 1);
+        std::vector<MPI_Count> rc(recvCounts.begin(), recvCounts.end());
+        std::vector<MPI_Aint> rd(layout.recvOffsets.begin(), layout.recvOffsets.end() - 1);
+        MPI_Alltoallv_c(send.data(), sc.data(), sd.data(), dt.type(),
+                        recv.data(), rc.data(), rd.data(), dt.type(),
+                        comm);
+        return;
+    }
+#endif
+
+    detail::alltoallvRounds(send, sendCounts, recv, recvCounts, layout, comm, limit);
+}
+
+/**
+ * \brief An exchange started by ialltoallv().
+ *
+ * The send and receive buffers have to be kept alive until wait() returns.
+ * Waits on destruction if needed.
+ */
+template <typename T>
+class PendingExchange {
+  public:
+    PendingExchange() = default;
+    PendingExchange(const PendingExchange&) = delete;
+    PendingExchange& operator=(const PendingExchange&) = delete;
+
+    PendingExchange(PendingExchange&& other) noexcept {
+        *this = std::move(other);
+    }
+
+    PendingExchange& operator=(PendingExchange&& other) noexcept {
+        wait();
+        request_ = std::exchange(other.request_, MPI_REQUEST_NULL);
+        dt_ = std::move(other.dt_);
+        for (size_t i = 0; i < 4; ++i) {
+            counts_[i] = std::move(other.counts_[i]);
+        }
+#if MPI_VERSION >= 4
+        for (size_t i = 0; i < 2; ++i) {
+            largeCounts_[i] = std::move(other.largeCounts_[i]);
+            largeDispls_[i] = std::move(other.largeDispls_[i]);
+        }
+#endif
+        return *this;
+    }
+
+    ~PendingExchange() {
+        wait();
+    }
+
+    void wait() {
+        if (request_ != MPI_REQUEST_NULL) {
+            MPI_Wait(&request_, MPI_STATUS_IGNORE);
+        }
+    }
+
+  private:
+    template <typename U>
+    friend PendingExchange<U> ialltoallv(const std::vector<U>&,
+                                         const std::vector<uint64_t>&,
+                                         std::vector<U>&,
+                                         std::vector<uint64_t>&,
+                                         MPI_Comm);
+
+    MPI_Request request_ = MPI_REQUEST_NULL;
+    // Arguments of the non-blocking call have to outlive it
+    std::unique_ptr<DataType<T>> dt_;
+    std::vector<int> counts_[4];
+#if MPI_VERSION >= 4
+    std::vector<MPI_Count> largeCounts_[2];
+    std::vector<MPI_Aint> largeDispls_[2];
+#endif
+};
+
+/**
+ * \brief Starts exchanging data between all ranks, see alltoallv().
+ *
+ * The element counts are exchanged right away.  If the data does not fit
+ * int counts and MPI 4 is not available, the data is exchanged in rounds
+ * before returning.
+ */
+template <typename T>
+PendingExchange<T> ialltoallv(const std::vector<T>& send,
+                              const std::vector<uint64_t>& sendCounts,
+                              std::vector<T>& recv,
+                              std::vector<uint64_t>& recvCounts,
+                              MPI_Comm comm) {
+    const auto layout = detail::exchangeCounts(sendCounts, recv, recvCounts, comm, INT_MAX);
+
+    PendingExchange<T> result;
+    result.dt_ = std::make_unique<DataType<T>>();
+    auto& dt = *result.dt_;
+
+    if (layout.fitsInt) {
+        auto& [sc, sd, rc, rd] = result.counts_;
+        sc.assign(sendCounts.begin(), sendCounts.end());
+        sd.assign(layout.sendOffsets.begin(), layout.sendOffsets.end() - 1);
+        rc.assign(recvCounts.begin(), recvCounts.end());
+        rd.assign(layout.recvOffsets.begin(), layout.recvOffsets.end() - 1);
+        MPI_Ialltoallv(send.data(), sc.data(), sd.data(), dt.type(),
+                       recv.data(), rc.data(), rd.data(), dt.type(),
+                       comm, &result.request_);
+        return result;
+    }
+
+#if MPI_VERSION >= 4
+    auto& [sc, rc] = result.largeCounts_;
+    auto& [sd, rd] = result.largeDispls_;
+    sc.assign(sendCounts.begin(), sendCounts.end());
+    sd.assign(layout.sendOffsets.begin(), layout.sendOffsets.end() - 1);
+    rc.assign(recvCounts.begin(), recvCounts.end());
+    rd.assign(layout.recvOffsets.begin(), layout.recvOffsets.end() - 1);
+    MPI_Ialltoallv_c(send.data(), sc.data(), sd.data(), dt.type(),
+                     recv.data(), rc.data(), rd.data(), dt.type(),
+                     comm, &result.request_);
+#else
+    detail::alltoallvRounds(send, sendCounts, recv, recvCounts, layout, comm, INT_MAX);
+#endif
+    return result;
+}
+
+} // namespace mpi
+} // namespace indexing
@@ -0,0 +1,360 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace indexing {
+
+using NodeID = uint64_t;
+using RawIndex = std::vector<std::array<uint64_t, 2>>;
+using FlatRawIndex = std::vector<std::array<uint64_t, 3>>;
+
+/**
+ * \brief Ranges of a contiguous block of node IDs in CSR layout.
+ *
+ * The ranges of node \c firstNode + i are stored in \c ranges, starting at
+ * \c offsets[i] and ending before \c offsets[i + 1].
+ */
+struct GroupedIndex {
+    NodeID firstNode = 0;
+    std::vector<uint64_t> offsets;
+    RawIndex ranges;
+
+    uint64_t nodeCount() const {
+        return offsets.empty() ? 0 : offsets.size() - 1;
+    }
+};
+
+/**
+ * \brief Partition a count and return the offset and count that \c rank should process.
+ */
+inline std::pair<uint64_t, uint64_t> partitionCount(uint64_t num, uint64_t rank, uint64_t size) {
+    const auto base_count = num / size;
+    const auto ranks_w_more = num % size;
+    return {
+        base_count * rank + std::min(rank, ranks_w_more),
+        base_count + (rank < ranks_w_more)
+    };
+}
+
+/**
+ * \brief Appends \c count node IDs, starting at edge \c offset, as ranges.
+ *
+ * Continues the last range of \c ranges if it belongs to the same node and
+ * ends at \c offset, so that the node IDs can be passed in arbitrary blocks.
+ */
+template <typename T>
+void appendNodeRanges(FlatRawIndex& ranges, const T* nodeIDs, uint64_t count, uint64_t offset) {
+    if (count == 0) {
+        return;
+    }
+    uint64_t rangeStart = offset;
+    NodeID lastNodeID = nodeIDs[0];
+    if (!ranges.empty() && ranges.back()[0] == lastNodeID && ranges.back()[2] == offset) {
+        rangeStart = ranges.back()[1];
+        ranges.pop_back();
+    }
+    for (uint64_t i = 1; i < count; ++i) {
+        if (static_cast<NodeID>(nodeIDs[i]) != lastNodeID) {
+            ranges.push_back({lastNodeID, rangeStart, offset + i});
+            rangeStart = offset + i;
+            lastNodeID = nodeIDs[i];
+        }
+    }
+    ranges.push_back({lastNodeID, rangeStart, offset + count});
+}
+
+/**
+ * \brief Merges consecutive sorted runs of a flat index into one sorted index.
+ *
+ * \arg \c runOffsets The start of every run in \c index, followed by the end of
+ * the last run.
+ *
+ * Runs are merged pairwise, requiring log2(number of runs) linear passes.
+ */
+inline void mergeSortedRuns(FlatRawIndex& index, std::vector<uint64_t> runOffsets) {
+    while (runOffsets.size() > 2) {
+        std::vector<uint64_t> merged;
+        merged.reserve(runOffsets.size() / 2 + 2);
+        size_t i = 0;
+        for (; i + 2 < runOffsets.size(); i += 2) {
+            std::inplace_merge(index.begin() + runOffsets[i],
+                               index.begin() + runOffsets[i + 1],
+                               index.begin() + runOffsets[i + 2]);
+            merged.push_back(runOffsets[i]);
+        }
+        // Odd number of runs: the last one is carried to the next pass
+        for (; i < runOffsets.size(); ++i) {
+            merged.push_back(runOffsets[i]);
+        }
+        std::swap(runOffsets, merged);
+    }
+}
+
+/**
+ * \brief Counts the ranges of a sorted flat index per node partition.
+ *
+ * \arg \c boundaries The first node ID of every partition, followed by the end
+ * of the last partition.
+ *
+ * Uses a binary search per partition boundary, so that neither memory nor
+ * time depends on the total number of nodes.
+ */
+inline std::vector<uint64_t> countPerPartition(const FlatRawIndex& nodeRanges,
+                                               const std::vector<NodeID>& boundaries) {
+    auto beforeNode = [](const FlatRawIndex::value_type& range, NodeID id) {
+        return range[0] < id;
+    };
+    std::vector<uint64_t> result;
+    if (boundaries.empty()) {
+        return result;
+    }
+    result.reserve(boundaries.size() - 1);
+    auto it = std::lower_bound(nodeRanges.begin(), nodeRanges.end(), boundaries.front(), beforeNode);
+    for (size_t i = 1; i < boundaries.size(); ++i) {
+        const auto next = std::lower_bound(it, nodeRanges.end(), boundaries[i], beforeNode);
+        result.push_back(next - it);
+        it = next;
+    }
+    return result;
+}
+
+/**
+ * \brief Groups a sorted flat index by node ID.
+ *
+ * All node IDs in \c nodeRanges have to be in [firstNode, firstNode + nodeCount).
+ * Overlapping or adjacent ranges of the same node are joined.
+ */
+inline GroupedIndex groupSortedRanges(const FlatRawIndex& nodeRanges,
+                                      NodeID firstNode,
+                                      uint64_t nodeCount) {
+    GroupedIndex result;
+    result.firstNode = firstNode;
+    result.offsets.assign(nodeCount + 1, 0);
+    result.ranges.reserve(nodeRanges.size());
+
+    auto it = nodeRanges.begin();
+    for (uint64_t i = 0; i < nodeCount; ++i) {
+        const NodeID id = firstNode + i;
+        result.offsets[i] = result.ranges.size();
+        const auto nodeStart = result.ranges.size();
+        for (; it != nodeRanges.end() && (*it)[0] == id; ++it) {
+            const auto start = (*it)[1];
+            const auto end = (*it)[2];
+            auto& ranges = result.ranges;
+            if (ranges.size() > nodeStart && ranges.back()[0] <= start && start <= ranges.back()[1]) {
+                ranges.back()[1] = std::max(ranges.back()[1], end);
+            } else {
+                ranges.push_back({start, end});
+            }
+        }
+    }
+    result.offsets[nodeCount] = result.ranges.size();
+    if (it != nodeRanges.end()) {
+        throw std::runtime_error("node ranges are unsorted or outside of the node partition");
+    }
+    result.ranges.shrink_to_fit();
+
+    return result;
+}
+
+/**
+ * \brief A block of consecutive node IDs, from \c begin to before \c end.
+ */
+struct NodeSlot {
+    NodeID begin;
+    NodeID end;
+
+    bool operator==(const NodeSlot& o) const {
+        return begin == o.begin && end == o.end;
+    }
+};
+
+/**
+ * \brief Splits the nodes into blocks that can be indexed with limited memory.
+ *
+ * \arg \c bucketCounts The number of ranges for every \c bucketWidth node IDs
+ * \arg \c capacity The maximum number of ranges and nodes per block
+ *
+ * Blocks consist of whole buckets and contain at most \c capacity ranges and
+ * nodes, unless a single bucket exceeds it.
+ */
+inline std::vector<NodeSlot> planNodeSlots(const std::vector<uint64_t>& bucketCounts,
+                                           uint64_t bucketWidth,
+                                           uint64_t nodeCount,
+                                           uint64_t capacity) {
+    std::vector<NodeSlot> result;
+    NodeID begin = 0;
+    uint64_t ranges = 0;
+    for (size_t b = 0; b < bucketCounts.size() && b * bucketWidth < nodeCount; ++b) {
+        const NodeID bucketBegin = b * bucketWidth;
+        const NodeID bucketEnd = std::min(nodeCount, bucketBegin + bucketWidth);
+        const bool fits = ranges + bucketCounts[b] <= capacity && bucketEnd - begin <= capacity;
+        if (!fits && bucketBegin > begin) {
+            result.push_back({begin, bucketBegin});
+            begin = bucketBegin;
+            ranges = 0;
+        }
+        ranges += bucketCounts[b];
+    }
+    if (begin < nodeCount) {
+        result.push_back({begin, nodeCount});
+    }
+    return result;
+}
+
+/**
+ * \brief Summary of the ranges of one rank, to detect globally sorted edges.
+ *
+ * Consists of 64 bit fields only, so that it can be gathered as such.
+ */
+struct RankRanges {
+    uint64_t sorted = 1;  ///< Node IDs strictly increase over contiguous ranges
+    uint64_t rangeCount = 0;
+    NodeID firstNode = 0;
+    NodeID lastNode = 0;
+    uint64_t firstEdge = 0;  ///< Start of the first range
+    uint64_t lastEdge = 0;  ///< End of the last range
+    uint64_t firstRangeEnd = 0;
+};
+
+/**
+ * \brief Summarizes ranges in edge order, as appended by appendNodeRanges().
+ */
+inline RankRanges summarizeRanges(const FlatRawIndex& ranges) {
+    RankRanges result;
+    result.rangeCount = ranges.size();
+    if (ranges.empty()) {
+        return result;
+    }
+    result.firstNode = ranges.front()[0];
+    result.lastNode = ranges.back()[0];
+    result.firstEdge = ranges.front()[1];
+    result.lastEdge = ranges.back()[2];
+    result.firstRangeEnd = ranges.front()[2];
+    for (size_t i = 1; i < ranges.size(); ++i) {
+        if (ranges[i][0] <= ranges[i - 1][0] || ranges[i][1] != ranges[i - 1][2]) {
+            result.sorted = 0;
+            break;
+        }
+    }
+    return result;
+}
+
+/**
+ * \brief Orders the ranks with ranges by their first edge, if all edges are sorted by node ID.
+ *
+ * Returns nothing if any rank holds unsorted ranges, if the ranks do not
+ * hold consecutive blocks of edges with non-decreasing node IDs, or if there
+ * are no ranges at all.
+ */
+inline std::optional<std::vector<size_t>> sortedRankOrder(const std::vector<RankRanges>& ranks) {
+    std::vector<size_t> order;
+    for (size_t rank = 0; rank < ranks.size(); ++rank) {
+        if (!ranks[rank].sorted) {
+            return std::nullopt;
+        }
+        if (ranks[rank].rangeCount > 0) {
+            order.push_back(rank);
+        }
+    }
+    if (order.empty()) {
+        return std::nullopt;
+    }
+    std::sort(order.begin(), order.end(), [&ranks](size_t a, size_t b) {
+        return ranks[a].firstEdge < ranks[b].firstEdge;
+    });
+    for (size_t i = 1; i < order.size(); ++i) {
+        const auto& previous = ranks[order[i - 1]];
+        const auto& next = ranks[order[i]];
+        if (previous.lastEdge != next.firstEdge || previous.lastNode > next.firstNode) {
+            return std::nullopt;
+        }
+    }
+    return order;
+}
+
+/**
+ * \brief The rows of both index datasets written by one rank.
+ */
+struct IndexSlice {
+    uint64_t nodeOffset = 0;
+    RawIndex nodeToRanges;
+    uint64_t rangeOffset = 0;
+    RawIndex rangeToEdges;
+    uint64_t rangeCount = 0;  ///< Total over all ranks
+};
+
+/**
+ * \brief Builds the index rows of \c rank in one pass when all edges are sorted.
+ *
+ * \arg \c ranks The summaries of all ranks
+ * \arg \c order The ranks with ranges, see sortedRankOrder()
+ *
+ * Every node has a single range.  A node whose edges span several ranks is
+ * written by the first of them, and the last rank writing ranges also writes
+ * the trailing nodes without edges.
+ */
+inline IndexSlice sliceSortedRanges(const FlatRawIndex& ranges,
+                                    const std::vector<RankRanges>& ranks,
+                                    const std::vector<size_t>& order,
+                                    size_t rank,
+                                    uint64_t nodeCount) {
+    if (ranks[order.back()].lastNode >= nodeCount) {
+        throw std::runtime_error("node ranges are outside of the node partition");
+    }
+
+    // The first range of a rank may continue the last node of its predecessor
+    std::vector<uint64_t> owned(order.size());
+    IndexSlice result;
+    for (size_t i = 0; i < order.size(); ++i) {
+        const bool continued = i > 0 && ranks[order[i - 1]].lastNode == ranks[order[i]].firstNode;
+        owned[i] = ranks[order[i]].rangeCount - continued;
+        result.rangeCount += owned[i];
+    }
+
+    const size_t position = std::find(order.begin(), order.end(), rank) - order.begin();
+    if (position == order.size() || owned[position] == 0) {
+        return result;
+    }
+
+    const auto& local = ranks[rank];
+    const bool lastWriter = std::all_of(owned.begin() + position + 1, owned.end(),
+                                        [](uint64_t n) { return n == 0; });
+    const NodeID nodeEnd = lastWriter ? nodeCount : local.lastNode + 1;
+    result.nodeOffset = position > 0 ? ranks[order[position - 1]].lastNode + 1 : 0;
+    result.rangeOffset = std::accumulate(owned.begin(), owned.begin() + position, uint64_t{0});
+
+    result.nodeToRanges.reserve(nodeEnd - result.nodeOffset);
+    result.rangeToEdges.reserve(owned[position]);
+    for (auto it = ranges.end() - owned[position]; it != ranges.end(); ++it) {
+        const auto& [id, start, end] = *it;
+        result.nodeToRanges.resize(id - result.nodeOffset, {0, 0});
+        const uint64_t row = result.rangeOffset + result.rangeToEdges.size();
+        result.nodeToRanges.push_back({row, row + 1});
+        result.rangeToEdges.push_back({start, end});
+    }
+    result.nodeToRanges.resize(nodeEnd - result.nodeOffset, {0, 0});
+
+    // The last node may continue on the following ranks
+    for (size_t i = position + 1; i < order.size(); ++i) {
+        const auto& next = ranks[order[i]];
+        if (next.firstNode != local.lastNode) {
+            break;
+        }
+        result.rangeToEdges.back()[1] = next.firstRangeEnd;
+        if (next.rangeCount > 1) {
+            break;
+        }
+    }
+
+    return result;
+}
+
+}  // namespace indexing
@@ -1,9 +1,11 @@
 #include "index.h"
 
 #include <array>
+#include <cmath>
 #include <cstdint>
+#include <optional>
 #include <set>
-#include <unordered_map>
+#include <thread>
 #include <vector>
 
 #include <mpi.h>
@@ -11,13 +13,18 @@
 #include <highfive/H5DataSet.hpp>
 #include <highfive/H5File.hpp>
 
+#include "exchange.h"
+#include "flat_index.h"
+#include "layout.h"
+#include "radix_sort.h"
+#include "stats.hpp"
+
 namespace indexing {
 
 namespace {
 
-using NodeID = uint64_t;
-using RawIndex = std::vector<std::array<uint64_t, 2>>;
-using FlatRawIndex = std::vector<std::array<uint64_t, 3>>;
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
 
 constexpr auto INDEX_ELEMENT_SIZE = sizeof(FlatRawIndex::value_type);
 
@@ -33,11 +40,10 @@ const char* const RANGE_TO_EDGE_ID_DSET = "range_to_edge_id";
 }  // unnamed namespace
 
 
-namespace {
-
-
 namespace mpi {
 
+namespace {
+
 /**
  * \brief Helper to return the current rank.
  */
@@ -60,31 +66,12 @@ uint64_t size() {
     return size;
 }
 
-/**
- * \brief Helper class to get a RAII-style MPI type
- */
-template <typename T>
-class DataType {
-  public:
-    DataType() {
-        static_assert(std::is_trivially_copyable<T>::value,
-                      "Only trivially copyable types are supported.");
-        MPI_Type_contiguous(sizeof(T), MPI_BYTE, &kind_);
-        MPI_Type_commit(&kind_);
+}  // unnamed namespace
 
-    }
-    ~DataType() {
-        MPI_Type_free(&kind_);
-    }
+} // namespace mpi
 
-    MPI_Datatype& type() {
-        return kind_;
-    }
-  private:
-    MPI_Datatype kind_;
-};
 
-} // namespace mpi
+namespace {
 
 
 /**
@@ -97,15 +84,10 @@ class DataType {
  * \returns The offset and count of elements to process
  */
 std::pair<uint64_t, uint64_t> partition_count(const uint64_t num, int rank = -1) {
-    const auto base_count = num / mpi::size();
-    const auto ranks_w_more = num % mpi::size();
     if (rank < 0) {
         rank = mpi::rank();
     }
-    return {
-        base_count * rank + std::min(static_cast<uint64_t>(rank), ranks_w_more),
-        base_count + (rank < ranks_w_more)
-    };
+    return partitionCount(num, rank, mpi::size());
 }
 
 /**
@@ -113,42 +95,9 @@ std::pair<uint64_t, uint64_t> partition_count(const uint64_t num, int rank = -1)
  */
 FlatRawIndex _groupNodeRanges(const std::vector<NodeID>& nodeIDs, uint64_t offset) {
     FlatRawIndex result;
-
-    if (nodeIDs.empty()) {
-        return result;
-    }
-
     result.reserve(nodeIDs.size());  // Worst-case scenario, avoid re-allocating a lot
-
-    uint64_t rangeStart = 0;
-    NodeID lastNodeID = nodeIDs[rangeStart];
-    for (uint64_t i = 1; i < nodeIDs.size(); ++i) {
-        if (nodeIDs[i] != lastNodeID) {
-            result.push_back({lastNodeID, rangeStart + offset, i + offset});
-            rangeStart = i;
-            lastNodeID = nodeIDs[rangeStart];
-        }
-    }
-
-    result.push_back({lastNodeID, rangeStart + offset, nodeIDs.size() + offset});
+    appendNodeRanges(result, nodeIDs.data(), nodeIDs.size(), offset);
     result.shrink_to_fit();
-
-    return result;
-}
-
-/**
- * \brief Takes a flat index and groups all ranges by node ID in a map.
- */
-std::unordered_map<NodeID, RawIndex> _regroupNodeRanges(const FlatRawIndex& nodeRanges) {
-    std::unordered_map<NodeID, RawIndex> result;
-    for (const auto& [id, start, end]: nodeRanges) {
-        auto& ranges = result[id];
-        if (!ranges.empty() && ranges.back()[0] <= start && start <= ranges.back()[1]) {
-            ranges.back()[1] = std::max(ranges.back()[1], end);
-        } else {
-            ranges.push_back({start, end});
-        }
-    }
     return result;
 }
 
@@ -164,7 +113,8 @@ std::pair<std::vector<NodeID>, uint64_t> _readNodeIDs(const HighFive::Group& h5R
       // * the one we read and distribute
       // * the one we gather and write
       // Add a factor of two for potential MPI buffers => 4 indices with count
-      // elements.
+      // elements.  Source and target indices are built at the same time, so
+      // this applies to each of them.
       //
       // As we process the indices, we should release memory from now prior
       // versions.
@@ -174,6 +124,7 @@ std::pair<std::vector<NodeID>, uint64_t> _readNodeIDs(const HighFive::Group& h5R
                              (1024.0 * 1024.0))
                 << " MB memory usage" << std::endl;
     }
+    ScopedTimer timer(Stage::IndexRead, count * sizeof(NodeID), count);
     dataset.select({offset}, {count}).read(result);
     return {result, offset};
 }
@@ -181,93 +132,125 @@ std::pair<std::vector<NodeID>, uint64_t> _readNodeIDs(const HighFive::Group& h5R
 /**
  * \brief Writes a single dataset.
  */
-void _writeIndexDataset(const RawIndex& data, const std::string& name, HighFive::Group& h5Group, uint64_t offset, uint64_t global_count) {
-    constexpr auto inner_size = std::tuple_size<RawIndex::value_type>::value;
-    auto dset = h5Group.createDataSet<uint64_t>(
-        name,
-        {global_count, inner_size}
-    );
-    dset.select({offset, 0}, {data.size(), inner_size}).write(data);
+void _writeIndexDataset(const RawIndex& data,
+                        const std::string& name,
+                        HighFive::Group& h5Group,
+                        uint64_t offset,
+                        uint64_t global_count,
+                        const IndexLayout& layout) {
+    auto dset = createIndexDataset(h5Group, name, layout, global_count);
+    writeIndexRows(dset, data, offset, layout);
 }
 
 /**
- * \brief Writes two datasets: node IDs to ranges, ranges to edge IDs.
- *
- * Will split the work across multiple MPI nodes and gather indices as required.
+ * \brief The ranges of one index on their way from the reading to the writing ranks.
  */
-void _writeIndexGroup(const std::string& source,
-                      uint64_t nodeCount,
-                      HighFive::Group& h5Root,
-                      const std::string& name) {
-
-    auto [nodeIDs, nodeIDOffset] = _readNodeIDs(h5Root, source);
-    auto readRanges = _groupNodeRanges(nodeIDs, nodeIDOffset);
-    // sort ranges for MPI exchange
-    std::sort(std::begin(readRanges), std::end(readRanges));
-
-    if (nodeCount == 0) {
-        uint64_t localMaxNodeMaxID = readRanges.back()[0];
-        uint64_t globalMaxNodeID;
-        MPI_Allreduce(&localMaxNodeMaxID, &globalMaxNodeID, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
-        nodeCount = globalMaxNodeID + 1;
-    }
+struct IndexExchange {
+    FlatRawIndex readRanges;
+    uint64_t nodeCount;
+    std::string name;
+    std::vector<uint64_t> rangesToSend;
+    FlatRawIndex writeRanges;
+    std::vector<uint64_t> rangesToReceive;
+    MPI_Comm comm = MPI_COMM_NULL;
+    mpi::PendingExchange<FlatRawIndex::value_type> pending;
+    std::vector<RankRanges> ranks;
+    std::optional<std::vector<size_t>> sortedOrder;
+};
 
-    std::vector<uint64_t> rangeCounts(nodeCount, 0);
-    for (const auto& range: readRanges) {
-        rangeCounts[range[0]]++;
-    }
+/**
+ * \brief Gathers the summaries of the ranges of all ranks, to detect sorted edges.
+ */
+void _detectSortedEdges(IndexExchange& index) {
+    constexpr int fields = sizeof(RankRanges) / sizeof(uint64_t);
+    static_assert(sizeof(RankRanges) == fields * sizeof(uint64_t), "RankRanges has to be packed");
+
+    const auto local = summarizeRanges(index.readRanges);
+    index.ranks.resize(mpi::size());
+    ScopedTimer timer(Stage::IndexExchange);
+    MPI_Allgather(&local, fields, MPI_UINT64_T,
+                  index.ranks.data(), fields, MPI_UINT64_T,
+                  MPI_COMM_WORLD);
+    index.sortedOrder = sortedRankOrder(index.ranks);
+}
 
-    std::vector<int> rangesToSend(mpi::size(), 0);
-    for (int rank = 0; rank < mpi::size(); ++rank) {
-        const auto [offset, count] = partition_count(nodeCount, rank);
-        for (int i = offset; i < offset + count; ++i) {
-            rangesToSend[rank] += rangeCounts[i];
-        }
+/**
+ * \brief Writes an index of edges sorted by node ID, without exchanging ranges.
+ *
+ * Every rank writes the nodes of its own edges, a node spanning several
+ * ranks is completed from the summaries of the following ranks.
+ */
+void _writeSortedIndexGroup(IndexExchange& index, HighFive::Group& h5Root, const IndexLayout& layout) {
+    ScopedTimer timer(Stage::IndexWrite);
+    const auto& order = *index.sortedOrder;
+    if (index.nodeCount == 0) {
+        index.nodeCount = index.ranks[order.back()].lastNode + 1;
     }
 
-    // exchange send range
-    std::vector<int> rangesToReceive(mpi::size(), 0);
-    MPI_Alltoall(
-        rangesToSend.data(), 1, MPI_INT,
-        rangesToReceive.data(), 1, MPI_INT,
-        MPI_COMM_WORLD
-    );
+    const auto slice = sliceSortedRanges(index.readRanges, index.ranks, order, mpi::rank(), index.nodeCount);
 
-    FlatRawIndex writeRanges(std::accumulate(rangesToReceive.begin(), rangesToReceive.end(), uint64_t{0}));
-    mpi::DataType<FlatRawIndex::value_type> dt;
+    {
+        FlatRawIndex empty;
+        std::swap(index.readRanges, empty);
+    }
 
-    std::vector<int> offsetsToSend(mpi::size() + 1);
-    std::partial_sum(rangesToSend.begin(), rangesToSend.end(), offsetsToSend.begin() + 1);
+    timer.add(slice.rangeToEdges.size() * INDEX_ELEMENT_SIZE, slice.rangeToEdges.size());
+    auto indexGroup = h5Root.createGroup(index.name);
+    _writeIndexDataset(slice.nodeToRanges, NODE_ID_TO_RANGES_DSET, indexGroup, slice.nodeOffset, index.nodeCount, layout);
+    _writeIndexDataset(slice.rangeToEdges, RANGE_TO_EDGE_ID_DSET, indexGroup, slice.rangeOffset, slice.rangeCount, layout);
+}
 
-    std::vector<int> offsetsToReceive(mpi::size() + 1);
-    std::partial_sum(rangesToReceive.begin(), rangesToReceive.end(), offsetsToReceive.begin() + 1);
+/**
+ * \brief Determines the node count if needed, and how many sorted ranges go to each rank.
+ */
+void _prepareExchange(IndexExchange& index) {
+    if (index.nodeCount == 0) {
+        uint64_t localMaxNodeMaxID = index.readRanges.empty() ? 0 : index.readRanges.back()[0];
+        uint64_t globalMaxNodeID;
+        ScopedTimer timer(Stage::IndexExchange);
+        MPI_Allreduce(&localMaxNodeMaxID, &globalMaxNodeID, 1, MPI_UINT64_T, MPI_MAX, MPI_COMM_WORLD);
+        index.nodeCount = globalMaxNodeID + 1;
+    }
+    if (!index.readRanges.empty() && index.readRanges.back()[0] >= index.nodeCount) {
+        throw std::runtime_error("node ID exceeds the node count");
+    }
 
-    MPI_Alltoallv(
-        readRanges.data(), rangesToSend.data(), offsetsToSend.data(), dt.type(),
-        writeRanges.data(), rangesToReceive.data(), offsetsToReceive.data(), dt.type(),
-        MPI_COMM_WORLD
-    );
+    // The ranges are sorted by node ID, so the ranges to send to each rank
+    // are contiguous and can be found by searching the partition boundaries
+    std::vector<NodeID> boundaries(mpi::size() + 1, index.nodeCount);
+    for (int rank = 0; rank < mpi::size(); ++rank) {
+        boundaries[rank] = partition_count(index.nodeCount, rank).first;
+    }
+    index.rangesToSend = countPerPartition(index.readRanges, boundaries);
+}
 
+/**
+ * \brief Writes two datasets: node IDs to ranges, ranges to edge IDs.
+ *
+ * Takes the ranges received from all ranks, each run sorted.
+ */
+void _writeIndexGroup(IndexExchange& index, HighFive::Group& h5Root, const IndexLayout& layout) {
+    ScopedTimer timer(Stage::IndexWrite);
     {
         FlatRawIndex empty;
-        std::swap(readRanges, empty);
+        std::swap(index.readRanges, empty);
     }
 
-    const auto [localNodeOffset, localNodeCount] = partition_count(nodeCount);
-    const auto nodeToRanges = _regroupNodeRanges(writeRanges);
+    // Every rank sent its ranges sorted, merge them and group by node
+    std::vector<uint64_t> offsetsToReceive(mpi::size() + 1, 0);
+    std::partial_sum(index.rangesToReceive.begin(), index.rangesToReceive.end(), offsetsToReceive.begin() + 1);
+    mergeSortedRuns(index.writeRanges, std::move(offsetsToReceive));
+
+    const auto [localNodeOffset, localNodeCount] = partition_count(index.nodeCount);
+    const auto nodeToRanges = groupSortedRanges(index.writeRanges, localNodeOffset, localNodeCount);
 
     {
         FlatRawIndex empty;
-        std::swap(writeRanges, empty);
+        std::swap(index.writeRanges, empty);
     }
 
-    const uint64_t rangeCount =
-        std::accumulate(nodeToRanges.begin(),
-                        nodeToRanges.end(),
-                        uint64_t{0},
-                        [](uint64_t total, decltype(nodeToRanges)::const_reference item) {
-                            return total + item.second.size();
-                        });
+    const uint64_t rangeCount = nodeToRanges.ranges.size();
+    timer.add(rangeCount * INDEX_ELEMENT_SIZE, rangeCount);
 
     std::vector<uint64_t> allRangeCounts(mpi::size());
     MPI_Allgather(
@@ -280,27 +263,114 @@ void _writeIndexGroup(const std::string& source,
     const uint64_t globalRangeCount = std::accumulate(allRangeCounts.begin(), allRangeCounts.end(), uint64_t{0});
 
     RawIndex primaryIndex;
-    RawIndex secondaryIndex;
-
     primaryIndex.reserve(localNodeCount);
-    secondaryIndex.reserve(rangeCount);
 
-    uint64_t offset = localRangeOffset;
-    for (NodeID nodeID = localNodeOffset; nodeID < localNodeOffset + localNodeCount; ++nodeID) {
-        const auto it = nodeToRanges.find(nodeID);
-        if (it == nodeToRanges.end()) {
+    for (uint64_t i = 0; i < localNodeCount; ++i) {
+        const auto start = nodeToRanges.offsets[i];
+        const auto end = nodeToRanges.offsets[i + 1];
+        if (start == end) {
             primaryIndex.push_back({0, 0});
         } else {
-            auto& ranges = it->second;
-            primaryIndex.push_back({offset, offset + ranges.size()});
-            offset += ranges.size();
-            std::move(ranges.begin(), ranges.end(), std::back_inserter(secondaryIndex));
+            primaryIndex.push_back({localRangeOffset + start, localRangeOffset + end});
         }
     }
 
-    auto indexGroup = h5Root.createGroup(name);
-    _writeIndexDataset(primaryIndex, NODE_ID_TO_RANGES_DSET, indexGroup, localNodeOffset, nodeCount);
-    _writeIndexDataset(secondaryIndex, RANGE_TO_EDGE_ID_DSET, indexGroup, localRangeOffset, globalRangeCount);
+    auto indexGroup = h5Root.createGroup(index.name);
+    _writeIndexDataset(primaryIndex, NODE_ID_TO_RANGES_DSET, indexGroup, localNodeOffset, index.nodeCount, layout);
+    _writeIndexDataset(nodeToRanges.ranges, RANGE_TO_EDGE_ID_DSET, indexGroup, localRangeOffset, globalRangeCount, layout);
+}
+
+/**
+ * \brief Builds the source and target index, overlapping their work.
+ *
+ * Each rank passes the ranges of an arbitrary subset of the edges, in edge
+ * order.  If all edges are already sorted by the node ID of an index, it is
+ * written directly.  Otherwise, the ranges are sorted, both indices
+ * concurrently, and exchanged with non-blocking collectives on separate
+ * communicators, so that the ranges of one index are still in flight while
+ * the other is grouped and written.
+ *
+ * Only the main thread calls MPI and HDF5.  A non-zero \c maxExchangeCount
+ * forces blocking exchanges in rounds.
+ */
+void _writeIndexGroups(HighFive::Group& h5Root,
+                       std::array<IndexExchange, 2>& indices,
+                       uint64_t maxExchangeCount,
+                       const IndexLayout& layout) {
+    std::vector<IndexExchange*> unsorted;
+    for (auto& index: indices) {
+        _detectSortedEdges(index);
+        if (!index.sortedOrder) {
+            unsorted.push_back(&index);
+        }
+    }
+
+    if (!unsorted.empty()) {
+        // The ranges are in edge order, so sorting by node ID suffices
+        const unsigned threads = std::max<unsigned>(1, std::thread::hardware_concurrency() / unsorted.size());
+        std::vector<std::thread> sorters;
+        for (auto* index: unsorted) {
+            sorters.emplace_back([&ranges = index->readRanges, threads] {
+                ScopedTimer timer(Stage::IndexSort, ranges.size() * INDEX_ELEMENT_SIZE, ranges.size());
+                radixSortByNode(ranges, threads);
+            });
+        }
+        for (auto& sorter: sorters) {
+            sorter.join();
+        }
+    }
+
+    for (auto* index: unsorted) {
+        _prepareExchange(*index);
+    }
+
+    if (maxExchangeCount > 0) {
+        for (auto& index: indices) {
+            if (index.sortedOrder) {
+                _writeSortedIndexGroup(index, h5Root, layout);
+                continue;
+            }
+            {
+                ScopedTimer timer(Stage::IndexExchange,
+                                  index.readRanges.size() * INDEX_ELEMENT_SIZE, index.readRanges.size());
+                mpi::alltoallv(index.readRanges, index.rangesToSend,
+                               index.writeRanges, index.rangesToReceive,
+                               MPI_COMM_WORLD, maxExchangeCount);
+            }
+            _writeIndexGroup(index, h5Root, layout);
+        }
+        return;
+    }
+
+    for (auto* index: unsorted) {
+        ScopedTimer timer(Stage::IndexExchange,
+                          index->readRanges.size() * INDEX_ELEMENT_SIZE, index->readRanges.size());
+        MPI_Comm_dup(MPI_COMM_WORLD, &index->comm);
+        index->pending = mpi::ialltoallv(index->readRanges, index->rangesToSend,
+                                         index->writeRanges, index->rangesToReceive,
+                                         index->comm);
+    }
+    for (auto& index: indices) {
+        if (index.sortedOrder) {
+            _writeSortedIndexGroup(index, h5Root, layout);
+        }
+    }
+    for (auto* index: unsorted) {
+        {
+            ScopedTimer timer(Stage::IndexExchange);
+            index->pending.wait();
+            MPI_Comm_free(&index->comm);
+        }
+        _writeIndexGroup(*index, h5Root, layout);
+    }
+}
+
+/**
+ * \brief Reads the node IDs of \a name, evenly split over all ranks, as ranges.
+ */
+FlatRawIndex _readNodeRanges(const HighFive::Group& h5Root, const std::string& name) {
+    auto [nodeIDs, nodeIDOffset] = _readNodeIDs(h5Root, name);
+    return _groupNodeRanges(nodeIDs, nodeIDOffset);
 }
 
 }  // unnamed namespace
@@ -308,19 +378,40 @@ void _writeIndexGroup(const std::string& source,
 
 void write(HighFive::Group& h5Root,
            uint64_t sourceNodeCount,
-           uint64_t targetNodeCount) {
+           uint64_t targetNodeCount,
+           uint64_t maxExchangeCount,
+           const IndexLayout& layout) {
+    if (h5Root.exist(INDEX_GROUP)) {
+        throw std::runtime_error("Index group already exists");
+    }
+
+    auto sourceRanges = _readNodeRanges(h5Root, SOURCE_NODE_ID_DSET);
+    auto targetRanges = _readNodeRanges(h5Root, TARGET_NODE_ID_DSET);
+    write(h5Root, sourceNodeCount, targetNodeCount,
+          std::move(sourceRanges), std::move(targetRanges), maxExchangeCount, layout);
+}
+
+
+void write(HighFive::Group& h5Root,
+           uint64_t sourceNodeCount,
+           uint64_t targetNodeCount,
+           FlatRawIndex sourceRanges,
+           FlatRawIndex targetRanges,
+           uint64_t maxExchangeCount,
+           const IndexLayout& layout) {
     if (h5Root.exist(INDEX_GROUP)) {
         throw std::runtime_error("Index group already exists");
     }
 
-    _writeIndexGroup(SOURCE_NODE_ID_DSET,
-                     sourceNodeCount,
-                     h5Root,
-                     SOURCE_INDEX_GROUP);
-    _writeIndexGroup(TARGET_NODE_ID_DSET,
-                     targetNodeCount,
-                     h5Root,
-                     TARGET_INDEX_GROUP);
+    std::array<IndexExchange, 2> indices;
+    indices[0].readRanges = std::move(sourceRanges);
+    indices[0].nodeCount = sourceNodeCount;
+    indices[0].name = SOURCE_INDEX_GROUP;
+    indices[1].readRanges = std::move(targetRanges);
+    indices[1].nodeCount = targetNodeCount;
+    indices[1].name = TARGET_INDEX_GROUP;
+    const auto edgeCount = h5Root.getDataSet(SOURCE_NODE_ID_DSET).getElementCount();
+    _writeIndexGroups(h5Root, indices, maxExchangeCount, resolveLayout(layout, edgeCount));
 }
 
 
@@ -1,11 +1,84 @@
 #pragma once
 
+#include <string>
+
 #include <highfive/H5Group.hpp>
 
+#include "flat_index.h"
+
 namespace indexing {
 
+/**
+ * \brief Storage of the index datasets.
+ *
+ * Default constructed, the datasets are contiguous 64 bit integers written
+ * independently by every rank.  Compression requires chunking; if no chunk
+ * size is given, \c DEFAULT_CHUNK_SIZE rows are used per chunk.  With more
+ * than one rank, compressed datasets are always written collectively.
+ */
+struct IndexLayout {
+    static constexpr uint64_t DEFAULT_CHUNK_SIZE = 1024 * 1024;
+
+    /// Rows per chunk, 0 for contiguous datasets
+    uint64_t chunkSize = 0;
+    /// Deflate compression level (1-9), 0 to disable
+    unsigned deflate = 0;
+    /// Enable the byte shuffle filter (applied before compression)
+    bool shuffle = false;
+    /// Write the datasets with collective I/O
+    bool collective = false;
+    /// Store 32 bit unsigned integers if all edge IDs fit
+    bool narrow = false;
+
+    inline bool filtered() const {
+        return deflate > 0 || shuffle;
+    }
+
+    inline bool chunked() const {
+        return chunkSize > 0 || filtered();
+    }
+};
+
+/**
+ * \brief Writes the source and target indices of the edges in \a h5Root.
+ *
+ * \arg \c maxExchangeCount If non-zero, limits the number of ranges each rank
+ * exchanges with the others at once, see mpi::alltoallv.
+ */
 void write(HighFive::Group& h5Root,
            uint64_t sourceNodeCount,
-           uint64_t targetNodeCount);
+           uint64_t targetNodeCount,
+           uint64_t maxExchangeCount = 0,
+           const IndexLayout& layout = {});
+
+/**
+ * \brief Writes the indices from node ranges collected while writing the edges.
+ *
+ * Avoids reading the node IDs back from \a h5Root.  Every rank passes the
+ * ranges of the edges it wrote in edge order, see appendNodeRanges().
+ */
+void write(HighFive::Group& h5Root,
+           uint64_t sourceNodeCount,
+           uint64_t targetNodeCount,
+           FlatRawIndex sourceRanges,
+           FlatRawIndex targetRanges,
+           uint64_t maxExchangeCount = 0,
+           const IndexLayout& layout = {});
+
+/**
+ * \brief Writes the indices of the edges in \a h5Root within a memory budget.
+ *
+ * The node IDs are read in windows and kept as sorted runs of ranges in
+ * temporary files in \a spillDirectory.  The nodes are then indexed in as
+ * many passes as needed for every rank to handle its share of the ranges
+ * within \a memoryBudget bytes.  Node counts of 0 are derived from the
+ * largest node ID.
+ */
+void writeBounded(HighFive::Group& h5Root,
+                  uint64_t sourceNodeCount,
+                  uint64_t targetNodeCount,
+                  uint64_t memoryBudget,
+                  const std::string& spillDirectory,
+                  const IndexLayout& layout = {});
 
 } // namespace index
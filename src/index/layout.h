@@ -0,0 +1,98 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include <mpi.h>
+
+#include <highfive/H5DataSet.hpp>
+#include <highfive/H5Group.hpp>
+
+#include "flat_index.h"
+#include "index.h"
+
+namespace indexing {
+
+/**
+ * \brief Resolves the options of \a layout that depend on the edges and ranks.
+ *
+ * Narrow types are only used if all edge IDs of the \a edgeCount edges fit,
+ * and compressed datasets have to be written collectively in parallel.
+ */
+inline IndexLayout resolveLayout(IndexLayout layout, uint64_t edgeCount) {
+    int size;
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+    layout.narrow = layout.narrow && edgeCount <= std::numeric_limits<uint32_t>::max();
+    layout.collective = layout.collective || (layout.filtered() && size > 1);
+    return layout;
+}
+
+/**
+ * \brief Creates an index dataset of \a rows rows with two columns.
+ *
+ * Extendible datasets start out empty, and are chunked by \a extendibleChunk
+ * rows unless \a layout specifies chunks.
+ */
+inline HighFive::DataSet createIndexDataset(HighFive::Group& group,
+                                            const std::string& name,
+                                            const IndexLayout& layout,
+                                            uint64_t rows,
+                                            uint64_t extendibleChunk = 0) {
+    const bool extendible = extendibleChunk > 0;
+    HighFive::DataSetCreateProps props;
+    if (extendible || (layout.chunked() && rows > 0)) {
+        hsize_t chunk = layout.chunkSize;
+        if (chunk == 0) {
+            chunk = layout.chunked() ? IndexLayout::DEFAULT_CHUNK_SIZE : extendibleChunk;
+        }
+        if (!extendible) {
+            chunk = std::min<hsize_t>(chunk, rows);
+        }
+        props.add(HighFive::Chunking(std::vector<hsize_t>{chunk, 2}));
+        if (layout.shuffle) {
+            props.add(HighFive::Shuffle());
+        }
+        if (layout.deflate > 0) {
+            props.add(HighFive::Deflate(layout.deflate));
+        }
+    }
+    const auto space = extendible
+        ? HighFive::DataSpace({0, 2}, {HighFive::DataSpace::UNLIMITED, 2})
+        : HighFive::DataSpace({rows, 2});
+    if (layout.narrow) {
+        return group.createDataSet<uint32_t>(name, space, props);
+    }
+    return group.createDataSet<uint64_t>(name, space, props);
+}
+
+/**
+ * \brief Writes \a data to the rows of an index dataset starting at \a offset.
+ *
+ * Collective if \a layout says so: every rank has to call this, possibly
+ * without any data.
+ */
+inline void writeIndexRows(HighFive::DataSet& dataset,
+                           const RawIndex& data,
+                           uint64_t offset,
+                           const IndexLayout& layout) {
+    HighFive::DataTransferProps xfer;
+    if (layout.collective) {
+        xfer.add(HighFive::UseCollectiveIO{});
+    }
+    auto selection = dataset.select({offset, 0}, {data.size(), 2});
+    if (layout.narrow) {
+        std::vector<std::array<uint32_t, 2>> narrow(data.size());
+        std::transform(data.begin(), data.end(), narrow.begin(), [](const auto& row) {
+            return std::array<uint32_t, 2>{static_cast<uint32_t>(row[0]), static_cast<uint32_t>(row[1])};
+        });
+        selection.write(narrow, xfer);
+    } else {
+        selection.write(data, xfer);
+    }
+}
+
+}  // namespace indexing
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "flat_index.h"
+
+namespace indexing {
+
+namespace detail {
+
+constexpr unsigned RADIX_BITS = 11;
+constexpr size_t RADIX_BUCKETS = size_t{1} << RADIX_BITS;
+constexpr NodeID RADIX_MASK = RADIX_BUCKETS - 1;
+
+/// Below this many ranges per thread, threads are not worth their start-up
+constexpr size_t RADIX_MIN_BLOCK = size_t{1} << 16;
+
+/**
+ * \brief Calls \c f(thread, begin, end) for \c threads contiguous blocks of \c size elements.
+ *
+ * The first block is processed by the calling thread.
+ */
+template <typename F>
+void forEachBlock(size_t size, unsigned threads, F&& f) {
+    const auto block = [&](unsigned t) { return size * t / threads; };
+    std::vector<std::thread> workers;
+    workers.reserve(threads - 1);
+    for (unsigned t = 1; t < threads; ++t) {
+        workers.emplace_back([&f, &block, t] { f(t, block(t), block(t + 1)); });
+    }
+    f(0, block(0), block(1));
+    for (auto& worker: workers) {
+        worker.join();
+    }
+}
+
+}  // namespace detail
+
+/**
+ * \brief Sorts a flat index by node ID with a least significant digit radix sort.
+ *
+ * Only the node ID is used as key, and the sort is stable: ranges appended in
+ * edge order, as by appendNodeRanges(), end up in the same order as after
+ * sorting the full triples.  Passes over digits shared by all node IDs are
+ * skipped.  Histograms and scattering are split over \c threads threads,
+ * defaulting to the hardware concurrency.
+ */
+inline void radixSortByNode(FlatRawIndex& ranges, unsigned threads = 0) {
+    using namespace detail;
+    using Histogram = std::array<uint64_t, RADIX_BUCKETS>;
+
+    const size_t size = ranges.size();
+    if (size < RADIX_MIN_BLOCK) {
+        std::stable_sort(ranges.begin(), ranges.end(), [](const auto& a, const auto& b) {
+            return a[0] < b[0];
+        });
+        return;
+    }
+
+    if (threads == 0) {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = static_cast<unsigned>(std::clamp<size_t>(size / RADIX_MIN_BLOCK, 1, threads));
+
+    std::vector<NodeID> maxima(threads, 0);
+    forEachBlock(size, threads, [&](unsigned t, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            maxima[t] = std::max(maxima[t], ranges[i][0]);
+        }
+    });
+    const auto maxID = *std::max_element(maxima.begin(), maxima.end());
+
+    FlatRawIndex buffer(size);
+    auto* input = &ranges;
+    auto* output = &buffer;
+    std::vector<Histogram> histograms(threads);
+
+    for (unsigned shift = 0; shift < 64 && (maxID >> shift) > 0; shift += RADIX_BITS) {
+        forEachBlock(size, threads, [&](unsigned t, size_t begin, size_t end) {
+            auto& histogram = histograms[t];
+            histogram.fill(0);
+            for (size_t i = begin; i < end; ++i) {
+                ++histogram[((*input)[i][0] >> shift) & RADIX_MASK];
+            }
+        });
+
+        // Turn the counts into output positions, ordered by digit and then
+        // by thread to keep the sort stable
+        uint64_t position = 0;
+        bool trivial = false;
+        for (size_t digit = 0; digit < RADIX_BUCKETS; ++digit) {
+            const uint64_t start = position;
+            for (auto& histogram: histograms) {
+                const auto count = histogram[digit];
+                histogram[digit] = position;
+                position += count;
+            }
+            trivial = trivial || position - start == size;
+        }
+        if (trivial) {
+            continue;
+        }
+
+        forEachBlock(size, threads, [&](unsigned t, size_t begin, size_t end) {
+            auto& positions = histograms[t];
+            for (size_t i = begin; i < end; ++i) {
+                const auto& range = (*input)[i];
+                (*output)[positions[(range[0] >> shift) & RADIX_MASK]++] = range;
+            }
+        });
+        std::swap(input, output);
+    }
+
+    if (input != &ranges) {
+        ranges.swap(buffer);
+    }
+}
+
+}  // namespace indexing
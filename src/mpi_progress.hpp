@@ -0,0 +1,192 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#ifndef INCLUDE_MPI_PROGRESS_HPP_
+#define INCLUDE_MPI_PROGRESS_HPP_
+
+#include <unistd.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+#include <mpi.h>
+
+#include "progress.hpp"
+
+
+namespace utils {
+
+/**
+ * @brief The MPIProgress class: Reports the progress of all ranks together.
+ *
+ * Every rank adds the records and bytes it processed, and at most once per
+ * interval accumulates them into a window on rank 0 with one-sided
+ * MPI_Accumulate, so that ranks never wait for each other.  Rank 0 reads the
+ * window whenever it adds progress itself, and shows the global records/s,
+ * bytes/s and remaining time: as a progressbar if stderr is a TTY, otherwise
+ * as one line of `key=value` pairs per interval on stdout, for batch logs.
+ *
+ * Construction and finish() are collective.  Not thread-safe.
+ */
+class MPIProgress {
+ public:
+    using clock = std::chrono::steady_clock;
+
+    /**
+     * @brief MPIProgress
+     * @param comm The ranks to aggregate
+     * @param total The number of records processed by all ranks together
+     * @param interval Seconds between updates of the window and the output
+     */
+    MPIProgress(MPI_Comm comm, uint64_t total, double interval = 1.0)
+        : comm_(comm)
+        , total_(total)
+        , interval_(std::chrono::duration_cast<clock::duration>(
+              std::chrono::duration<double>(interval)))
+        , start_(clock::now())
+        , last_flush_(start_)
+        , last_show_(start_)
+    {
+        MPI_Comm_rank(comm_, &rank_);
+        MPI_Comm_size(comm_, &size_);
+        const MPI_Aint window_size = rank_ == 0 ? sizeof(Counts) : 0;
+        MPI_Win_allocate(window_size, sizeof(uint64_t), MPI_INFO_NULL, comm_, &counts_, &window_);
+        if (rank_ == 0) {
+            MPI_Win_lock(MPI_LOCK_EXCLUSIVE, 0, 0, window_);
+            std::fill(counts_->begin(), counts_->end(), 0);
+            MPI_Win_unlock(0, window_);
+            if (isatty(STDERR_FILENO)) {
+                bar_.reset(new ProgressMonitor(total_, true, size_));
+            }
+        }
+        // Nobody may accumulate before the window is cleared
+        MPI_Barrier(comm_);
+    }
+
+    MPIProgress(const MPIProgress&) = delete;
+    MPIProgress& operator=(const MPIProgress&) = delete;
+
+    ~MPIProgress() {
+        if (window_ != MPI_WIN_NULL) {
+            finish();
+        }
+    }
+
+    /**
+     * @brief Adds the records and bytes processed by this rank.
+     */
+    void add(uint64_t records, uint64_t bytes = 0) {
+        pending_[RECORDS] += records;
+        pending_[BYTES] += bytes;
+        const auto now = clock::now();
+        if (now - last_flush_ >= interval_) {
+            flush();
+            last_flush_ = now;
+        }
+        if (rank_ == 0 && now - last_show_ >= interval_) {
+            show(read(), now);
+            last_show_ = now;
+        }
+    }
+
+    /**
+     * @brief Adds the remaining progress of this rank, waiting on rank 0 until
+     *  all ranks are done to report the final rates. Collective.
+     */
+    void finish() {
+        pending_[DONE] += 1;
+        flush();
+        if (rank_ == 0) {
+            Counts counts;
+            while ((counts = read())[DONE] < uint64_t(size_)) {
+                const auto now = clock::now();
+                if (now - last_show_ >= interval_) {
+                    show(counts, now);
+                    last_show_ = now;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            }
+            show(counts, clock::now());
+            bar_.reset();
+        }
+        MPI_Win_free(&window_);
+    }
+
+ private:
+    enum { RECORDS, BYTES, DONE, FIELDS };
+    using Counts = std::array<uint64_t, FIELDS>;
+
+    void flush() {
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, window_);
+        MPI_Accumulate(pending_.data(), FIELDS, MPI_UINT64_T,
+                       0, 0, FIELDS, MPI_UINT64_T, MPI_SUM, window_);
+        MPI_Win_unlock(0, window_);
+        pending_.fill(0);
+    }
+
+    Counts read() {
+        // Atomic with respect to the accumulations of other ranks
+        Counts result;
+        MPI_Win_lock(MPI_LOCK_SHARED, 0, 0, window_);
+        MPI_Get_accumulate(nullptr, 0, MPI_UINT64_T,
+                           result.data(), FIELDS, MPI_UINT64_T,
+                           0, 0, FIELDS, MPI_UINT64_T, MPI_NO_OP, window_);
+        MPI_Win_unlock(0, window_);
+        return result;
+    }
+
+    void show(const Counts& counts, clock::time_point now) {
+        const double elapsed = std::chrono::duration<double>(now - start_).count();
+        const double records_rate = elapsed > 0 ? counts[RECORDS] / elapsed : 0;
+        const double bytes_rate = elapsed > 0 ? counts[BYTES] / elapsed : 0;
+        const uint64_t remaining = total_ > counts[RECORDS] ? total_ - counts[RECORDS] : 0;
+        const double eta = records_rate > 0 ? remaining / records_rate : -1;
+
+        if (bar_) {
+            char info[80];
+            if (eta < 0) {
+                snprintf(info, sizeof(info), "%.3g rec/s %.1f MB/s ETA -",
+                         records_rate, bytes_rate / (1024 * 1024));
+            } else {
+                snprintf(info, sizeof(info), "%.3g rec/s %.1f MB/s ETA %.0fs",
+                         records_rate, bytes_rate / (1024 * 1024), eta);
+            }
+            bar_->set_info(info);
+            *bar_ += counts[RECORDS] - shown_;
+            shown_ = counts[RECORDS];
+            return;
+        }
+        printf("[progress] elapsed=%.1f records=%" PRIu64 " total=%" PRIu64 " ranks_done=%" PRIu64 "/%d "
+               "records_per_s=%.1f bytes_per_s=%.1f eta_s=%.1f\n",
+               elapsed, counts[RECORDS], total_, counts[DONE], size_,
+               records_rate, bytes_rate, eta);
+        std::fflush(stdout);
+    }
+
+    MPI_Comm comm_;
+    int rank_;
+    int size_;
+    const uint64_t total_;
+    const clock::duration interval_;
+    const clock::time_point start_;
+    clock::time_point last_flush_;
+    clock::time_point last_show_;
+
+    MPI_Win window_ = MPI_WIN_NULL;
+    Counts* counts_ = nullptr;
+    Counts pending_{};
+    uint64_t shown_ = 0;
+    std::unique_ptr<ProgressMonitor> bar_;
+};
+
+
+}  // namespace utils
+
+#endif  // INCLUDE_MPI_PROGRESS_HPP_
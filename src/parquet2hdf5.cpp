@@ -5,10 +5,16 @@
  * @author Fernando Pereira <fernando.pereira@epfl.ch>
  *
  */
+#include <algorithm>
+#include <array>
+#include <memory>
 #include <stdexcept>
 #include <filesystem>
 #include <iomanip>
 #include <iostream>
+#include <numeric>
+#include <set>
+#include <sstream>
 #include <vector>
 #include <unordered_map>
 #include <mpi.h>
@@ -16,13 +22,16 @@
 #include "CLI/CLI.hpp"
 
 #include "circuit.h"
-#include "progress.hpp"
+#include "mpi_progress.hpp"
+#include "stats.hpp"
 #include "version.h"
 
 using namespace neuron_parquet::circuit;
 
 using neuron_parquet::Converter;
-using utils::ProgressMonitor;
+using utils::MPIProgress;
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
 
 namespace fs = std::filesystem;
 
@@ -31,143 +40,345 @@ int mpi_size, mpi_rank;
 MPI_Comm comm = MPI_COMM_WORLD;
 MPI_Info info = MPI_INFO_NULL;
 
+/// Returns the sorted union of the \a values from all ranks
+std::vector<std::string> gather_strings(const std::vector<std::string>& values, MPI_Comm comm) {
+    int mpi_size;
+    MPI_Comm_size(comm, &mpi_size);
+    ScopedTimer timer(Stage::MPI);
+
+    // Send the values as a single buffer of null terminated strings
+    std::string local;
+    for (const auto& v: values) {
+        local.append(v);
+        local.push_back('\0');
+    }
+    int local_size = local.size();
+    std::vector<int> sizes(mpi_size);
+    MPI_Allgather(&local_size, 1, MPI_INT, sizes.data(), 1, MPI_INT, comm);
+    std::vector<int> displacements(mpi_size, 0);
+    std::partial_sum(sizes.begin(), sizes.end() - 1, displacements.begin() + 1);
+    std::string global(displacements.back() + sizes.back(), '\0');
+    MPI_Allgatherv(local.data(), local_size, MPI_CHAR,
+                   global.data(), sizes.data(), displacements.data(), MPI_CHAR, comm);
+
+    std::set<std::string> result;
+    for (size_t start = 0; start < global.size();) {
+        const auto end = global.find('\0', start);
+        result.insert(global.substr(start, end - start));
+        start = end + 1;
+    }
+    return {result.begin(), result.end()};
+}
+
+
 ///
-/// \brief convert_circuit_mpi: Converts parquet files to SYN2 using mpi
+/// \brief count_records: Reads the record counts of the files of all populations
 ///
+/// Every rank reads the footers of a share of all files.  With a \a filter,
+/// the filtered columns of the row groups that may match are read, too.
 ///
-void convert_circuit_mpi(const std::vector<std::string>& filenames,
-                         const std::string& metadata_path,
-                         const std::string& sonata_path,
-                         const std::string& population,
-                         const bool create_index) {
-
-    // Each reader and each writer in a separate MPI process
-    int total_files = filenames.size();
-    int my_n_files = total_files / mpi_size;
-    int remaining = total_files % mpi_size;
-    if( mpi_rank < remaining ) {
-        my_n_files++;
+void count_records(std::vector<Population>& populations, std::shared_ptr<const RowFilter> filter) {
+    size_t total_files = 0;
+    for (const auto& p: populations) {
+        total_files += p.filenames.size();
+    }
+    std::vector<uint64_t> counts(total_files, 0);
+    size_t index = 0;
+    for (const auto& p: populations) {
+        for (const auto& name: p.filenames) {
+            if (index++ % static_cast<size_t>(mpi_size) == static_cast<size_t>(mpi_rank)) {
+                CircuitReaderParquet reader(name);
+                reader.set_filter(filter);
+                counts[index - 1] = reader.matching_count();
+            }
+        }
+    }
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Allreduce(MPI_IN_PLACE, counts.data(), counts.size(), MPI_UINT64_T, MPI_SUM, comm);
     }
+    index = 0;
+    for (auto& p: populations) {
+        p.file_records.assign(counts.begin() + index, counts.begin() + index + p.filenames.size());
+        p.records = std::accumulate(p.file_records.begin(), p.file_records.end(), uint64_t(0));
+        index += p.filenames.size();
+    }
+}
 
-    int my_offset = total_files / mpi_size * mpi_rank;
-    my_offset += (mpi_rank > remaining) ? remaining : mpi_rank;
 
-    std::vector<std::string> input_names(filenames.begin() + my_offset, filenames.begin() + my_offset + my_n_files);
-    if (mpi_rank < filenames.size()) {
-        std::cout << std::setfill('.')
-                  << "Process " << std::setw(4) << mpi_rank
-                  << " is going to read files " << std::setw(8) << my_offset
-                  << " to " << std::setw(8) << my_offset + my_n_files - 1 << std::endl;
-    } else {
-        std::cout << std::setfill('.')
-                  << "Process " << std::setw(4) << mpi_rank
-                  << " is not going to read files." << std::endl;
-    }
+///
+/// \brief The conversion of one population on this rank
+///
+struct PopulationConversion {
+    std::vector<std::string> input_names;
+    uint64_t record_count = 0;
+    uint64_t offset = 0;
+    std::unique_ptr<CircuitMultiReaderParquet> reader;
+    std::unique_ptr<SonataWriter> writer;
+    std::unique_ptr<Converter<CircuitData>> converter;
+};
 
-    if (input_names.empty()) {
-        // We need this to grab the schema of the input files. All ranks
-        // need to have the schema to keep the state of the output HDF5
-        // file in sync, otherwise the execution will hang when closing the
-        // output HDF5 file.
-        input_names.push_back(filenames.back());
-    }
 
-    MPI_Barrier(comm);
+///
+/// \brief convert_circuit_mpi: Converts parquet files to SYN2 using mpi
+///
+/// All populations are set up on all ranks, as creating the datasets of the
+/// output file is collective.  Every rank then only converts the files of
+/// the populations it has been assigned to, and flushes every population
+/// after converting it, which is collective for compressed datasets.
+///
+void convert_circuit_mpi(std::vector<Population>& populations,
+                         const std::string& sonata_path,
+                         const bool create_index,
+                         const bool stream_index,
+                         const bool append,
+                         std::shared_ptr<const RowFilter> filter,
+                         const DatasetLayout& layout) {
+    count_records(populations, filter);
+    schedule(populations, mpi_size);
 
     if (mpi_rank == 0) {
         std::cout << "Writing to " << sonata_path << std::endl;
     }
+    auto file = append ? SonataFile::open(sonata_path, comm, info)
+                       : SonataFile::create(sonata_path, comm, info);
+
+    std::vector<PopulationConversion> conversions(populations.size());
+    uint64_t global_record_sum = 0;
+    for (size_t i = 0; i < populations.size(); ++i) {
+        const auto& population = populations[i];
+        auto& conversion = conversions[i];
+        global_record_sum += population.records;
+
+        // Each reader and each writer in a separate MPI process
+        const int local_rank = mpi_rank - population.first_rank;
+        if (local_rank >= 0 && local_rank < population.ranks) {
+            const int total_files = population.filenames.size();
+            int my_n_files = total_files / population.ranks;
+            const int remaining = total_files % population.ranks;
+            if (local_rank < remaining) {
+                my_n_files++;
+            }
+            int my_offset = total_files / population.ranks * local_rank;
+            my_offset += (local_rank > remaining) ? remaining : local_rank;
+
+            conversion.input_names.assign(population.filenames.begin() + my_offset,
+                                          population.filenames.begin() + my_offset + my_n_files);
+            conversion.record_count = std::accumulate(population.file_records.begin() + my_offset,
+                                                      population.file_records.begin() + my_offset + my_n_files,
+                                                      uint64_t(0));
+            conversion.offset = std::accumulate(population.file_records.begin(),
+                                                population.file_records.begin() + my_offset,
+                                                uint64_t(0));
+            std::cout << std::setfill('.')
+                      << "Process " << std::setw(4) << mpi_rank
+                      << " is going to read files " << std::setw(8) << my_offset
+                      << " to " << std::setw(8) << my_offset + my_n_files - 1
+                      << " of population " << population.name
+                      << ", writing with an offset of " << std::setw(12) << conversion.offset
+                      << std::endl;
+        }
 
-    MPI_Barrier(comm);
-
-    CircuitMultiReaderParquet reader(input_names, metadata_path);
+        const bool converting = !conversion.input_names.empty();
+        if (converting) {
+            conversion.reader = std::make_unique<CircuitMultiReaderParquet>(conversion.input_names,
+                                                                            population.metadata_path);
+        } else {
+            // We need this to grab the schema of the input files. All ranks
+            // need to have the schema to keep the state of the output HDF5
+            // file in sync, otherwise the execution will hang when closing the
+            // output HDF5 file.
+            conversion.reader = std::make_unique<CircuitMultiReaderParquet>(
+                std::vector<std::string>{population.filenames.back()}, population.metadata_path);
+        }
+        conversion.reader->set_filter(filter);
+
+        conversion.writer = std::make_unique<SonataWriter>(
+            file, population.records, conversion.offset, population.name, layout);
+        // Allows collective datasets to be written while converting
+        conversion.writer->set_local_records(conversion.record_count);
+
+        // String columns without enumeration values need them to be shared
+        // across all ranks before the datasets can be set up
+        for (const auto& column: SonataWriter::unenumerated_columns(conversion.reader->schema(),
+                                                                    conversion.reader->metadata())) {
+            std::vector<std::string> values;
+            if (converting) {
+                values = conversion.reader->unique_values(column);
+            }
+            conversion.writer->set_enumeration(column, gather_strings(values, comm));
+        }
 
-    // Count the records and
-    // 1. Sum
-    // 2. Calculate offsets
+        // Only columns with nulls in any file get a fill value
+        std::vector<std::string> null_columns;
+        if (converting) {
+            null_columns = conversion.reader->null_columns();
+        }
+        conversion.writer->set_nullable_columns(gather_strings(null_columns, comm));
 
-    uint64_t record_count = mpi_rank < filenames.size() ? reader.record_count() : 0;
-    uint64_t global_record_sum;
-    MPI_Allreduce(&record_count, &global_record_sum, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+        if (create_index && stream_index) {
+            conversion.writer->collect_index_ranges();
+        }
 
-    uint32_t block_count = mpi_rank < filenames.size() ? reader.block_count() : 0;
-    uint32_t global_block_sum;
-    MPI_Allreduce(&block_count, &global_block_sum, 1, MPI_UINT32_T, MPI_SUM, MPI_COMM_WORLD);
+        conversion.converter = std::make_unique<Converter<CircuitData>>(*conversion.reader,
+                                                                        *conversion.writer);
 
-    uint64_t *offsets=nullptr;
-    if (mpi_rank == 0) {
-        offsets = new uint64_t[mpi_size+1];
-        offsets[0] = 0;
-    }
-    MPI_Gather(&record_count, 1, MPI_UINT64_T, offsets+1, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
-    if (mpi_rank == 0) {
-        for(int i=1; i<mpi_size; i++) {
-            offsets[i] += offsets[i-1];
+        if (mpi_rank == 0 && !conversion.writer->kept_datasets().empty()) {
+            std::cout << "Keeping the existing dataset(s)";
+            for (const auto& name: conversion.writer->kept_datasets()) {
+                std::cout << " " << name;
+            }
+            std::cout << " of population " << population.name << std::endl;
         }
     }
 
-    uint64_t offset;
-    MPI_Scatter(offsets, 1, MPI_UINT64_T, &offset, 1, MPI_UINT64_T, 0, MPI_COMM_WORLD);
-
-    if (mpi_rank < filenames.size()) {
-        std::cout << std::setfill('.')
-                  << "Process " << std::setw(4) << mpi_rank
-                  << " is going to write " << std::setw(12) << reader.block_count()
-                  << " block(s) with an offset of " << std::setw(12) << offset
-                  << std::endl;
-    } else {
-        std::cout << std::setfill('.')
-                  << "Process " << std::setw(4) << mpi_rank
-                  << " is not going to write anything."
-                  << std::endl;
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Barrier(comm);
     }
 
-    SonataWriter writer(sonata_path, global_record_sum, {comm, info}, offset, population);
+    const double conversion_start = MPI_Wtime();
 
-    //Create converter and progress monitor
+    // Progress monitor over all populations
+    WriteCounters counters;
     {
-        Converter<CircuitData> converter(reader, writer);
-        ProgressMonitor p(global_block_sum, mpi_rank==0);
-        // Use progress of first process to estimate global progress
-        if (mpi_rank == 0) {
-            p.set_parallelism(mpi_size);
-            converter.setProgressHandler(p, mpi_size);
-        }
-        if (mpi_rank < filenames.size()) {
+        MPIProgress progress(comm, global_record_sum);
+        for (auto& conversion: conversions) {
             // See above: avoid converting data if we just opened the last
             // file to access the schema.
-            converter.exportAll();
+            if (!conversion.input_names.empty()) {
+                // Rows of the input, uncompressed, including those filtered out
+                const auto input_records = conversion.reader->record_count();
+                const double record_size = input_records > 0
+                    ? double(conversion.reader->byte_count()) / input_records
+                    : 0;
+                conversion.converter->setRecordHandler([&progress, record_size](uint32_t n) {
+                    progress.add(n, n * record_size);
+                });
+                conversion.converter->exportAll();
+            }
+            // Collective when using parallel compression, every rank takes
+            // part in the writes of each population in turn.  Flushing
+            // right away keeps only one population staged in memory
+            conversion.converter.reset();
+            conversion.reader.reset();
+            conversion.writer->flush();
+            counters += conversion.writer->write_counters();
         }
+        progress.finish();
     }
 
-    MPI_Barrier(comm);
+    {
+        std::array<uint64_t, 3> local{counters.requests, counters.writes, counters.bytes};
+        std::array<uint64_t, 3> global;
+        MPI_Reduce(local.data(), global.data(), local.size(), MPI_UINT64_T, MPI_SUM, 0, comm);
+        if (mpi_rank == 0) {
+            std::cout << std::endl
+                      << "Issued " << global[1] << " writes of "
+                      << global[2] / (1024 * 1024) << " MB in total for "
+                      << global[0] << " write requests" << std::endl;
+        }
+    }
+
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Barrier(comm);
+    }
 
     if(mpi_rank == 0) {
         std::cout << std::endl
-                  << "Data conversion complete. " << std::endl;
+                  << "Data conversion complete in "
+                  << MPI_Wtime() - conversion_start << " seconds." << std::endl;
     }
 
-    MPI_Barrier(comm);
-
     if (create_index) {
-        if(mpi_rank == 0) {
-            std::cout << "Creating indices..." << std::endl;
-        }
-        try {
-            writer.write_indices(true);
-        } catch (const std::exception& e) {
-            std::cerr << "ERROR on rank " << mpi_rank << ": Failed to write indices: " << e.what() << std::endl;
-            throw e;
+        // Indexing is collective, every population uses all ranks in turn.
+        // Existing populations keep their node IDs, and thus their indices
+        for (size_t i = 0; i < populations.size(); ++i) {
+            if (!conversions[i].writer->needs_indices()) {
+                continue;
+            }
+            if(mpi_rank == 0) {
+                std::cout << "Creating indices of population " << populations[i].name << "..." << std::endl;
+            }
+            const double index_start = MPI_Wtime();
+            try {
+                conversions[i].writer->write_indices(true);
+            } catch (const std::exception& e) {
+                std::cerr << "ERROR on rank " << mpi_rank << ": Failed to write indices: " << e.what() << std::endl;
+                throw e;
+            }
+            {
+                ScopedTimer timer(Stage::MPI);
+                MPI_Barrier(comm);
+            }
+            if(mpi_rank == 0) {
+                std::cout << "Indices created in " << MPI_Wtime() - index_start << " seconds." << std::endl;
+            }
         }
-        MPI_Barrier(comm);
     }
 
+    // Close the populations before the file
+    conversions.clear();
+
     if(mpi_rank == 0) {
         std::cout << "Finished writing " << sonata_path << std::endl;
     }
 }
 
 
+///
+/// \brief list_population: Lists the Parquet files of the population \a name in \a directory
+///
+Population list_population(const std::string& directory, const std::string& name) {
+    Population population;
+    population.name = name;
+
+    fs::path p(directory);
+
+    auto meta = p / "_metadata";
+    if (fs::is_regular_file(meta)) {
+        population.metadata_path = meta.string();
+    } else if (mpi_rank == 0) {
+        std::cerr << "WARNING: Input directory '"
+                  << directory
+                  << "' did not contain a '_metadata' file"
+                  << std::endl;
+    }
+
+    for (const auto& e: fs::directory_iterator(p)) {
+        auto ep = e.path();
+        if (fs::is_regular_file(ep) && ep.extension() == ".parquet") {
+            population.filenames.push_back(ep.string());
+        }
+    }
+    std::sort(population.filenames.begin(), population.filenames.end());
+
+    if (population.filenames.empty()) {
+        throw std::runtime_error("Input directory '" + directory + "' did not contain any Parquet files");
+    }
+    return population;
+}
+
+
+///
+/// \brief parse_filter: Parses a filter given as `ID[:VALUE,VALUE,...]`
+///
+std::pair<H5Z_filter_t, std::vector<unsigned int>> parse_filter(const std::string& spec) {
+    const auto colon = spec.find(':');
+    const H5Z_filter_t id = std::stoi(spec.substr(0, colon));
+    std::vector<unsigned int> values;
+    if (colon != std::string::npos) {
+        std::stringstream ss(spec.substr(colon + 1));
+        std::string value;
+        while (std::getline(ss, value, ',')) {
+            values.push_back(std::stoul(value));
+        }
+    }
+    return {id, values};
+}
+
+
 int main(int argc, char* argv[]) {
     // Initialize MPI
     MPI_Init(&argc, &argv);
@@ -177,13 +388,59 @@ int main(int argc, char* argv[]) {
     std::string output_filename;
     std::string output_population;
     std::string input_directory;
+    std::vector<std::pair<std::string, std::string>> more_populations;
     bool create_index = true;
+    bool stream_index = false;
+    bool append = false;
+    DatasetLayout layout;
+    std::vector<std::string> filters;
+    std::vector<std::string> selections;
+    std::string stats_json;
+    std::string trace_json;
 
     // Every node makes his job in reading the args and
     // compute the sub array of files to process
     CLI::App app{"Convert Parquet synapse files into the SONATA format"};
     app.set_version_flag("-v,--version", neuron_parquet::VERSION);
     app.add_flag("--index,!--no-index", create_index, "Create a SONATA index");
+    app.add_option("--select", selections,
+                   "Only convert edges with values of an integer column as COLUMN=FIRST-LAST, "
+                   "COLUMN=VALUE,VALUE,... or COLUMN=@FILE, all selections have to match");
+    app.add_flag("--append", append,
+                 "Add the populations to an existing output file, or datasets to its populations");
+    app.add_flag("--stream-index", stream_index,
+                 "Collect the index ranges during the conversion instead of reading the node ids back");
+    app.add_option("--chunk-size", layout.chunk_size,
+                   "Rows per chunk of the datasets created, contiguous if 0 (default)");
+    app.add_option("--deflate", layout.deflate, "Deflate compression level")
+        ->check(CLI::Range(0, 9));
+    app.add_flag("--shuffle", layout.shuffle, "Shuffle bytes before compressing");
+    app.add_option("--filter", filters,
+                   "Additional HDF5 filter to apply, as ID[:VALUE,VALUE,...]");
+    app.add_option("--index-chunk-size", layout.index.chunkSize,
+                   "Rows per chunk of the index datasets, contiguous if 0 (default)");
+    app.add_option("--index-deflate", layout.index.deflate, "Deflate compression level of the index")
+        ->check(CLI::Range(0, 9));
+    app.add_flag("--index-shuffle", layout.index.shuffle, "Shuffle bytes before compressing the index");
+    app.add_flag("--index-collective", layout.index.collective,
+                 "Write the index with collective I/O");
+    app.add_flag("--index-uint32", layout.index.narrow,
+                 "Store the index as 32 bit integers if all edge ids fit");
+    size_t write_buffer_mb = 4;
+    size_t stripe_size_mb = 1;
+    app.add_option("--write-buffer", write_buffer_mb,
+                   "MB to buffer per dataset before writing, 0 to disable")
+        ->capture_default_str();
+    app.add_option("--stripe-size", stripe_size_mb,
+                   "File system stripe size in MB to align buffered writes to")
+        ->capture_default_str();
+    app.add_option("--population", more_populations,
+                   "Also convert the Parquet files of a directory into a population, as DIRECTORY POPULATION")
+        ->allow_extra_args(false);
+    app.add_option("--stats-json", stats_json,
+                   "Time the conversion stages and write a summary over all ranks to this file");
+    app.add_option("--trace-json", trace_json,
+                   "Record a timeline of the conversion stages of all ranks to this Chrome trace file");
     app.add_option("input_directory", input_directory, "Directory containing Parquet files to convert")
         ->check(CLI::ExistingDirectory)
         ->required();
@@ -194,46 +451,63 @@ int main(int argc, char* argv[]) {
 
     try {
         app.parse(argc, argv);
+        for (const auto& f: filters) {
+            layout.filters.push_back(parse_filter(f));
+        }
+        layout.write_buffer_size = write_buffer_mb * 1024 * 1024;
+        layout.stripe_size = stripe_size_mb * 1024 * 1024;
     } catch(const CLI::ParseError& e) {
         if (mpi_rank == 0) {
             app.exit(e);
         }
         MPI_Finalize();
         return 1;
+    } catch(const std::logic_error& e) {
+        if (mpi_rank == 0) {
+            std::cerr << "Invalid filter specification: " << e.what() << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
     }
 
-    std::string metadata_file = "";
-    std::vector<std::string> input_files;
-    {
-        fs::path p(input_directory);
-
-        auto meta = p / "_metadata";
-        if (fs::is_regular_file(meta)) {
-            metadata_file = meta.string();
-        } else if (mpi_rank == 0) {
-            std::cerr << "WARNING: Input directory '"
-                      << input_directory
-                      << "' did not contain a '_metadata' file"
-                      << std::endl;
+    std::shared_ptr<const RowFilter> filter;
+    if (!selections.empty()) {
+        std::vector<RowFilter::Condition> conditions;
+        try {
+            for (const auto& s: selections) {
+                conditions.push_back(RowFilter::parse(s));
+            }
+        } catch (const std::exception& e) {
+            if (mpi_rank == 0) {
+                std::cerr << "Invalid selection: " << e.what() << std::endl;
+            }
+            MPI_Finalize();
+            return 1;
         }
+        filter = std::make_shared<RowFilter>(std::move(conditions));
+    }
 
-        for (const auto& e: fs::directory_iterator(p)) {
-            auto ep = e.path();
-            if (fs::is_regular_file(ep) && ep.extension() == ".parquet") {
-                input_files.push_back(ep.string());
+    std::vector<Population> populations;
+    try {
+        populations.push_back(list_population(input_directory, output_population));
+        for (const auto& [directory, name]: more_populations) {
+            if (!fs::is_directory(directory)) {
+                throw std::runtime_error("Input directory '" + directory + "' does not exist");
             }
+            for (const auto& p: populations) {
+                if (p.name == name) {
+                    throw std::runtime_error("Population '" + name + "' given more than once");
+                }
+            }
+            populations.push_back(list_population(directory, name));
         }
-
-        if (input_files.empty()) {
-            std::cerr << "Imput directory '"
-                      << input_directory
-                      << "' did not contain any Parquet files"
-                      << std::endl;
-            MPI_Finalize();
-            return 1;
+    } catch (const std::exception& e) {
+        if (mpi_rank == 0) {
+            std::cerr << e.what() << std::endl;
         }
+        MPI_Finalize();
+        return 1;
     }
-    std::sort(input_files.begin(), input_files.end());
 
     if (mpi_rank == 0) {
         auto parent = fs::path(output_filename).parent_path();
@@ -243,7 +517,17 @@ int main(int argc, char* argv[]) {
     }
     MPI_Barrier(comm);
 
-    convert_circuit_mpi(input_files, metadata_file, output_filename, output_population, create_index);
+    if (!stats_json.empty()) {
+        utils::stats::enable();
+    }
+    if (!trace_json.empty()) {
+        utils::trace::enable(comm);
+    }
+
+    convert_circuit_mpi(populations, output_filename, create_index, stream_index, append, filter, layout);
+
+    utils::stats::report(comm, stats_json, "parquet2hdf5");
+    utils::trace::write(comm, trace_json);
 
     MPI_Finalize();
 
@@ -0,0 +1,238 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+#include "CLI/CLI.hpp"
+
+#include "circuit.h"
+#include "mpi_progress.hpp"
+#include "stats.hpp"
+#include "version.h"
+
+using namespace neuron_parquet::circuit;
+
+using neuron_parquet::Converter;
+using utils::MPIProgress;
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
+
+namespace fs = std::filesystem;
+
+
+int mpi_size, mpi_rank;
+MPI_Comm comm = MPI_COMM_WORLD;
+
+
+///
+/// \brief split_inputs: Splits the files into at most \a n contiguous groups of similar size
+///
+std::vector<std::vector<std::string>> split_inputs(const std::vector<std::string>& filenames, size_t n) {
+    n = std::min(n, filenames.size());
+    std::vector<uint64_t> sizes;
+    uint64_t total = 0;
+    for (const auto& name: filenames) {
+        sizes.push_back(fs::file_size(name));
+        total += sizes.back();
+    }
+
+    std::vector<std::vector<std::string>> groups(n);
+    uint64_t accumulated = 0;
+    size_t group = 0;
+    for (size_t i = 0; i < filenames.size(); ++i) {
+        // Start the next group once the middle of this file lies beyond the
+        // share of the current one, leaving at least one file for every
+        // remaining group
+        const bool full = 2 * accumulated + sizes[i] > 2 * (total / n) * (group + 1);
+        if (!groups[group].empty() && group + 1 < n &&
+            (full || filenames.size() - i <= n - group - 1)) {
+            ++group;
+        }
+        groups[group].push_back(filenames[i]);
+        accumulated += sizes[i];
+    }
+    return groups;
+}
+
+
+///
+/// \brief compact: Rewrites the groups of input files assigned to this rank
+///
+void compact(const std::vector<std::vector<std::string>>& groups,
+             const std::string& metadata_path,
+             const fs::path& output_directory,
+             const CircuitWriterParquet::Options& options) {
+    // Round robin, as the groups are of similar size
+    std::vector<size_t> mine;
+    uint64_t records = 0;
+    uint64_t bytes = 0;
+    for (size_t i = mpi_rank; i < groups.size(); i += mpi_size) {
+        // Only reads the footers, the files are opened again one group at a time
+        const CircuitMultiReaderParquet reader(groups[i], metadata_path);
+        records += reader.record_count();
+        bytes += reader.byte_count();
+        mine.push_back(i);
+    }
+
+    uint64_t global_records;
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Allreduce(&records, &global_records, 1, MPI_UINT64_T, MPI_SUM, comm);
+    }
+
+    MPIProgress progress(comm, global_records);
+    const double record_size = records > 0 ? double(bytes) / records : 0;
+    for (const auto i: mine) {
+        char name[32];
+        snprintf(name, sizeof(name), "part-%05zu.parquet", i);
+        CircuitMultiReaderParquet reader(groups[i], metadata_path);
+        CircuitWriterParquet writer(output_directory / name, options);
+        {
+            Converter<CircuitData> converter(reader, writer);
+            converter.setRecordHandler([&progress, record_size](uint32_t n) {
+                progress.add(n, n * record_size);
+            });
+            converter.exportAll();
+        }
+        writer.close();
+    }
+    progress.finish();
+}
+
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(comm, &mpi_size);
+    MPI_Comm_rank(comm, &mpi_rank);
+
+    static const std::map<std::string, std::vector<std::string>> sort_orders{
+        {"none", {}},
+        {"target", {"target_node_id", "source_node_id"}},
+        {"source", {"source_node_id", "target_node_id"}}};
+
+    std::string input_directory;
+    std::string output_directory;
+    size_t output_files = mpi_size;
+    std::string sort_by = "none";
+    std::string stats_json;
+    std::string trace_json;
+    CircuitWriterParquet::Options options;
+
+    CLI::App app{"Rewrite Parquet edge files into fewer, larger and optionally sorted files"};
+    app.set_version_flag("-v,--version", neuron_parquet::VERSION);
+    app.add_option("-n,--files", output_files, "Number of files to write, one per rank by default")
+        ->check(CLI::PositiveNumber);
+    options.add_options(app);
+    app.add_option("--sort", sort_by,
+                   "Sort the edges of every output file by target or source node id")
+        ->check(CLI::IsMember(sort_orders))
+        ->capture_default_str();
+    app.add_option("--stats-json", stats_json,
+                   "Time the compaction stages and write a summary over all ranks to this file");
+    app.add_option("--trace-json", trace_json,
+                   "Record a timeline of the compaction stages of all ranks to this Chrome trace file");
+    app.add_option("input_directory", input_directory, "Directory containing Parquet files to compact")
+        ->check(CLI::ExistingDirectory)
+        ->required();
+    app.add_option("output_directory", output_directory, "Directory to write the compacted files to")
+        ->required();
+
+    try {
+        app.parse(argc, argv);
+    } catch(const CLI::ParseError& e) {
+        if (mpi_rank == 0) {
+            app.exit(e);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    options.sort_by = sort_orders.at(sort_by);
+
+    std::string metadata_file = "";
+    std::vector<std::string> input_files;
+    {
+        fs::path p(input_directory);
+
+        // Only read for the schema and the key-value metadata, it describes
+        // the row groups of the inputs and is not written to the output
+        auto meta = p / "_metadata";
+        if (fs::is_regular_file(meta)) {
+            metadata_file = meta.string();
+        }
+
+        for (const auto& e: fs::directory_iterator(p)) {
+            auto ep = e.path();
+            if (fs::is_regular_file(ep) && ep.extension() == ".parquet") {
+                input_files.push_back(ep.string());
+            }
+        }
+
+        if (input_files.empty()) {
+            std::cerr << "Input directory '"
+                      << input_directory
+                      << "' did not contain any Parquet files"
+                      << std::endl;
+            MPI_Finalize();
+            return 1;
+        }
+    }
+    std::sort(input_files.begin(), input_files.end());
+
+    if (fs::exists(output_directory) &&
+        fs::equivalent(fs::path(output_directory), fs::path(input_directory))) {
+        if (mpi_rank == 0) {
+            std::cerr << "The output directory has to differ from the input directory" << std::endl;
+        }
+        MPI_Finalize();
+        return 1;
+    }
+    if (mpi_rank == 0) {
+        fs::create_directories(output_directory);
+    }
+    MPI_Barrier(comm);
+
+    if (!stats_json.empty()) {
+        utils::stats::enable();
+    }
+    if (!trace_json.empty()) {
+        utils::trace::enable(comm);
+    }
+
+    const auto groups = split_inputs(input_files, output_files);
+    if (mpi_rank == 0) {
+        std::cout << "Compacting " << input_files.size() << " file(s) into "
+                  << groups.size() << " file(s)" << std::endl;
+    }
+
+    const double start = MPI_Wtime();
+    try {
+        compact(groups, metadata_file, output_directory, options);
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR on rank " << mpi_rank << ": " << e.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Barrier(comm);
+    }
+    if (mpi_rank == 0) {
+        std::cout << "Compaction complete in " << MPI_Wtime() - start << " seconds." << std::endl;
+    }
+
+    utils::stats::report(comm, stats_json, "parquet-compact");
+    utils::trace::write(comm, trace_json);
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -19,6 +19,7 @@
 #include <cstring>
 #include <mutex>
 #include <stdexcept>
+#include <string>
 
 
 namespace utils {
@@ -86,6 +87,15 @@ class ProgressMonitor {
         n_tasks_ = n_tasks;
     }
 
+    /**
+     * @brief set_info: Shows a short text after the progressbar, e.g. rates.
+     *  Displayed with the next redraw.
+     */
+    void set_info(const std::string& info) {
+        std::lock_guard<std::mutex> lg(output_mtx_);
+        info_ = info;
+    }
+
     /**
      * @brief Prints some message above the progressbar, thread-safe
      */
@@ -106,7 +116,7 @@ class ProgressMonitor {
             return;
         }
         auto end = std::chrono::steady_clock::now();
-        if ((end - last_update_).count() < 1) {
+        if (end - last_update_ < std::chrono::seconds(1)) {
             return;  // draw at most once per sec
         }
         last_update_ = std::move(end);
@@ -150,20 +160,21 @@ class ProgressMonitor {
         const float progress = (total_ == 0)? 1. : float(done) / total_;
         const unsigned cols = window_cols() - 1;
 
-        char tasks_str[30];
-        snprintf(tasks_str, 30, "(%ld + %d / %ld)", done, n_tasks, total_);
+        char tasks_str[64];
+        snprintf(tasks_str, sizeof(tasks_str), "(%ld + %d / %ld)", done, n_tasks, total_);
 
-        int progress_len = cols - (11 + strlen(tasks_str));
+        int progress_len = cols - (11 + strlen(tasks_str) + info_.size());
         if (progress_len > MAX_BAR_LEN) {
             progress_len = MAX_BAR_LEN;
         }
+        progress_len = std::max(0, progress_len);
 
         const auto bar_len = int(std::round(std::min(1.f, progress) * progress_len));
         int rpad = std::max(0, progress_len - bar_len);
-        last_msg_len_ = progress_len + 11 + strlen(tasks_str);
+        last_msg_len_ = progress_len + 11 + strlen(tasks_str) + info_.size();
 
-        fprintf(stderr, "\r[%5.1f%%|%.*s>%*s] %s ",
-                std::min(progress*100.f, 100.f), bar_len, PB_STR, rpad, "", tasks_str);
+        fprintf(stderr, "\r[%5.1f%%|%.*s>%*s] %s %s",
+                std::min(progress*100.f, 100.f), bar_len, PB_STR, rpad, "", tasks_str, info_.c_str());
     }
 
     const size_t total_;
@@ -174,7 +185,8 @@ class ProgressMonitor {
     // output related
     std::mutex output_mtx_;
     std::chrono::time_point<std::chrono::steady_clock> last_update_;
-    unsigned last_msg_len_;
+    unsigned last_msg_len_ = 0;
+    std::string info_;
 };
 
 
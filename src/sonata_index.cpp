@@ -0,0 +1,149 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+#include <highfive/H5File.hpp>
+
+#include "CLI/CLI.hpp"
+
+#include "index/index.h"
+#include "stats.hpp"
+#include "version.h"
+
+
+int mpi_size, mpi_rank;
+MPI_Comm comm = MPI_COMM_WORLD;
+MPI_Info info = MPI_INFO_NULL;
+
+
+///
+/// \brief index_population: (Re)builds the index of a single edge population
+///
+void index_population(HighFive::File& file,
+                      const std::string& population,
+                      uint64_t source_nodes,
+                      uint64_t target_nodes,
+                      uint64_t memory,
+                      const std::string& spill_directory,
+                      const indexing::IndexLayout& layout,
+                      bool overwrite) {
+    auto group = file.getGroup("edges/" + population);
+    if (group.exist("indices")) {
+        if (!overwrite) {
+            throw std::runtime_error("population " + population + " already has indices");
+        }
+        group.unlink("indices");
+    }
+
+    if (mpi_rank == 0) {
+        std::cout << "Indexing population " << population << std::endl;
+    }
+    const double start = MPI_Wtime();
+    indexing::writeBounded(group, source_nodes, target_nodes, memory, spill_directory, layout);
+    MPI_Barrier(comm);
+    if (mpi_rank == 0) {
+        std::cout << "Indexed population " << population << " in "
+                  << MPI_Wtime() - start << " seconds." << std::endl;
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(comm, &mpi_size);
+    MPI_Comm_rank(comm, &mpi_rank);
+
+    std::string filename;
+    std::vector<std::string> populations;
+    uint64_t source_nodes = 0;
+    uint64_t target_nodes = 0;
+    uint64_t memory_mb = 1024;
+    bool overwrite = false;
+    std::string stats_json;
+    std::string trace_json;
+    indexing::IndexLayout layout;
+    std::string spill_directory = std::getenv("TMPDIR") ? std::getenv("TMPDIR") : "/tmp";
+
+    CLI::App app{"Create the indices of SONATA edge files with a bounded amount of memory"};
+    app.set_version_flag("-v,--version", neuron_parquet::VERSION);
+    app.add_option("--population", populations,
+                   "Edge populations to index, all if not given");
+    app.add_option("--source-nodes", source_nodes,
+                   "Number of source nodes, derived from the largest node id if 0")
+        ->capture_default_str();
+    app.add_option("--target-nodes", target_nodes,
+                   "Number of target nodes, derived from the largest node id if 0")
+        ->capture_default_str();
+    app.add_option("--memory", memory_mb,
+                   "MB of memory to use per rank for the ranges of the index")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    app.add_option("--spill-directory", spill_directory,
+                   "Local directory to store temporary data in")
+        ->check(CLI::ExistingDirectory)
+        ->capture_default_str();
+    app.add_option("--chunk-size", layout.chunkSize,
+                   "Rows per chunk of the index datasets, contiguous if 0 (default)");
+    app.add_option("--deflate", layout.deflate, "Deflate compression level")
+        ->check(CLI::Range(0, 9));
+    app.add_flag("--shuffle", layout.shuffle, "Shuffle bytes before compressing");
+    app.add_flag("--collective", layout.collective, "Write with collective I/O");
+    app.add_flag("--uint32", layout.narrow, "Store 32 bit integers if all edge ids fit");
+    app.add_flag("--overwrite", overwrite, "Replace existing indices");
+    app.add_option("--stats-json", stats_json,
+                   "Time the indexing stages and write a summary over all ranks to this file");
+    app.add_option("--trace-json", trace_json,
+                   "Record a timeline of the indexing stages of all ranks to this Chrome trace file");
+    app.add_option("filename", filename, "SONATA edge file to index")
+        ->check(CLI::ExistingFile)
+        ->required();
+
+    try {
+        app.parse(argc, argv);
+    } catch(const CLI::ParseError& e) {
+        if (mpi_rank == 0) {
+            app.exit(e);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (!stats_json.empty()) {
+        utils::stats::enable();
+    }
+    if (!trace_json.empty()) {
+        utils::trace::enable(comm);
+    }
+
+    try {
+        // The file has to be closed before MPI is finalized
+        HighFive::FileAccessProps fapl;
+        fapl.add(HighFive::MPIOFileAccess{comm, info});
+        HighFive::File file(filename, HighFive::File::ReadWrite, fapl);
+
+        if (populations.empty()) {
+            populations = file.getGroup("edges").listObjectNames();
+        }
+        for (const auto& population: populations) {
+            index_population(file, population, source_nodes, target_nodes,
+                             memory_mb * 1024 * 1024, spill_directory, layout, overwrite);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR on rank " << mpi_rank << ": " << e.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    utils::stats::report(comm, stats_json, "sonata-index");
+    utils::trace::write(comm, trace_json);
+
+    MPI_Finalize();
+
+    return 0;
+}
@@ -0,0 +1,210 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+#include <mpi.h>
+
+#include <highfive/H5File.hpp>
+
+#include "CLI/CLI.hpp"
+
+#include "index/check.h"
+#include "version.h"
+
+
+int mpi_size, mpi_rank;
+MPI_Comm comm = MPI_COMM_WORLD;
+MPI_Info info = MPI_INFO_NULL;
+
+const std::vector<std::pair<std::string, std::string>> INDICES{
+    {"indices/source_to_target", "source_node_id"},
+    {"indices/target_to_source", "target_node_id"}};
+
+
+///
+/// \brief verify_index: Checks an index against its node IDs, returns the number of errors
+///
+uint64_t verify_index(const HighFive::Group& group,
+                      const std::string& population,
+                      const std::string& index,
+                      const std::string& node_ids) {
+    const double start = MPI_Wtime();
+    const auto result = indexing::verify(group, index, node_ids);
+    const double elapsed = MPI_Wtime() - start;
+
+    for (const auto& message: result.messages) {
+        std::cerr << "ERROR on rank " << mpi_rank << ": " << population << "/" << index
+                  << ": " << message << std::endl;
+    }
+    MPI_Barrier(comm);
+    if (mpi_rank == 0) {
+        std::cout << population << "/" << index << ": " << result.nodes << " nodes, "
+                  << result.ranges << " ranges, " << result.edges << " edges, "
+                  << result.errors << " errors, verified in " << elapsed << " seconds."
+                  << std::endl;
+    }
+    return result.errors;
+}
+
+
+///
+/// \brief benchmark_lookups: Times lookups of node selections on all ranks
+///
+/// Every rank performs \a queries lookups of \a selection nodes, either
+/// random node IDs or a contiguous block of them.  Prints the latency
+/// percentiles over all lookups, and the throughput of all ranks together.
+///
+void benchmark_lookups(const HighFive::Group& group,
+                       const std::string& index,
+                       uint64_t queries,
+                       uint64_t selection,
+                       bool contiguous,
+                       std::mt19937_64& rng) {
+    const auto index_group = group.getGroup(index);
+    const uint64_t node_count = index_group.getDataSet("node_id_to_ranges").getDimensions()[0];
+    if (node_count == 0) {
+        return;
+    }
+    selection = std::min(selection, node_count);
+
+    std::vector<double> latencies;
+    uint64_t edges = 0;
+    std::uniform_int_distribution<uint64_t> nodes(0, node_count - 1);
+    std::uniform_int_distribution<uint64_t> blocks(0, node_count - selection);
+
+    MPI_Barrier(comm);
+    const double start = MPI_Wtime();
+    for (uint64_t q = 0; q < queries; ++q) {
+        indexing::RawIndex ranges;
+        double query_start;
+        if (contiguous) {
+            const auto begin = blocks(rng);
+            query_start = MPI_Wtime();
+            ranges = indexing::lookupRange(index_group, begin, begin + selection);
+        } else {
+            std::vector<indexing::NodeID> ids(selection);
+            std::generate(ids.begin(), ids.end(), [&] { return nodes(rng); });
+            std::sort(ids.begin(), ids.end());
+            ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+            query_start = MPI_Wtime();
+            ranges = indexing::lookup(index_group, ids);
+        }
+        latencies.push_back(MPI_Wtime() - query_start);
+        for (const auto& [begin, end]: ranges) {
+            edges += end - begin;
+        }
+    }
+    const double elapsed = MPI_Wtime() - start;
+
+    std::vector<double> all_latencies(mpi_rank == 0 ? queries * mpi_size : 0);
+    MPI_Gather(latencies.data(), queries, MPI_DOUBLE,
+               all_latencies.data(), queries, MPI_DOUBLE,
+               0, comm);
+    double max_elapsed;
+    MPI_Reduce(&elapsed, &max_elapsed, 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    uint64_t all_edges;
+    MPI_Reduce(&edges, &all_edges, 1, MPI_UINT64_T, MPI_SUM, 0, comm);
+
+    if (mpi_rank == 0) {
+        std::sort(all_latencies.begin(), all_latencies.end());
+        auto percentile = [&all_latencies](double p) {
+            return 1e3 * all_latencies[std::min(all_latencies.size() - 1,
+                                                static_cast<size_t>(p * all_latencies.size()))];
+        };
+        const double mean = std::accumulate(all_latencies.begin(), all_latencies.end(), 0.0) /
+                            all_latencies.size();
+        std::cout << "  " << (contiguous ? "range" : "random") << " lookups of " << selection
+                  << " nodes: mean " << 1e3 * mean << " ms, p50 " << percentile(0.5)
+                  << " ms, p99 " << percentile(0.99) << " ms, max " << percentile(1.0) << " ms, "
+                  << all_latencies.size() / max_elapsed << " lookups/s, "
+                  << all_edges / max_elapsed << " edges/s" << std::endl;
+    }
+}
+
+
+int main(int argc, char* argv[]) {
+    MPI_Init(&argc, &argv);
+    MPI_Comm_size(comm, &mpi_size);
+    MPI_Comm_rank(comm, &mpi_rank);
+
+    std::string filename;
+    std::vector<std::string> populations;
+    uint64_t queries = 1000;
+    std::vector<uint64_t> selections{1, 100, 10000};
+    uint64_t seed = 0;
+    bool skip_verify = false;
+    bool skip_benchmark = false;
+
+    CLI::App app{"Verify the indices of SONATA edge files and benchmark lookups"};
+    app.set_version_flag("-v,--version", neuron_parquet::VERSION);
+    app.add_option("--population", populations,
+                   "Edge populations to check, all if not given");
+    app.add_option("--queries", queries, "Lookups per rank and selection size")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    app.add_option("--selection", selections, "Number of nodes to look up at once")
+        ->check(CLI::PositiveNumber)
+        ->capture_default_str();
+    app.add_option("--seed", seed, "Seed for the random node selections")
+        ->capture_default_str();
+    app.add_flag("--skip-verify", skip_verify, "Only benchmark lookups");
+    app.add_flag("--skip-benchmark", skip_benchmark, "Only verify the indices");
+    app.add_option("filename", filename, "SONATA edge file to check")
+        ->check(CLI::ExistingFile)
+        ->required();
+
+    try {
+        app.parse(argc, argv);
+    } catch(const CLI::ParseError& e) {
+        if (mpi_rank == 0) {
+            app.exit(e);
+        }
+        MPI_Finalize();
+        return 1;
+    }
+
+    uint64_t errors = 0;
+    try {
+        // The file has to be closed before MPI is finalized
+        HighFive::FileAccessProps fapl;
+        fapl.add(HighFive::MPIOFileAccess{comm, info});
+        HighFive::File file(filename, HighFive::File::ReadOnly, fapl);
+
+        if (populations.empty()) {
+            populations = file.getGroup("edges").listObjectNames();
+        }
+        std::mt19937_64 rng(seed + mpi_rank);
+        for (const auto& population: populations) {
+            auto group = file.getGroup("edges/" + population);
+            for (const auto& [index, node_ids]: INDICES) {
+                if (!skip_verify) {
+                    errors += verify_index(group, population, index, node_ids);
+                }
+                if (!skip_benchmark) {
+                    if (mpi_rank == 0) {
+                        std::cout << population << "/" << index << ":" << std::endl;
+                    }
+                    for (const auto selection: selections) {
+                        benchmark_lookups(group, index, queries, selection, false, rng);
+                        benchmark_lookups(group, index, queries, selection, true, rng);
+                    }
+                }
+            }
+        }
+    } catch (const std::exception& e) {
+        std::cerr << "ERROR on rank " << mpi_rank << ": " << e.what() << std::endl;
+        MPI_Abort(comm, 1);
+    }
+
+    MPI_Finalize();
+
+    return errors > 0 ? 1 : 0;
+}
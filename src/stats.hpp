@@ -0,0 +1,270 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#ifndef INCLUDE_STATS_HPP_
+#define INCLUDE_STATS_HPP_
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <mpi.h>
+
+#include "trace.hpp"
+
+
+namespace utils {
+namespace stats {
+
+/**
+ * @brief The stages of a conversion that are timed.
+ *
+ * Stages may nest: \c Write covers the whole writer call, including the
+ * \c Transpose, \c WriteBatch or \c H5Write it triggers.
+ */
+enum class Stage : unsigned {
+    Read,           ///< Reader::fillBuffer
+    Write,          ///< Writer::write
+    Transpose,      ///< Touches transposed into columns
+    WriteBatch,     ///< Parquet row groups encoded and written
+    H5Write,        ///< H5Dwrite of edge datasets
+    MPI,            ///< Barriers and collectives of the converters
+    IndexRead,      ///< Node IDs read back for the index
+    IndexSort,      ///< Node ranges sorted by node ID
+    IndexExchange,  ///< Node ranges exchanged between ranks
+    IndexWrite,     ///< Index grouped and written
+    COUNT
+};
+
+constexpr size_t STAGE_COUNT = static_cast<size_t>(Stage::COUNT);
+
+constexpr std::array<const char*, STAGE_COUNT> STAGE_NAMES{
+    "read", "write", "transpose", "write_batch", "h5_write", "mpi",
+    "index_read", "index_sort", "index_exchange", "index_write"};
+
+namespace detail {
+
+using clock = std::chrono::steady_clock;
+
+struct Counters {
+    std::atomic<uint64_t> nanoseconds{0};
+    std::atomic<uint64_t> calls{0};
+    std::atomic<uint64_t> bytes{0};
+    std::atomic<uint64_t> records{0};
+};
+
+inline std::atomic<bool> enabled{false};
+inline std::array<Counters, STAGE_COUNT> counters;
+inline clock::time_point start;
+
+inline Counters& of(Stage stage) {
+    return counters[static_cast<size_t>(stage)];
+}
+
+}  // namespace detail
+
+
+/**
+ * @brief Whether timers and counters record anything. Off by default.
+ */
+inline bool enabled() {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Starts recording, the wall time reported is measured from here.
+ */
+inline void enable() {
+    detail::start = detail::clock::now();
+    detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Adds bytes and records to a stage without timing it.
+ */
+inline void count(Stage stage, uint64_t bytes, uint64_t records = 0) {
+    if (enabled()) {
+        auto& c = detail::of(stage);
+        c.bytes.fetch_add(bytes, std::memory_order_relaxed);
+        c.records.fetch_add(records, std::memory_order_relaxed);
+    }
+}
+
+
+/**
+ * @brief The ScopedTimer class: Adds the time until destruction to a stage,
+ *  with the bytes and records processed meanwhile. Thread-safe.
+ *
+ * When tracing, the span is also recorded as a trace event of the calling
+ * thread.  When neither is enabled, only checks two flags on construction.
+ */
+class ScopedTimer {
+ public:
+    explicit ScopedTimer(Stage stage, uint64_t bytes = 0, uint64_t records = 0)
+        : stage_(stage)
+        , counting_(enabled())
+        , tracing_(trace::enabled())
+        , bytes_(bytes)
+        , records_(records)
+    {
+        if (counting_ || tracing_) {
+            start_ = detail::clock::now();
+        }
+    }
+
+    ScopedTimer(const ScopedTimer&) = delete;
+    ScopedTimer& operator=(const ScopedTimer&) = delete;
+
+    ~ScopedTimer() {
+        if (!counting_ && !tracing_) {
+            return;
+        }
+        const auto end = detail::clock::now();
+        if (tracing_) {
+            trace::record(STAGE_NAMES[static_cast<size_t>(stage_)], start_, end, bytes_, records_);
+        }
+        if (!counting_) {
+            return;
+        }
+        const auto elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start_).count();
+        auto& c = detail::of(stage_);
+        c.nanoseconds.fetch_add(elapsed, std::memory_order_relaxed);
+        c.calls.fetch_add(1, std::memory_order_relaxed);
+        c.bytes.fetch_add(bytes_, std::memory_order_relaxed);
+        c.records.fetch_add(records_, std::memory_order_relaxed);
+    }
+
+    /// Adds to the bytes and records, when only known at the end of the scope
+    inline void add(uint64_t bytes, uint64_t records = 0) {
+        bytes_ += bytes;
+        records_ += records;
+    }
+
+ private:
+    const Stage stage_;
+    const bool counting_;
+    const bool tracing_;
+    uint64_t bytes_;
+    uint64_t records_;
+    detail::clock::time_point start_;
+};
+
+
+/**
+ * @brief Aggregates the stages over all ranks of \a comm. Collective.
+ *
+ * Rank 0 prints the minimum, mean and maximum seconds spent per stage, and
+ * the throughput of all ranks together bound by the slowest one.  If \a path
+ * is not empty, the same is written there as JSON.  Stages never entered on
+ * any rank are omitted.  Does nothing if recording is disabled.
+ */
+inline void report(MPI_Comm comm, const std::string& path, const std::string& executable) {
+    if (!enabled()) {
+        return;
+    }
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    constexpr size_t N = STAGE_COUNT;
+    std::array<double, N + 1> seconds;
+    std::array<uint64_t, 3 * N> values;
+    for (size_t i = 0; i < N; ++i) {
+        const auto& c = detail::counters[i];
+        seconds[i] = c.nanoseconds.load() * 1e-9;
+        values[i] = c.calls.load();
+        values[N + i] = c.bytes.load();
+        values[2 * N + i] = c.records.load();
+    }
+    seconds[N] = std::chrono::duration<double>(detail::clock::now() - detail::start).count();
+
+    std::array<double, N + 1> min_seconds, max_seconds, sum_seconds;
+    std::array<uint64_t, 3 * N> min_values, max_values, sum_values;
+    MPI_Reduce(seconds.data(), min_seconds.data(), N + 1, MPI_DOUBLE, MPI_MIN, 0, comm);
+    MPI_Reduce(seconds.data(), max_seconds.data(), N + 1, MPI_DOUBLE, MPI_MAX, 0, comm);
+    MPI_Reduce(seconds.data(), sum_seconds.data(), N + 1, MPI_DOUBLE, MPI_SUM, 0, comm);
+    MPI_Reduce(values.data(), min_values.data(), 3 * N, MPI_UINT64_T, MPI_MIN, 0, comm);
+    MPI_Reduce(values.data(), max_values.data(), 3 * N, MPI_UINT64_T, MPI_MAX, 0, comm);
+    MPI_Reduce(values.data(), sum_values.data(), 3 * N, MPI_UINT64_T, MPI_SUM, 0, comm);
+
+    if (rank != 0) {
+        return;
+    }
+
+    auto rate = [&max_seconds](uint64_t total, size_t i) {
+        return max_seconds[i] > 0 ? total / max_seconds[i] : 0.0;
+    };
+
+    std::cout << std::endl
+              << std::left << std::setw(16) << "Stage" << std::right
+              << std::setw(10) << "calls" << std::setw(11) << "min [s]"
+              << std::setw(11) << "mean [s]" << std::setw(11) << "max [s]"
+              << std::setw(12) << "MB/s" << std::setw(14) << "records/s" << std::endl;
+    std::cout << std::fixed;
+    for (size_t i = 0; i < N; ++i) {
+        if (sum_values[i] == 0) {
+            continue;
+        }
+        std::cout << std::left << std::setw(16) << STAGE_NAMES[i] << std::right
+                  << std::setw(10) << sum_values[i]
+                  << std::setprecision(3)
+                  << std::setw(11) << min_seconds[i]
+                  << std::setw(11) << sum_seconds[i] / size
+                  << std::setw(11) << max_seconds[i]
+                  << std::setprecision(1)
+                  << std::setw(12) << rate(sum_values[N + i], i) / (1024 * 1024)
+                  << std::setprecision(0)
+                  << std::setw(14) << rate(sum_values[2 * N + i], i) << std::endl;
+    }
+    std::cout << std::defaultfloat << std::setprecision(6);
+
+    if (path.empty()) {
+        return;
+    }
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Could not open " + path + " to write statistics");
+    }
+    auto triple = [&out, size](auto min, auto sum, auto max) {
+        out << "{\"min\": " << min << ", \"mean\": " << double(sum) / size
+            << ", \"max\": " << max << ", \"total\": " << sum << "}";
+    };
+    out << std::setprecision(9);
+    out << "{\n  \"executable\": \"" << executable << "\",\n"
+        << "  \"ranks\": " << size << ",\n"
+        << "  \"wall_seconds\": " << max_seconds[N] << ",\n"
+        << "  \"stages\": {";
+    const char* separator = "\n";
+    for (size_t i = 0; i < N; ++i) {
+        if (sum_values[i] == 0) {
+            continue;
+        }
+        out << separator << "    \"" << STAGE_NAMES[i] << "\": {\n"
+            << "      \"calls\": " << sum_values[i] << ",\n"
+            << "      \"seconds\": ";
+        triple(min_seconds[i], sum_seconds[i], max_seconds[i]);
+        out << ",\n      \"bytes\": ";
+        triple(min_values[N + i], sum_values[N + i], max_values[N + i]);
+        out << ",\n      \"records\": ";
+        triple(min_values[2 * N + i], sum_values[2 * N + i], max_values[2 * N + i]);
+        out << ",\n      \"bytes_per_second\": " << rate(sum_values[N + i], i)
+            << ",\n      \"records_per_second\": " << rate(sum_values[2 * N + i], i)
+            << "\n    }";
+        separator = ",\n";
+    }
+    out << "\n  }\n}\n";
+}
+
+
+}  // namespace stats
+}  // namespace utils
+
+#endif  // INCLUDE_STATS_HPP_
@@ -14,7 +14,8 @@
 
 #include "CLI/CLI.hpp"
 
-#include "progress.hpp"
+#include "mpi_progress.hpp"
+#include "stats.hpp"
 #include "touches.h"
 #include "version.h"
 
@@ -23,7 +24,9 @@ namespace fs = std::filesystem;
 using namespace neuron_parquet::touches;
 
 using neuron_parquet::Converter;
-using utils::ProgressMonitor;
+using utils::MPIProgress;
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
 
 typedef Converter<IndexedTouch> TouchConverter;
 
@@ -41,10 +44,16 @@ int main( int argc, char* argv[] ) {
     std::vector<std::string> all_input_names;
     std::string output_filename;
     long convert_limit = -1;
+    std::string stats_json;
+    std::string trace_json;
     CLI::App app{"Convert TouchDetector output to Parquet synapse files"};
     app.set_version_flag("-v,--version", neuron_parquet::VERSION);
     app.add_option("-o", output_filename, "Specify the output filename");
     app.add_option("-n", convert_limit, "Maximum number of records to export");
+    app.add_option("--stats-json", stats_json,
+                   "Time the conversion stages and write a summary over all ranks to this file");
+    app.add_option("--trace-json", trace_json,
+                   "Record a timeline of the conversion stages of all ranks to this Chrome trace file");
     app.add_option("files", all_input_names, "Files to convert")
        ->required()
        ->check(CLI::ExistingFile);
@@ -59,25 +68,16 @@ int main( int argc, char* argv[] ) {
       return 1;
     }
 
+    if (!stats_json.empty()) {
+      utils::stats::enable();
+    }
+    if (!trace_json.empty()) {
+      utils::trace::enable(comm);
+    }
+
     std::string first_file(all_input_names[0]);
     int number_of_files = all_input_names.size();
 
-    // Progress with an estimate number of blocks
-    size_t nblocks = 1;
-    if (mpi_rank == 0) {
-      if (convert_limit >0) {
-        TouchReader tr(first_file.c_str());
-        nblocks = TouchConverter::number_of_buffers(convert_limit * tr.record_size());
-      }
-      else {
-        std::ifstream f1(first_file, std::ios::binary | std::ios::ate);
-        nblocks = TouchConverter::number_of_buffers(f1.tellg());
-        f1.close();
-      }
-    }
-    ProgressMonitor progress(number_of_files * nblocks, mpi_rank==0);
-    progress.set_parallelism(mpi_size);
-
     if (output_filename.empty()) {
       output_filename = fs::path(first_file).filename();
     }
@@ -99,8 +99,20 @@ int main( int argc, char* argv[] ) {
         // Every rank participates in the conversion of every file, different regions
         TouchWriterParquet tw(outfn, version, version_string);
 
+        // All files share the record size of the first one
+        const uint64_t record_size = trv.record_size();
+        uint64_t total_records = 0;
+        for (const auto& name: all_input_names) {
+            const uint64_t records = fs::file_size(name) / record_size;
+            total_records += convert_limit > 0 ? std::min<uint64_t>(records, convert_limit) : records;
+        }
+        MPIProgress progress(comm, total_records);
+
         for (int i = 0; i < number_of_files; i++) {
-            MPI_Barrier(comm);
+            {
+                ScopedTimer timer(Stage::MPI);
+                MPI_Barrier(comm);
+            }
             const char* in_filename = all_input_names[i].c_str();
 
             if (mpi_rank == 0)
@@ -115,13 +127,13 @@ int main( int argc, char* argv[] ) {
             work_unit = std::min(tr.record_count() - offset, work_unit);
 
             TouchConverter converter(tr, tw);
-            if (mpi_rank == 0) {
-                // Progress handlers is just a function that triggers incrementing the progressbar
-                converter.setProgressHandler(progress, mpi_size);
-            }
+            converter.setRecordHandler([&progress, record_size](uint32_t n) {
+                progress.add(n, n * record_size);
+            });
 
             converter.exportN(work_unit, offset);
         }
+        progress.finish();
     }
     catch (const std::exception& e){
         printf("\n[ERROR] Could not create output file for rank %d.\n -> %s\n", mpi_rank, e.what());
@@ -129,11 +141,17 @@ int main( int argc, char* argv[] ) {
         return 1;
     }
 
-    MPI_Barrier(comm);
-    MPI_Finalize();
-
+    {
+        ScopedTimer timer(Stage::MPI);
+        MPI_Barrier(comm);
+    }
     if (mpi_rank == 0)
         printf("\nDone exporting\n");
+
+    utils::stats::report(comm, stats_json, "touch2parquet");
+    utils::trace::write(comm, trace_json);
+    MPI_Finalize();
+
     return 0;
 }
 
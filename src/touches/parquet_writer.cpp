@@ -10,12 +10,15 @@
 #include <arrow/util/key_value_metadata.h>
 
 #include "parquet_writer.h"
+#include "stats.hpp"
 #include "version.h"
 
 namespace neuron_parquet {
 namespace touches {
 
 using namespace parquet;
+using utils::stats::ScopedTimer;
+using utils::stats::Stage;
 
 
 static std::shared_ptr<GroupNode> setupSchema(Version version) {
@@ -137,7 +140,11 @@ TouchWriterParquet::~TouchWriterParquet() {
         // Flush remaining data
         _writeBuffer(_buffer_offset);
     }
-    file_writer->Close();
+    {
+        // Encodes and compresses the last row group
+        ScopedTimer timer(Stage::WriteBatch);
+        file_writer->Close();
+    }
     const auto status = out_file->Close();
     if (!status.ok()) {
         std::clog << status.ToString() << std::endl;
@@ -167,10 +174,13 @@ void TouchWriterParquet::_writeDataSet(const IndexedTouch* data, uint length) {
     uint n_chunks = length / TRANSPOSE_LEN;
     uint remaining = length % TRANSPOSE_LEN;
 
-    for( uint i=0; i<n_chunks; i++) {
-        _transpose_buffer_part(data, i*TRANSPOSE_LEN, TRANSPOSE_LEN);
+    {
+        ScopedTimer timer(Stage::Transpose, length * sizeof(IndexedTouch), length);
+        for( uint i=0; i<n_chunks; i++) {
+            _transpose_buffer_part(data, i*TRANSPOSE_LEN, TRANSPOSE_LEN);
+        }
+        _transpose_buffer_part(data, n_chunks*TRANSPOSE_LEN, remaining);
     }
-    _transpose_buffer_part(data, n_chunks*TRANSPOSE_LEN, remaining);
 
     assert(_buffer_offset+length <= BUFFER_LEN);
 
@@ -300,6 +310,9 @@ void TouchWriterParquet::_transpose_buffer_part(const IndexedTouch* data, uint o
 /// Low-level function to write directly a IndexedTouch set to the currently open row group
 ///
 void TouchWriterParquet::_writeBuffer(uint length) {
+    // Encoding and compression happen within, the previous row group is
+    // flushed when appending
+    ScopedTimer timer(Stage::WriteBatch, 0, length);
     RowGroupWriter* rg_writer = file_writer->AppendRowGroup();
 
     //pre_neuron / post_neuron [ids, section, segment]
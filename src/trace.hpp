@@ -0,0 +1,225 @@
+/**
+ * Copyright (C) 2018 Blue Brain Project
+ * All rights reserved. Do not distribute without further notice.
+ *
+ */
+#ifndef INCLUDE_TRACE_HPP_
+#define INCLUDE_TRACE_HPP_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <numeric>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <mpi.h>
+
+
+namespace utils {
+namespace trace {
+
+/**
+ * @brief A completed span of work on one thread.
+ *
+ * Times are in nanoseconds since tracing was enabled, \c name has to be a
+ * string literal or otherwise outlive the trace.
+ */
+struct Event {
+    const char* name;
+    uint64_t start;
+    uint64_t duration;
+    uint64_t bytes;
+    uint64_t records;
+};
+
+namespace detail {
+
+using clock = std::chrono::steady_clock;
+
+/**
+ * @brief Ring buffer of the events of a single thread.
+ *
+ * Only the owning thread writes, the oldest events are overwritten when full.
+ * The buffer is read once all threads recording are done.
+ */
+struct ThreadBuffer {
+    ThreadBuffer(size_t capacity, unsigned id, bool main)
+        : events(capacity)
+        , thread(id)
+        , main(main) {}
+
+    std::vector<Event> events;
+    std::atomic<uint64_t> recorded{0};
+    const unsigned thread;
+    const bool main;
+};
+
+inline std::atomic<bool> enabled{false};
+inline clock::time_point epoch;
+inline size_t capacity = 0;
+inline std::thread::id main_thread;
+
+// Buffers outlive their threads, e.g. the index sorting threads
+inline std::mutex registry_mtx;
+inline std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+inline ThreadBuffer& local_buffer() {
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (buffer == nullptr) {
+        std::lock_guard<std::mutex> lg(registry_mtx);
+        registry.push_back(std::make_unique<ThreadBuffer>(
+            capacity, registry.size(), std::this_thread::get_id() == main_thread));
+        buffer = registry.back().get();
+    }
+    return *buffer;
+}
+
+inline uint64_t since_epoch(clock::time_point t) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(t - epoch).count();
+}
+
+}  // namespace detail
+
+
+/// Events kept per thread by default, the oldest are dropped beyond
+constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+/**
+ * @brief Whether events are recorded. Off by default.
+ */
+inline bool enabled() {
+    return detail::enabled.load(std::memory_order_relaxed);
+}
+
+/**
+ * @brief Starts recording events, keeping up to \a capacity per thread.
+ *
+ * Synchronizes the ranks of \a comm first, to line up their timelines.
+ * Collective.
+ */
+inline void enable(MPI_Comm comm, size_t capacity = DEFAULT_CAPACITY) {
+    if (capacity == 0) {
+        throw std::invalid_argument("the trace needs room for at least one event per thread");
+    }
+    detail::capacity = capacity;
+    detail::main_thread = std::this_thread::get_id();
+    MPI_Barrier(comm);
+    detail::epoch = detail::clock::now();
+    detail::enabled.store(true, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Records the span from \a start to \a end on the calling thread.
+ */
+inline void record(const char* name,
+                   detail::clock::time_point start,
+                   detail::clock::time_point end,
+                   uint64_t bytes = 0,
+                   uint64_t records = 0) {
+    auto& buffer = detail::local_buffer();
+    const auto n = buffer.recorded.load(std::memory_order_relaxed);
+    const auto begin = detail::since_epoch(start);
+    buffer.events[n % buffer.events.size()] = {name, begin, detail::since_epoch(end) - begin,
+                                               bytes, records};
+    buffer.recorded.store(n + 1, std::memory_order_release);
+}
+
+
+/**
+ * @brief Writes the events of all ranks of \a comm to \a path. Collective.
+ *
+ * The file is in the Chrome trace event format, as read by chrome://tracing
+ * or Perfetto, with one process per rank and one track per thread.  Must be
+ * called once no other thread records events.  Does nothing if tracing is
+ * disabled.
+ */
+inline void write(MPI_Comm comm, const std::string& path) {
+    if (!enabled()) {
+        return;
+    }
+    detail::enabled.store(false, std::memory_order_relaxed);
+
+    int rank, size;
+    MPI_Comm_rank(comm, &rank);
+    MPI_Comm_size(comm, &size);
+
+    // Every rank formats its own events, rank 0 only concatenates them
+    std::ostringstream local;
+    local << "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": " << rank
+          << ", \"args\": {\"name\": \"rank " << rank << "\"}},\n"
+          << "{\"name\": \"process_sort_index\", \"ph\": \"M\", \"pid\": " << rank
+          << ", \"args\": {\"sort_index\": " << rank << "}},\n";
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lg(detail::registry_mtx);
+        for (const auto& buffer: detail::registry) {
+            const uint64_t recorded = buffer->recorded.load(std::memory_order_acquire);
+            const uint64_t capacity = buffer->events.size();
+            const uint64_t first = recorded > capacity ? recorded - capacity : 0;
+            dropped += first;
+            local << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": " << rank
+                  << ", \"tid\": " << buffer->thread << ", \"args\": {\"name\": \""
+                  << (buffer->main ? "main" : "thread " + std::to_string(buffer->thread))
+                  << "\"}},\n";
+            for (uint64_t i = first; i < recorded; ++i) {
+                const auto& e = buffer->events[i % capacity];
+                local << "{\"name\": \"" << e.name << "\", \"ph\": \"X\", \"pid\": " << rank
+                      << ", \"tid\": " << buffer->thread
+                      << ", \"ts\": " << e.start / 1000 << "." << (e.start / 100) % 10
+                      << ", \"dur\": " << e.duration / 1000 << "." << (e.duration / 100) % 10
+                      << ", \"args\": {\"bytes\": " << e.bytes << ", \"records\": " << e.records
+                      << "}},\n";
+            }
+        }
+    }
+    if (dropped > 0) {
+        std::cerr << "WARNING: rank " << rank << " dropped the " << dropped
+                  << " oldest trace events, the trace buffers are full" << std::endl;
+    }
+
+    // Gathered at once, the whole trace has to stay within the count of MPI_Gatherv
+    const std::string events = local.str();
+    uint64_t total;
+    const uint64_t length = events.size();
+    MPI_Allreduce(&length, &total, 1, MPI_UINT64_T, MPI_SUM, comm);
+    if (total > static_cast<uint64_t>(std::numeric_limits<int>::max())) {
+        throw std::runtime_error("trace is too large to gather, record fewer events per thread");
+    }
+
+    const int count = length;
+    std::vector<int> counts(rank == 0 ? size : 0);
+    MPI_Gather(&count, 1, MPI_INT, counts.data(), 1, MPI_INT, 0, comm);
+
+    std::vector<int> displacements(counts.size(), 0);
+    std::string all(rank == 0 ? total : 0, '\0');
+    if (rank == 0) {
+        std::partial_sum(counts.begin(), counts.end() - 1, displacements.begin() + 1);
+    }
+    MPI_Gatherv(events.data(), count, MPI_CHAR,
+                all.data(), counts.data(), displacements.data(), MPI_CHAR, 0, comm);
+
+    if (rank != 0) {
+        return;
+    }
+    std::ofstream out(path);
+    if (!out) {
+        throw std::runtime_error("Could not open " + path + " to write the trace");
+    }
+    // Every event ends in a separator, drop the last one
+    all.resize(all.size() - 2);
+    out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n" << all << "\n]}\n";
+}
+
+
+}  // namespace trace
+}  // namespace utils
+
+#endif  // INCLUDE_TRACE_HPP_
@@ -0,0 +1,289 @@
+#include <numeric>
+#include <random>
+#include <unordered_map>
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
+
+#include "index/flat_index.h"
+#include "index/radix_sort.h"
+
+using namespace indexing;
+
+/**
+ * \brief The former regrouping by node ID via a map, used as reference.
+ */
+std::unordered_map<NodeID, RawIndex> mapNodeRanges(const FlatRawIndex& nodeRanges) {
+    std::unordered_map<NodeID, RawIndex> result;
+    for (const auto& [id, start, end]: nodeRanges) {
+        auto& ranges = result[id];
+        if (!ranges.empty() && ranges.back()[0] <= start && start <= ranges.back()[1]) {
+            ranges.back()[1] = std::max(ranges.back()[1], end);
+        } else {
+            ranges.push_back({start, end});
+        }
+    }
+    return result;
+}
+
+/**
+ * \brief Generates node ranges as received from \c nruns ranks.
+ *
+ * Every rank holds a contiguous block of edges with random node IDs, and
+ * sends its ranges sorted.  Returns the concatenated runs and their offsets.
+ */
+std::pair<FlatRawIndex, std::vector<uint64_t>> generateRuns(uint64_t nodeCount,
+                                                             uint64_t edgeCount,
+                                                             uint64_t nruns) {
+    std::mt19937_64 rng(42);
+    std::uniform_int_distribution<NodeID> nodes(0, nodeCount - 1);
+    std::geometric_distribution<uint64_t> lengths(0.2);
+
+    FlatRawIndex result;
+    std::vector<uint64_t> offsets{0};
+    const auto edgesPerRun = edgeCount / nruns;
+    uint64_t edge = 0;
+    for (uint64_t run = 0; run < nruns; ++run) {
+        const auto runStart = result.size();
+        const auto runEnd = edge + edgesPerRun;
+        while (edge < runEnd) {
+            const auto end = std::min(runEnd, edge + 1 + lengths(rng));
+            result.push_back({nodes(rng), edge, end});
+            edge = end;
+        }
+        std::sort(result.begin() + runStart, result.end());
+        offsets.push_back(result.size());
+    }
+    return {result, offsets};
+}
+
+TEST_CASE("MergeSortedRuns", "[index]") {
+    for (uint64_t nruns: {1, 2, 3, 7, 16}) {
+        auto [ranges, offsets] = generateRuns(100, 10000, nruns);
+        auto expected = ranges;
+        std::sort(expected.begin(), expected.end());
+        mergeSortedRuns(ranges, offsets);
+        REQUIRE(ranges == expected);
+    }
+}
+
+TEST_CASE("GroupSortedRanges", "[index]") {
+    const uint64_t nodeCount = 1000;
+    auto [ranges, offsets] = generateRuns(nodeCount, 100000, 5);
+    const auto reference = mapNodeRanges(ranges);
+    mergeSortedRuns(ranges, offsets);
+
+    const auto grouped = groupSortedRanges(ranges, 0, nodeCount);
+    REQUIRE(grouped.nodeCount() == nodeCount);
+    for (NodeID id = 0; id < nodeCount; ++id) {
+        const auto it = reference.find(id);
+        const RawIndex nodeRanges(grouped.ranges.begin() + grouped.offsets[id],
+                                  grouped.ranges.begin() + grouped.offsets[id + 1]);
+        if (it == reference.end()) {
+            REQUIRE(nodeRanges.empty());
+        } else {
+            REQUIRE(nodeRanges == it->second);
+        }
+    }
+
+    SECTION("partitions") {
+        const auto first = std::lower_bound(ranges.begin(), ranges.end(), FlatRawIndex::value_type{100, 0, 0});
+        const auto last = std::lower_bound(ranges.begin(), ranges.end(), FlatRawIndex::value_type{200, 0, 0});
+        const auto partition = groupSortedRanges({first, last}, 100, 100);
+        REQUIRE(partition.nodeCount() == 100);
+        REQUIRE(partition.ranges.size() == grouped.offsets[200] - grouped.offsets[100]);
+        REQUIRE_THROWS(groupSortedRanges(ranges, 100, 100));
+    }
+}
+
+TEST_CASE("CountPerPartition", "[index]") {
+    const uint64_t nodeCount = 1000;
+    auto [ranges, offsets] = generateRuns(nodeCount, 100000, 1);
+
+    std::vector<uint64_t> expected(4, 0);
+    for (const auto& range: ranges) {
+        expected[range[0] / 250]++;
+    }
+    REQUIRE(countPerPartition(ranges, {0, 250, 500, 750, 1000}) == expected);
+
+    // Empty partitions, and ranges outside of all partitions are not counted
+    const auto counts = countPerPartition(ranges, {250, 250, 500});
+    REQUIRE(counts == std::vector<uint64_t>{0, expected[1]});
+    REQUIRE(countPerPartition({}, {0, 10, 20}) == std::vector<uint64_t>{0, 0});
+}
+
+TEST_CASE("AppendNodeRanges", "[index]") {
+    std::vector<NodeID> ids{3, 3, 3, 1, 1, 3, 2, 2, 2, 2};
+
+    FlatRawIndex whole;
+    appendNodeRanges(whole, ids.data(), ids.size(), 100);
+    REQUIRE(whole == FlatRawIndex{{3, 100, 103}, {1, 103, 105}, {3, 105, 106}, {2, 106, 110}});
+
+    // Blocks continue the ranges across their boundaries
+    for (size_t block: {1, 2, 3, 4}) {
+        FlatRawIndex blocks;
+        for (size_t start = 0; start < ids.size(); start += block) {
+            const auto count = std::min(block, ids.size() - start);
+            appendNodeRanges(blocks, ids.data() + start, count, 100 + start);
+        }
+        REQUIRE(blocks == whole);
+    }
+
+    // Non-contiguous blocks start new ranges
+    FlatRawIndex gaps;
+    appendNodeRanges(gaps, ids.data(), 2, 0);
+    appendNodeRanges(gaps, ids.data() + 2, 1, 10);
+    REQUIRE(gaps == FlatRawIndex{{3, 0, 2}, {3, 10, 11}});
+}
+
+TEST_CASE("PlanNodeSlots", "[index]") {
+    // 10 buckets of 3 nodes, the last one truncated to 2
+    const std::vector<uint64_t> counts{1, 1, 5, 0, 0, 0, 0, 9, 2, 2};
+    REQUIRE(planNodeSlots(counts, 3, 29, 100) == std::vector<NodeSlot>{{0, 29}});
+    // Limited by ranges, a too large bucket still forms one block
+    REQUIRE(planNodeSlots(counts, 3, 29, 6) ==
+            std::vector<NodeSlot>{{0, 6}, {6, 12}, {12, 18}, {18, 21}, {21, 24}, {24, 29}});
+    // Limited by nodes
+    REQUIRE(planNodeSlots(std::vector<uint64_t>(10, 0), 3, 29, 7) ==
+            std::vector<NodeSlot>{{0, 6}, {6, 12}, {12, 18}, {18, 24}, {24, 29}});
+    REQUIRE(planNodeSlots({}, 3, 0, 7).empty());
+}
+
+/**
+ * \brief Generates the unsorted ranges of \c edgeCount edges, in edge order.
+ */
+FlatRawIndex generateRanges(uint64_t nodeCount, uint64_t edgeCount, uint64_t seed = 42) {
+    std::mt19937_64 rng(seed);
+    std::uniform_int_distribution<NodeID> nodes(0, nodeCount - 1);
+    std::vector<NodeID> ids(edgeCount);
+    for (auto& id: ids) {
+        id = nodes(rng);
+    }
+    FlatRawIndex result;
+    appendNodeRanges(result, ids.data(), ids.size(), 0);
+    return result;
+}
+
+TEST_CASE("SliceSortedRanges", "[index]") {
+    // Sorted node IDs with gaps and long runs, followed by nodes without edges
+    std::mt19937_64 rng(42);
+    std::geometric_distribution<uint64_t> gaps(0.5);
+    std::geometric_distribution<uint64_t> lengths(0.02);
+    std::vector<NodeID> ids;
+    for (NodeID id = 0; ids.size() < 5000; id += gaps(rng)) {
+        ids.insert(ids.end(), 1 + lengths(rng), id);
+    }
+    const uint64_t nodeCount = ids.back() + 10;
+
+    FlatRawIndex all;
+    appendNodeRanges(all, ids.data(), ids.size(), 0);
+    const auto expected = groupSortedRanges(all, 0, nodeCount);
+
+    for (size_t nranks: {1, 2, 5, 40, 200}) {
+        // Ranks hold consecutive blocks of edges of random size, some empty,
+        // and not in the order of the ranks
+        std::vector<uint64_t> cuts{0, ids.size()};
+        std::uniform_int_distribution<uint64_t> positions(0, ids.size());
+        while (cuts.size() < nranks + 1) {
+            cuts.push_back(positions(rng));
+        }
+        std::sort(cuts.begin(), cuts.end());
+        std::vector<size_t> blocks(nranks);
+        std::iota(blocks.begin(), blocks.end(), 0);
+        std::shuffle(blocks.begin(), blocks.end(), rng);
+
+        std::vector<FlatRawIndex> ranges(nranks);
+        std::vector<RankRanges> summaries;
+        for (size_t rank = 0; rank < nranks; ++rank) {
+            const auto begin = cuts[blocks[rank]];
+            appendNodeRanges(ranges[rank], ids.data() + begin, cuts[blocks[rank] + 1] - begin, begin);
+            summaries.push_back(summarizeRanges(ranges[rank]));
+        }
+        const auto order = sortedRankOrder(summaries);
+        REQUIRE(order);
+
+        RawIndex nodeToRanges(nodeCount, {1, 0});
+        RawIndex rangeToEdges(expected.ranges.size(), {1, 0});
+        for (size_t rank = 0; rank < nranks; ++rank) {
+            const auto slice = sliceSortedRanges(ranges[rank], summaries, *order, rank, nodeCount);
+            REQUIRE(slice.rangeCount == expected.ranges.size());
+            std::copy(slice.nodeToRanges.begin(), slice.nodeToRanges.end(),
+                      nodeToRanges.begin() + slice.nodeOffset);
+            std::copy(slice.rangeToEdges.begin(), slice.rangeToEdges.end(),
+                      rangeToEdges.begin() + slice.rangeOffset);
+        }
+        REQUIRE(rangeToEdges == expected.ranges);
+        for (NodeID id = 0; id < nodeCount; ++id) {
+            if (expected.offsets[id] == expected.offsets[id + 1]) {
+                REQUIRE(nodeToRanges[id] == RawIndex::value_type{0, 0});
+            } else {
+                REQUIRE(nodeToRanges[id] == RawIndex::value_type{expected.offsets[id], expected.offsets[id + 1]});
+            }
+        }
+
+        REQUIRE_THROWS(sliceSortedRanges(ranges[0], summaries, *order, 0, ids.back()));
+    }
+
+    SECTION("unsorted") {
+        std::vector<NodeID> unsorted{1, 1, 3, 2};
+        FlatRawIndex ranges;
+        appendNodeRanges(ranges, unsorted.data(), unsorted.size(), 0);
+        REQUIRE_FALSE(sortedRankOrder({summarizeRanges(ranges)}));
+
+        // Sorted per rank, but not across ranks
+        FlatRawIndex first, second;
+        appendNodeRanges(first, unsorted.data(), 3, 0);
+        appendNodeRanges(second, unsorted.data() + 3, 1, 3);
+        REQUIRE(sortedRankOrder({summarizeRanges(first)}));
+        REQUIRE_FALSE(sortedRankOrder({summarizeRanges(first), summarizeRanges(second)}));
+        REQUIRE_FALSE(sortedRankOrder({summarizeRanges({})}));
+    }
+}
+
+TEST_CASE("RadixSortByNode", "[index]") {
+    const uint64_t nodeCount = GENERATE(1, 200, 70000, uint64_t{1} << 40);
+    const uint64_t edgeCount = GENERATE(0, 1000, 300000);
+    const unsigned threads = GENERATE(1, 3);
+
+    auto ranges = generateRanges(nodeCount, edgeCount);
+    auto expected = ranges;
+    std::sort(expected.begin(), expected.end());
+    radixSortByNode(ranges, threads);
+    REQUIRE(ranges == expected);
+}
+
+TEST_CASE("RadixSortBenchmark", "[.][benchmark]") {
+    // Every range takes 24 bytes, held by the input, the copy sorted, and the
+    // buffer of the radix sort: about 7 GB for 10^8 ranges
+    const uint64_t edgeCount = GENERATE(10000000, 100000000);
+    const auto ranges = generateRanges(100000000, edgeCount);
+
+    BENCHMARK("std::sort " + std::to_string(ranges.size())) {
+        auto copy = ranges;
+        std::sort(copy.begin(), copy.end());
+        return copy.front()[0];
+    };
+
+    BENCHMARK("radixSortByNode " + std::to_string(ranges.size())) {
+        auto copy = ranges;
+        radixSortByNode(copy);
+        return copy.front()[0];
+    };
+}
+
+TEST_CASE("RegroupBenchmark", "[.][benchmark]") {
+    const uint64_t nodeCount = 1000000;
+    const auto [runs, offsets] = generateRuns(nodeCount, 20000000, 64);
+
+    BENCHMARK("unordered_map") {
+        auto ranges = runs;
+        return mapNodeRanges(ranges).size();
+    };
+
+    BENCHMARK("sorted flat arrays") {
+        auto ranges = runs;
+        mergeSortedRuns(ranges, offsets);
+        return groupSortedRanges(ranges, 0, nodeCount).ranges.size();
+    };
+}
@@ -1,9 +1,13 @@
 #include <filesystem>
+#include <map>
 
 #include <catch2/catch_test_macros.hpp>
+#include <catch2/generators/catch_generators.hpp>
 #include <highfive/H5File.hpp>
 #include <mpi.h>
 
+#include "index/check.h"
+#include "index/exchange.h"
 #include "index/index.h"
 
 namespace fs = std::filesystem;
@@ -33,7 +37,7 @@ class MPIFixture {
     }
 };
 
-void generate_data(const fs::path& base) {
+void generate_node_ids(HighFive::Group& g) {
     std::vector<uint64_t> source_ids;
     std::vector<uint64_t> target_ids;
     source_ids.reserve(NNODES * NNODES);
@@ -46,11 +50,17 @@ void generate_data(const fs::path& base) {
         }
     }
 
-    HighFive::File file(base, HighFive::File::Overwrite);
-    auto g = file.createGroup(GROUP);
     g.createDataSet("source_node_id", source_ids);
     g.createDataSet("target_node_id", target_ids);
-    indexing::write(g, SOURCE_OFFSET + NNODES, NNODES);
+}
+
+void generate_data(const fs::path& base,
+                   uint64_t maxExchangeCount = 0,
+                   const indexing::IndexLayout& layout = {}) {
+    HighFive::File file(base, HighFive::File::Overwrite);
+    auto g = file.createGroup(GROUP);
+    generate_node_ids(g);
+    indexing::write(g, SOURCE_OFFSET + NNODES, NNODES, maxExchangeCount, layout);
 }
 
 TEST_CASE("Indexing") {
@@ -111,3 +121,165 @@ TEST_CASE("Indexing") {
         }
     }
 }
+
+TEST_CASE("BoundedIndexing") {
+    MPIFixture fixed;
+
+    generate_data("index_test.h5");
+    HighFive::File f("index_test.h5", HighFive::File::ReadWrite);
+    auto g = f.getGroup(GROUP);
+
+    // Rebuild the index with a budget of a few ranges, taking many passes
+    std::map<std::string, std::vector<std::array<uint64_t, 2>>> expected;
+    for (const auto& name: {"source_to_target", "target_to_source"}) {
+        for (const auto& dset: {"node_id_to_ranges", "range_to_edge_id"}) {
+            const auto path = std::string("indices/") + name + "/" + dset;
+            g.getDataSet(path).read(expected[path]);
+        }
+    }
+    g.unlink("indices");
+    indexing::writeBounded(g, SOURCE_OFFSET + NNODES, NNODES, 16 * 128, fs::temp_directory_path());
+
+    for (const auto& [path, data]: expected) {
+        std::vector<std::array<uint64_t, 2>> result;
+        g.getDataSet(path).read(result);
+        REQUIRE(result == data);
+    }
+}
+
+TEST_CASE("IndexNodeCount") {
+    MPIFixture fixed;
+
+    HighFive::File file("index_count_test.h5", HighFive::File::Overwrite);
+    auto g = file.createGroup(GROUP);
+    generate_node_ids(g);
+
+    // The target node IDs are unsorted and exchanged, the source node IDs
+    // are sorted and sliced
+    REQUIRE_THROWS(indexing::write(g, SOURCE_OFFSET + NNODES, NNODES - 1));
+    REQUIRE_THROWS(indexing::write(g, SOURCE_OFFSET + NNODES - 1, NNODES));
+}
+
+TEST_CASE("IndexLayout") {
+    MPIFixture fixed;
+
+    indexing::IndexLayout layout;
+    layout.chunkSize = 7;
+    layout.deflate = 4;
+    layout.shuffle = true;
+    layout.narrow = true;
+    generate_data("index_layout_test.h5", 0, layout);
+    generate_data("index_test.h5");
+
+    HighFive::File f("index_layout_test.h5");
+    HighFive::File reference("index_test.h5");
+    for (const auto& name: {"source_to_target", "target_to_source"}) {
+        for (const auto& dset: {"node_id_to_ranges", "range_to_edge_id"}) {
+            const auto path = std::string(GROUP) + "/indices/" + name + "/" + dset;
+            const auto dataset = f.getDataSet(path);
+            REQUIRE(dataset.getDataType().getSize() == sizeof(uint32_t));
+
+            std::vector<std::array<uint64_t, 2>> result;
+            std::vector<std::array<uint64_t, 2>> expected;
+            dataset.read(result);
+            reference.getDataSet(path).read(expected);
+            REQUIRE(result == expected);
+        }
+    }
+}
+
+TEST_CASE("ChunkedExchange") {
+    MPIFixture fixed;
+
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    // Rank r sends r + i + 1 values (r, i, j) to rank i
+    std::vector<std::array<uint64_t, 3>> send;
+    std::vector<uint64_t> sendCounts;
+    for (int i = 0; i < size; ++i) {
+        sendCounts.push_back(rank + i + 1);
+        for (int j = 0; j < rank + i + 1; ++j) {
+            send.push_back({uint64_t(rank), uint64_t(i), uint64_t(j)});
+        }
+    }
+
+    const uint64_t maxRoundCount = GENERATE(0, 1, 2, 5);
+    std::vector<std::array<uint64_t, 3>> recv;
+    std::vector<uint64_t> recvCounts;
+    indexing::mpi::alltoallv(send, sendCounts, recv, recvCounts, MPI_COMM_WORLD, maxRoundCount);
+
+    size_t k = 0;
+    for (int i = 0; i < size; ++i) {
+        REQUIRE(recvCounts[i] == i + rank + 1);
+        for (int j = 0; j < i + rank + 1; ++j, ++k) {
+            REQUIRE(recv[k] == std::array<uint64_t, 3>{uint64_t(i), uint64_t(rank), uint64_t(j)});
+        }
+    }
+    REQUIRE(k == recv.size());
+}
+
+TEST_CASE("ChunkedIndexing") {
+    MPIFixture fixed;
+
+    // Force the exchange of ranges in many small rounds
+    const uint64_t maxExchangeCount = GENERATE(1, 3, 7);
+    generate_data("index_chunked_test.h5", maxExchangeCount);
+    generate_data("index_test.h5");
+
+    HighFive::File f("index_chunked_test.h5");
+    HighFive::File reference("index_test.h5");
+    for (const auto& name: {"source_to_target", "target_to_source"}) {
+        for (const auto& dset: {"node_id_to_ranges", "range_to_edge_id"}) {
+            const auto path = std::string(GROUP) + "/indices/" + name + "/" + dset;
+            std::vector<std::array<uint64_t, 2>> result;
+            std::vector<std::array<uint64_t, 2>> expected;
+            f.getDataSet(path).read(result);
+            reference.getDataSet(path).read(expected);
+            REQUIRE(result == expected);
+        }
+    }
+}
+
+TEST_CASE("VerifyIndex") {
+    MPIFixture fixed;
+
+    generate_data("index_test.h5");
+    HighFive::File f("index_test.h5", HighFive::File::ReadWrite);
+    auto g = f.getGroup(GROUP);
+
+    const auto source = indexing::verify(g, "indices/source_to_target", "source_node_id");
+    REQUIRE(source.errors == 0);
+    REQUIRE(source.nodes == SOURCE_OFFSET + NNODES);
+    REQUIRE(source.ranges == NNODES);
+    REQUIRE(source.edges == NNODES * NNODES);
+    REQUIRE(indexing::verify(g, "indices/target_to_source", "target_node_id").errors == 0);
+
+    SECTION("Lookups") {
+        auto tidx = g.getGroup("indices/target_to_source");
+        REQUIRE(indexing::lookup(tidx, {}).empty());
+        const auto ranges = indexing::lookup(tidx, {1, 2, 5});
+        REQUIRE(ranges.size() == 2 * NNODES);
+        for (size_t j = 0; j < NNODES; ++j) {
+            REQUIRE(ranges[2 * j] == std::array<uint64_t, 2>{NNODES * j + 1, NNODES * j + 3});
+            REQUIRE(ranges[2 * j + 1] == std::array<uint64_t, 2>{NNODES * j + 5, NNODES * j + 6});
+        }
+
+        auto sidx = g.getGroup("indices/source_to_target");
+        REQUIRE(indexing::lookupRange(sidx, 0, SOURCE_OFFSET).empty());
+        REQUIRE(indexing::lookupRange(sidx, SOURCE_OFFSET + 2, SOURCE_OFFSET + 5) ==
+                std::vector<std::array<uint64_t, 2>>{{2 * NNODES, 5 * NNODES}});
+    }
+
+    SECTION("Errors") {
+        // Swap the ranges of two target nodes, and cover an edge twice
+        auto dset = g.getDataSet("indices/target_to_source/range_to_edge_id");
+        std::vector<std::array<uint64_t, 2>> edges;
+        dset.read(edges);
+        std::swap(edges[0], edges[NNODES]);
+        edges[2][1] += 1;
+        dset.write(edges);
+        REQUIRE(indexing::verify(g, "indices/target_to_source", "target_node_id").errors >= 3);
+    }
+}
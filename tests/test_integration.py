@@ -1,7 +1,10 @@
+import h5py
 import libsonata
 import numpy as np
 import numpy.testing as npt
 import pandas as pd
+import pyarrow as pa
+import pyarrow.parquet as pq
 import subprocess
 import tempfile
 from pathlib import Path
@@ -101,5 +104,272 @@ def test_conversion():
         )
 
 
+def test_streamed_index():
+    with tempfile.TemporaryDirectory() as dirname:
+        tmpdir = Path(dirname)
+
+        parquet_name = tmpdir / "data.parquet"
+        parquet_name.mkdir(parents=True, exist_ok=True)
+        population_name = "streamed"
+
+        generate_data(parquet_name, nfiles=5)
+
+        names = []
+        for flags in ([], ["--stream-index"]):
+            sonata_name = tmpdir / f"data{len(names)}.h5"
+            subprocess.check_call(
+                ["parquet2hdf5", parquet_name, sonata_name, population_name] + flags
+            )
+            names.append(sonata_name)
+
+        with h5py.File(names[0], "r") as read, h5py.File(names[1], "r") as streamed:
+            base = f"edges/{population_name}/indices"
+            for direction in ("source_to_target", "target_to_source"):
+                for dset in ("node_id_to_ranges", "range_to_edge_id"):
+                    name = f"{base}/{direction}/{dset}"
+                    npt.assert_array_equal(read[name], streamed[name])
+
+
+def test_nested_columns():
+    with tempfile.TemporaryDirectory() as dirname:
+        tmpdir = Path(dirname)
+
+        parquet_name = tmpdir / "nested.parquet"
+        parquet_name.mkdir(parents=True, exist_ok=True)
+        sonata_name = tmpdir / "nested.h5"
+        population_name = "nested"
+
+        nrows = 1000
+        rng = np.random.default_rng()
+        positions = rng.standard_normal((nrows, 3)).astype(np.float32)
+
+        table = pa.table(
+            {
+                "source_node_id": np.arange(nrows, dtype=np.int64) // 10,
+                "target_node_id": np.arange(nrows, dtype=np.int64) % 10,
+                "edge_type_id": np.zeros(nrows, dtype=np.int64),
+                "position": pa.StructArray.from_arrays(
+                    [pa.array(positions[:, i]) for i in range(3)], ["x", "y", "z"]
+                ),
+                "vector": pa.FixedSizeListArray.from_arrays(
+                    pa.array(positions.ravel()), 3
+                ),
+            }
+        )
+        pq.write_table(table, parquet_name / "data0.parquet", row_group_size=300)
+
+        subprocess.check_call(
+            ["parquet2hdf5", parquet_name, sonata_name, population_name]
+        )
+
+        store = libsonata.EdgeStorage(sonata_name)
+        pop = store.open_population(population_name)
+        assert len(pop) == nrows
+        for i, axis in enumerate("xyz"):
+            npt.assert_array_equal(
+                pop.get_attribute(f"position_{axis}", pop.select_all()),
+                positions[:, i],
+            )
+
+        with h5py.File(sonata_name, "r") as fd:
+            npt.assert_array_equal(fd[f"edges/{population_name}/0/vector"], positions)
+
+
+def test_nullable_and_string_columns():
+    with tempfile.TemporaryDirectory() as dirname:
+        tmpdir = Path(dirname)
+
+        parquet_name = tmpdir / "strings.parquet"
+        parquet_name.mkdir(parents=True, exist_ok=True)
+        sonata_name = tmpdir / "strings.h5"
+        population_name = "strings"
+
+        nrows = 1000
+        rng = np.random.default_rng()
+        names = np.array(["dend", "axon", "soma"])[rng.integers(3, size=nrows)]
+        flags = rng.integers(2, size=nrows).astype(bool)
+        classes = rng.integers(5, size=nrows).astype(np.int32)
+        delays = rng.standard_normal(nrows)
+        missing = rng.integers(4, size=nrows) == 0
+
+        table = pa.table(
+            {
+                "source_node_id": np.arange(nrows, dtype=np.int64) // 10,
+                "target_node_id": np.arange(nrows, dtype=np.int64) % 10,
+                "edge_type_id": np.zeros(nrows, dtype=np.int64),
+                "section_type": pa.array(names).dictionary_encode(),
+                "morphology": pa.array(names),
+                "syn_class": pa.array(classes, mask=missing).dictionary_encode(),
+                "flag": pa.array(flags),
+                "delay": pa.array(delays, mask=missing),
+            }
+        )
+        for i, start in enumerate(range(0, nrows, 400)):
+            pq.write_table(
+                table.slice(start, 400),
+                parquet_name / f"data{i}.parquet",
+                row_group_size=150,
+            )
+
+        subprocess.check_call(
+            ["parquet2hdf5", parquet_name, sonata_name, population_name]
+        )
+
+        store = libsonata.EdgeStorage(sonata_name)
+        pop = store.open_population(population_name)
+        assert len(pop) == nrows
+        for column in ("section_type", "morphology"):
+            assert pop.enumeration_names(column) == sorted(set(names))
+            npt.assert_array_equal(pop.get_attribute(column, pop.select_all()), names)
+
+        with h5py.File(sonata_name, "r") as fd:
+            group = fd[f"edges/{population_name}/0"]
+            npt.assert_array_equal(group["flag"][:], flags)
+            assert "syn_class" not in group["@library"]
+            npt.assert_array_equal(group["syn_class"][:][~missing], classes[~missing])
+            assert (group["syn_class"][:][missing] == -1).all()
+            npt.assert_array_equal(group["delay"][:][~missing], delays[~missing])
+            assert np.isnan(group["delay"][:][missing]).all()
+
+
+def test_sonata_roundtrip():
+    with tempfile.TemporaryDirectory() as dirname:
+        tmpdir = Path(dirname)
+
+        parquet_name = tmpdir / "input.parquet"
+        parquet_name.mkdir(parents=True, exist_ok=True)
+        roundtrip_name = tmpdir / "roundtrip.parquet"
+        population_name = "roundtrip"
+
+        nrows = 1000
+        rng = np.random.default_rng()
+        names = np.array(["dend", "axon", "soma"])[rng.integers(3, size=nrows)]
+        delays = rng.standard_normal(nrows)
+        missing = rng.integers(4, size=nrows) == 0
+        # Nullable, but without nulls: -1 is not the fill value of a null
+        classes = rng.integers(-1, 3, size=nrows).astype(np.int32)
+
+        table = pa.table(
+            {
+                "source_node_id": np.arange(nrows, dtype=np.int64) // 10,
+                "target_node_id": np.arange(nrows, dtype=np.int64) % 10,
+                "edge_type_id": np.zeros(nrows, dtype=np.int64),
+                "section_type": pa.array(names).dictionary_encode(),
+                "morphology": pa.array(names),
+                "delay": pa.array(delays, mask=missing),
+                "syn_type_id": rng.integers(100, size=nrows).astype(np.int16),
+                "syn_class": pa.array(classes),
+            }
+        )
+        pq.write_table(table, parquet_name / "data0.parquet", row_group_size=150)
+
+        first_name = tmpdir / "first.h5"
+        second_name = tmpdir / "second.h5"
+        subprocess.check_call(
+            ["parquet2hdf5", parquet_name, first_name, population_name]
+        )
+        subprocess.check_call(
+            ["hdf52parquet", first_name, population_name, roundtrip_name]
+        )
+        subprocess.check_call(
+            ["parquet2hdf5", roundtrip_name, second_name, population_name]
+        )
+
+        roundtrip = pq.read_table(roundtrip_name)
+        assert roundtrip["syn_class"].null_count == 0
+        npt.assert_array_equal(roundtrip["syn_class"].to_numpy(), classes)
+        npt.assert_array_equal(roundtrip["delay"].is_null().to_numpy(), missing)
+
+        datasets = []
+
+        def collect(name, obj):
+            if isinstance(obj, h5py.Dataset):
+                datasets.append(name)
+
+        with h5py.File(first_name, "r") as first, h5py.File(second_name, "r") as second:
+            first.visititems(collect)
+            assert f"edges/{population_name}/0/@library/section_type" in datasets
+            for name in datasets:
+                assert first[name].dtype == second[name].dtype, name
+                npt.assert_array_equal(first[name][:], second[name][:], name)
+                assert set(first[name].attrs) == set(second[name].attrs), name
+                for key, value in first[name].attrs.items():
+                    npt.assert_array_equal(value, second[name].attrs[key], name)
+
+
+def test_parquet_compaction():
+    with tempfile.TemporaryDirectory() as dirname:
+        tmpdir = Path(dirname)
+
+        parquet_name = tmpdir / "data.parquet"
+        parquet_name.mkdir(parents=True, exist_ok=True)
+        metadata = {
+            b"source_population_name": b"sources",
+            b"source_population_size": b"100",
+            b"target_population_name": b"targets",
+            b"target_population_size": b"100",
+        }
+
+        df = generate_data(parquet_name, nfiles=4)
+        for filename in parquet_name.glob("*.parquet"):
+            table = pq.read_table(filename)
+            pq.write_table(
+                table.replace_schema_metadata(metadata), filename, row_group_size=100
+            )
+
+        compacted_name = tmpdir / "compacted.parquet"
+        subprocess.check_call(
+            [
+                "parquet-compact",
+                "--files",
+                "2",
+                "--row-group-size",
+                "1000",
+                parquet_name,
+                compacted_name,
+            ]
+        )
+        filenames = sorted(compacted_name.glob("*.parquet"))
+        assert len(filenames) == 2
+        for filename in filenames:
+            assert pq.read_schema(filename).metadata == metadata
+        compacted = pq.read_table(compacted_name).to_pandas()
+        assert len(compacted) == len(df)
+        for column in df.columns:
+            npt.assert_array_equal(compacted[column], df[column])
+
+        sorted_name = tmpdir / "sorted.parquet"
+        subprocess.check_call(
+            [
+                "parquet-compact",
+                "--files",
+                "1",
+                "--sort",
+                "target",
+                parquet_name,
+                sorted_name,
+            ]
+        )
+        (filename,) = sorted_name.glob("*.parquet")
+        assert pq.read_schema(filename).metadata == metadata
+        ordered = pq.read_table(filename).to_pandas()
+        assert len(ordered) == len(df)
+        expected = df.sort_values(
+            ["target_node_id", "source_node_id"], kind="stable"
+        ).reset_index(drop=True)
+        for column in ("source_node_id", "target_node_id"):
+            npt.assert_array_equal(ordered[column], expected[column])
+        pd.testing.assert_frame_equal(
+            ordered.sort_values(list(df.columns)).reset_index(drop=True),
+            df.sort_values(list(df.columns)).reset_index(drop=True),
+            check_dtype=False,
+        )
+
+
 if __name__ == "__main__":
     test_conversion()
+    test_streamed_index()
+    test_nested_columns()
+    test_nullable_and_string_columns()
+    test_sonata_roundtrip()
+    test_parquet_compaction()
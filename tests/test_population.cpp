@@ -0,0 +1,64 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "circuit/population.h"
+
+using neuron_parquet::circuit::Population;
+using neuron_parquet::circuit::schedule;
+
+/// A population of \a n_files files with \a records records in total
+Population population(size_t n_files, uint64_t records) {
+    Population p;
+    p.filenames.resize(n_files);
+    p.records = records;
+    return p;
+}
+
+std::vector<int> ranks(const std::vector<Population>& populations) {
+    std::vector<int> result;
+    for (const auto& p: populations) {
+        result.push_back(p.ranks);
+    }
+    return result;
+}
+
+std::vector<int> first_ranks(const std::vector<Population>& populations) {
+    std::vector<int> result;
+    for (const auto& p: populations) {
+        result.push_back(p.first_rank);
+    }
+    return result;
+}
+
+TEST_CASE("ScheduleProportional", "[population]") {
+    std::vector<Population> populations{population(10, 600), population(10, 300), population(10, 100)};
+    schedule(populations, 10);
+    CHECK(ranks(populations) == std::vector<int>{6, 3, 1});
+    CHECK(first_ranks(populations) == std::vector<int>{0, 6, 9});
+}
+
+TEST_CASE("ScheduleCappedByFiles", "[population]") {
+    SECTION("spare ranks go to other populations") {
+        std::vector<Population> populations{population(2, 900), population(10, 100)};
+        schedule(populations, 8);
+        CHECK(ranks(populations) == std::vector<int>{2, 6});
+        CHECK(first_ranks(populations) == std::vector<int>{0, 2});
+    }
+    SECTION("ranks beyond the files are left idle") {
+        std::vector<Population> populations{population(2, 900), population(1, 100)};
+        schedule(populations, 8);
+        CHECK(ranks(populations) == std::vector<int>{2, 1});
+        CHECK(first_ranks(populations) == std::vector<int>{0, 2});
+    }
+}
+
+TEST_CASE("ScheduleMorePopulationsThanRanks", "[population]") {
+    // Largest first, each on the least loaded rank
+    std::vector<Population> populations{population(1, 20),
+                                        population(3, 50),
+                                        population(1, 10),
+                                        population(2, 40),
+                                        population(1, 30)};
+    schedule(populations, 2);
+    CHECK(ranks(populations) == std::vector<int>{1, 1, 1, 1, 1});
+    CHECK(first_ranks(populations) == std::vector<int>{0, 0, 0, 1, 1});
+}
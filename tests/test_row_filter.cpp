@@ -0,0 +1,220 @@
+#include <filesystem>
+#include <fstream>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <catch2/catch_test_macros.hpp>
+#include <parquet/arrow/writer.h>
+
+#include "circuit/parquet_reader.h"
+#include "circuit/row_filter.h"
+
+namespace fs = std::filesystem;
+
+using neuron_parquet::circuit::CircuitData;
+using neuron_parquet::circuit::CircuitMultiReaderParquet;
+using neuron_parquet::circuit::CircuitReaderParquet;
+using neuron_parquet::circuit::RowFilter;
+
+const int64_t NROWS = 100;
+const int64_t ROW_GROUP_SIZE = 10;
+
+template <typename T>
+T check(arrow::Result<T> result) {
+    REQUIRE(result.ok());
+    return std::move(result).ValueOrDie();
+}
+
+/// Target node IDs increasing by row group, source node IDs cycling through 0-9,
+/// and a string naming the row
+std::shared_ptr<arrow::Table> generate_table() {
+    arrow::UInt64Builder target_builder;
+    arrow::Int64Builder source_builder;
+    arrow::StringBuilder name_builder;
+    for (int64_t i = 0; i < NROWS; ++i) {
+        REQUIRE(target_builder.Append(i / 2).ok());
+        REQUIRE(source_builder.Append(i % 10).ok());
+        REQUIRE(name_builder.Append("row" + std::to_string(i)).ok());
+    }
+    auto schema = arrow::schema({arrow::field("target_node_id", arrow::uint64(), false),
+                                 arrow::field("source_node_id", arrow::int64(), false),
+                                 arrow::field("name", arrow::utf8(), false)});
+    return arrow::Table::Make(schema, {check(target_builder.Finish()),
+                                       check(source_builder.Finish()),
+                                       check(name_builder.Finish())});
+}
+
+/// Reads the values of an integer \a column of \a table
+std::vector<int64_t> values(const arrow::Table& table, const std::string& column) {
+    std::vector<int64_t> result;
+    for (const auto& chunk: table.GetColumnByName(column)->chunks()) {
+        for (int64_t i = 0; i < chunk->length(); ++i) {
+            if (chunk->type_id() == arrow::Type::UINT64) {
+                result.push_back(static_cast<const arrow::UInt64Array&>(*chunk).Value(i));
+            } else {
+                result.push_back(static_cast<const arrow::Int64Array&>(*chunk).Value(i));
+            }
+        }
+    }
+    return result;
+}
+
+TEST_CASE("RowFilterParse", "[filter]") {
+    SECTION("range") {
+        const auto c = RowFilter::parse("target_node_id=5-10");
+        CHECK(c.column == "target_node_id");
+        CHECK(c.min == 5);
+        CHECK(c.max == 10);
+        CHECK(c.values.empty());
+    }
+    SECTION("values") {
+        const auto c = RowFilter::parse("source_node_id=7,3,7,1");
+        CHECK(c.values == std::vector<int64_t>{1, 3, 7});
+        CHECK(c.min == 1);
+        CHECK(c.max == 7);
+    }
+    SECTION("single value") {
+        const auto c = RowFilter::parse("source_node_id=4");
+        CHECK(c.values == std::vector<int64_t>{4});
+    }
+    SECTION("file") {
+        const auto path = fs::temp_directory_path() / "row_filter_values.txt";
+        std::ofstream(path) << "12\n4 8\n";
+        const auto c = RowFilter::parse("target_node_id=@" + path.string());
+        CHECK(c.values == std::vector<int64_t>{4, 8, 12});
+        fs::remove(path);
+    }
+    SECTION("invalid") {
+        CHECK_THROWS(RowFilter::parse("target_node_id"));
+        CHECK_THROWS(RowFilter::parse("=1-2"));
+        CHECK_THROWS(RowFilter::parse("target_node_id=2-1"));
+        CHECK_THROWS(RowFilter::parse("target_node_id=a-b"));
+        CHECK_THROWS(RowFilter::parse("target_node_id=1,x"));
+    }
+}
+
+TEST_CASE("RowFilterApply", "[filter]") {
+    const auto table = generate_table();
+
+    SECTION("range") {
+        const RowFilter filter({RowFilter::parse("target_node_id=10-12")});
+        const auto result = filter.apply(table);
+        CHECK(values(*result, "target_node_id") == std::vector<int64_t>{10, 10, 11, 11, 12, 12});
+    }
+    SECTION("values and range") {
+        const RowFilter filter({RowFilter::parse("target_node_id=0-9"),
+                                RowFilter::parse("source_node_id=3,4")});
+        const auto result = filter.apply(table);
+        CHECK(values(*result, "target_node_id") == std::vector<int64_t>{1, 2, 6, 7});
+        CHECK(values(*result, "source_node_id") == std::vector<int64_t>{3, 4, 3, 4});
+    }
+    SECTION("nothing") {
+        const RowFilter filter({RowFilter::parse("target_node_id=1000-2000")});
+        CHECK(filter.apply(table)->num_rows() == 0);
+    }
+    SECTION("missing column") {
+        const RowFilter filter({RowFilter::parse("edge_type_id=1")});
+        CHECK_THROWS(filter.apply(table));
+    }
+}
+
+TEST_CASE("RowFilterReader", "[filter]") {
+    const auto path = fs::temp_directory_path() / "row_filter.parquet";
+    {
+        auto outfile = check(arrow::io::FileOutputStream::Open(path.string()));
+        REQUIRE(parquet::arrow::WriteTable(*generate_table(), arrow::default_memory_pool(),
+                                           outfile, ROW_GROUP_SIZE).ok());
+        REQUIRE(outfile->Close().ok());
+    }
+
+    CircuitReaderParquet reader(path.string());
+    REQUIRE(reader.block_count() == NROWS / ROW_GROUP_SIZE);
+
+    SECTION("row groups skipped") {
+        // Target node IDs 12-14 are in the third row group only
+        auto filter = std::make_shared<RowFilter>(
+            std::vector<RowFilter::Condition>{RowFilter::parse("target_node_id=12-14")});
+        for (uint32_t rg = 0; rg < reader.block_count(); ++rg) {
+            // The statistics are independent of the filtering done by the reader
+            CHECK(filter->may_match(*parquet::ParquetFileReader::OpenFile(path.string())
+                                         ->metadata()
+                                         ->RowGroup(rg)) == (rg == 2));
+        }
+        reader.set_filter(filter);
+        CHECK(reader.matching_count() == 6);
+
+        CircuitData data;
+        CHECK(reader.fillBuffer(&data, 0) == 6);
+        CHECK(values(*data.row_group, "target_node_id") == std::vector<int64_t>{12, 12, 13, 13, 14, 14});
+        CHECK(reader.fillBuffer(&data, 0) == 0);
+    }
+
+    SECTION("empty row groups skipped") {
+        // Source node ID 9 is in every row group, target node ID 17 only
+        // with other source node IDs
+        reader.set_filter(std::make_shared<RowFilter>(std::vector<RowFilter::Condition>{
+            RowFilter::parse("source_node_id=9"), RowFilter::parse("target_node_id=4,17,29")}));
+        CHECK(reader.matching_count() == 2);
+
+        CircuitData data;
+        CHECK(reader.fillBuffer(&data, 0) == 1);
+        CHECK(values(*data.row_group, "target_node_id") == std::vector<int64_t>{4});
+        CHECK(reader.fillBuffer(&data, 0) == 1);
+        CHECK(values(*data.row_group, "target_node_id") == std::vector<int64_t>{29});
+        CHECK(reader.fillBuffer(&data, 0) == 0);
+    }
+
+    SECTION("unique values") {
+        reader.set_filter(nullptr);
+        std::set<std::string> names;
+        reader.unique_values("name", names);
+        CHECK(names.size() == NROWS);
+
+        // Only the strings of matching rows are enumerated
+        reader.set_filter(std::make_shared<RowFilter>(std::vector<RowFilter::Condition>{
+            RowFilter::parse("source_node_id=9"), RowFilter::parse("target_node_id=4,17,29")}));
+        names.clear();
+        reader.unique_values("name", names);
+        CHECK(names == std::set<std::string>{"row59", "row9"});
+    }
+
+    fs::remove(path);
+}
+
+TEST_CASE("RowFilterMultiReader", "[filter]") {
+    // Four files of 25 rows each, the target node IDs of the last one start at 37
+    const auto table = generate_table();
+    std::vector<std::string> paths;
+    for (int64_t offset = 0; offset < NROWS; offset += NROWS / 4) {
+        const auto path = fs::temp_directory_path() /
+                          ("row_filter_" + std::to_string(offset) + ".parquet");
+        auto outfile = check(arrow::io::FileOutputStream::Open(path.string()));
+        REQUIRE(parquet::arrow::WriteTable(*table->Slice(offset, NROWS / 4),
+                                           arrow::default_memory_pool(),
+                                           outfile,
+                                           ROW_GROUP_SIZE).ok());
+        REQUIRE(outfile->Close().ok());
+        paths.push_back(path.string());
+    }
+
+    // The second and third file do not match at all
+    CircuitMultiReaderParquet reader(paths);
+    reader.set_filter(std::make_shared<RowFilter>(std::vector<RowFilter::Condition>{
+        RowFilter::parse("target_node_id=5,40,41,42,43,44,45")}));
+
+    CircuitData data;
+    std::vector<int64_t> targets;
+    std::vector<uint32_t> counts;
+    uint32_t n;
+    while ((n = reader.fillBuffer(&data, 0)) > 0) {
+        counts.push_back(n);
+        const auto read = values(*data.row_group, "target_node_id");
+        targets.insert(targets.end(), read.begin(), read.end());
+    }
+    CHECK(counts == std::vector<uint32_t>{2, 5, 7});
+    CHECK(targets == std::vector<int64_t>{5, 5, 40, 40, 41, 41, 42, 42, 43, 43, 44, 44, 45, 45});
+
+    for (const auto& path: paths) {
+        fs::remove(path);
+    }
+}
@@ -0,0 +1,389 @@
+#include <cmath>
+#include <filesystem>
+#include <numeric>
+
+#include <arrow/api.h>
+#include <arrow/io/file.h>
+#include <catch2/catch_test_macros.hpp>
+#include <highfive/H5File.hpp>
+#include <mpi.h>
+#include <parquet/arrow/writer.h>
+
+#include "circuit/parquet_reader.h"
+#include "circuit/sonata_writer.h"
+
+namespace fs = std::filesystem;
+
+using neuron_parquet::circuit::CircuitData;
+using neuron_parquet::circuit::CircuitReaderParquet;
+using neuron_parquet::circuit::DatasetLayout;
+using neuron_parquet::circuit::SonataFile;
+using neuron_parquet::circuit::SonataWriter;
+
+const int64_t NROWS = 200;
+const char* POPULATION = "test";
+
+class MPIFixture {
+  public:
+    MPIFixture() {
+        int init;
+        MPI_Initialized(&init);
+        if (!init) {
+            MPI_Init(nullptr, nullptr);
+        }
+    }
+};
+
+template <typename T>
+T check(arrow::Result<T> result) {
+    REQUIRE(result.ok());
+    return std::move(result).ValueOrDie();
+}
+
+/// Slices \a array into a column of chunks of differing size, starting at \a start
+std::shared_ptr<arrow::ChunkedArray> sliced(const std::shared_ptr<arrow::Array>& array,
+                                            int64_t start,
+                                            int64_t length) {
+    arrow::ArrayVector chunks;
+    for (int64_t size = 1; length > 0; size *= 3) {
+        const auto n = std::min(size, length);
+        chunks.push_back(array->Slice(start, n));
+        start += n;
+        length -= n;
+    }
+    return std::make_shared<arrow::ChunkedArray>(chunks);
+}
+
+/// Full columns, of which only slices will be written
+std::shared_ptr<arrow::Table> generate_table() {
+    const auto n = 2 * NROWS;
+
+    std::vector<int32_t> ints(n);
+    std::iota(ints.begin(), ints.end(), 0);
+    arrow::Int32Builder int_builder;
+    REQUIRE(int_builder.AppendValues(ints).ok());
+
+    arrow::DoubleBuilder double_builder;
+    arrow::BooleanBuilder bool_builder;
+    arrow::StringBuilder string_builder;
+    for (int64_t i = 0; i < n; ++i) {
+        if (i % 7 == 0) {
+            REQUIRE(double_builder.AppendNull().ok());
+        } else {
+            REQUIRE(double_builder.Append(0.5 * i).ok());
+        }
+        REQUIRE(bool_builder.Append(i % 3 == 0).ok());
+        REQUIRE(string_builder.Append(i % 2 == 0 ? "even" : "odd").ok());
+    }
+
+    std::vector<float> floats(3 * n);
+    std::iota(floats.begin(), floats.end(), 0.f);
+    arrow::FloatBuilder float_builder;
+    REQUIRE(float_builder.AppendValues(floats).ok());
+    auto lists = check(arrow::FixedSizeListArray::FromArrays(check(float_builder.Finish()), 3));
+
+    arrow::BooleanBuilder flag_builder;
+    for (int64_t i = 0; i < 2 * n; ++i) {
+        REQUIRE(flag_builder.Append(i % 5 == 0).ok());
+    }
+    auto flags = check(arrow::FixedSizeListArray::FromArrays(check(flag_builder.Finish()), 2));
+
+    auto schema = arrow::schema({arrow::field("ints", arrow::int32(), false),
+                                 arrow::field("doubles", arrow::float64()),
+                                 arrow::field("bools", arrow::boolean(), false),
+                                 arrow::field("strings", arrow::utf8(), false),
+                                 arrow::field("lists", lists->type(), false),
+                                 arrow::field("flags", flags->type(), false)});
+    return arrow::Table::Make(schema,
+                              {check(int_builder.Finish()),
+                               check(double_builder.Finish()),
+                               check(bool_builder.Finish()),
+                               check(string_builder.Finish()),
+                               lists,
+                               flags});
+}
+
+/// Writes \a table to Parquet to obtain the schema and metadata SonataWriter expects
+void write_parquet(const std::shared_ptr<arrow::Table>& table, const fs::path& path) {
+    auto sink = check(arrow::io::FileOutputStream::Open(path.string()));
+    auto props = parquet::ArrowWriterProperties::Builder().store_schema()->build();
+    REQUIRE(parquet::arrow::WriteTable(*table,
+                                       arrow::default_memory_pool(),
+                                       sink,
+                                       NROWS,
+                                       parquet::default_writer_properties(),
+                                       props)
+                .ok());
+    REQUIRE(sink->Close().ok());
+}
+
+/// Edges with node IDs shifted by \a shift, and an integer \a column
+std::shared_ptr<arrow::Table> generate_edges(int64_t shift, const std::string& column) {
+    arrow::Int64Builder source_builder;
+    arrow::Int64Builder target_builder;
+    arrow::Int32Builder value_builder;
+    for (int64_t i = 0; i < NROWS; ++i) {
+        REQUIRE(source_builder.Append(i / 10).ok());
+        REQUIRE(target_builder.Append(i % 10 + shift).ok());
+        REQUIRE(value_builder.Append(i).ok());
+    }
+    auto schema = arrow::schema({arrow::field("source_node_id", arrow::int64(), false),
+                                 arrow::field("target_node_id", arrow::int64(), false),
+                                 arrow::field(column, arrow::int32(), false)});
+    return arrow::Table::Make(schema,
+                              {check(source_builder.Finish()),
+                               check(target_builder.Finish()),
+                               check(value_builder.Finish())});
+}
+
+TEST_CASE("SonataWriterSlices", "[sonata]") {
+    const fs::path base = fs::temp_directory_path() / "test_sonata_writer";
+    fs::create_directories(base);
+    const auto parquet_path = base / "data.parquet";
+    const auto sonata_path = base / "data.h5";
+
+    const auto table = generate_table();
+    write_parquet(table, parquet_path);
+
+    // Start at an odd offset to not be aligned with the bitmaps of booleans
+    const int64_t start = 13;
+    std::vector<std::shared_ptr<arrow::ChunkedArray>> columns;
+    for (const auto& column: table->columns()) {
+        REQUIRE(column->num_chunks() == 1);
+        columns.push_back(sliced(column->chunk(0), start, NROWS));
+    }
+    CircuitData data{arrow::Table::Make(table->schema(), columns, NROWS)};
+
+    {
+        CircuitReaderParquet reader(parquet_path.string());
+        SonataWriter writer(sonata_path.string(), NROWS, POPULATION);
+        writer.set_enumeration("strings", {"even", "odd"});
+        writer.set_nullable_columns({"doubles"});
+        writer.setup(reader.schema(), reader.metadata());
+        writer.write(&data, NROWS);
+        writer.flush();
+    }
+
+    HighFive::File file(sonata_path.string(), HighFive::File::ReadOnly);
+    const auto group = file.getGroup(std::string("edges/") + POPULATION + "/0");
+
+    std::vector<int32_t> ints;
+    group.getDataSet("ints").read(ints);
+    std::vector<double> doubles;
+    group.getDataSet("doubles").read(doubles);
+    std::vector<uint8_t> bools;
+    group.getDataSet("bools").read(bools);
+    std::vector<uint32_t> strings;
+    group.getDataSet("strings").read(strings);
+    std::vector<std::vector<float>> lists;
+    group.getDataSet("lists").read(lists);
+    std::vector<std::vector<uint8_t>> flags;
+    group.getDataSet("flags").read(flags);
+
+    // Only the column with nulls has a fill value
+    for (const auto& name: {"ints", "doubles", "bools", "strings", "lists", "flags"}) {
+        const hid_t dcpl = H5Dget_create_plist(group.getDataSet(name).getId());
+        H5D_fill_value_t fill_status;
+        H5Pfill_value_defined(dcpl, &fill_status);
+        H5Pclose(dcpl);
+        REQUIRE((fill_status == H5D_FILL_VALUE_USER_DEFINED) == (name == std::string("doubles")));
+    }
+
+    REQUIRE(ints.size() == NROWS);
+    REQUIRE(lists.size() == NROWS);
+    for (int64_t i = 0; i < NROWS; ++i) {
+        const auto row = start + i;
+        REQUIRE(ints[i] == row);
+        if (row % 7 == 0) {
+            REQUIRE(std::isnan(doubles[i]));
+        } else {
+            REQUIRE(doubles[i] == 0.5 * row);
+        }
+        REQUIRE(bools[i] == (row % 3 == 0));
+        REQUIRE(strings[i] == row % 2);
+        REQUIRE(lists[i] == std::vector<float>{3.f * row, 3.f * row + 1, 3.f * row + 2});
+        REQUIRE(flags[i] == std::vector<uint8_t>{(2 * row) % 5 == 0, (2 * row + 1) % 5 == 0});
+    }
+
+    fs::remove_all(base);
+}
+
+TEST_CASE("SonataWriterStructs", "[sonata]") {
+    const fs::path base = fs::temp_directory_path() / "test_sonata_writer_structs";
+    fs::create_directories(base);
+    const auto parquet_path = base / "data.parquet";
+    const auto sonata_path = base / "data.h5";
+
+    // Rows divisible by 5 are null structs, the y of rows divisible by 3 is null
+    const auto n = 2 * NROWS;
+    auto type = arrow::struct_({arrow::field("x", arrow::float32()), arrow::field("y", arrow::float64())});
+    auto x_builder = std::make_shared<arrow::FloatBuilder>();
+    auto y_builder = std::make_shared<arrow::DoubleBuilder>();
+    arrow::StructBuilder struct_builder(type, arrow::default_memory_pool(), {x_builder, y_builder});
+    for (int64_t i = 0; i < n; ++i) {
+        REQUIRE(struct_builder.Append(i % 5 != 0).ok());
+        REQUIRE(x_builder->Append(1.5f * i).ok());
+        if (i % 3 == 0) {
+            REQUIRE(y_builder->AppendNull().ok());
+        } else {
+            REQUIRE(y_builder->Append(-2.0 * i).ok());
+        }
+    }
+    const auto table = arrow::Table::Make(arrow::schema({arrow::field("position", type)}),
+                                          {check(struct_builder.Finish())});
+    write_parquet(table, parquet_path);
+
+    const int64_t start = 13;
+    CircuitData data{arrow::Table::Make(table->schema(),
+                                        {sliced(table->column(0)->chunk(0), start, NROWS)},
+                                        NROWS)};
+
+    {
+        CircuitReaderParquet reader(parquet_path.string());
+        SonataWriter writer(sonata_path.string(), NROWS, POPULATION);
+        writer.set_nullable_columns({"position"});
+        writer.setup(reader.schema(), reader.metadata());
+        writer.write(&data, NROWS);
+        writer.flush();
+    }
+
+    HighFive::File file(sonata_path.string(), HighFive::File::ReadOnly);
+    const auto group = file.getGroup(std::string("edges/") + POPULATION + "/0");
+    REQUIRE(group.listObjectNames() == std::vector<std::string>{"position_x", "position_y"});
+
+    std::vector<float> xs;
+    group.getDataSet("position_x").read(xs);
+    std::vector<double> ys;
+    group.getDataSet("position_y").read(ys);
+
+    REQUIRE(xs.size() == NROWS);
+    REQUIRE(ys.size() == NROWS);
+    for (int64_t i = 0; i < NROWS; ++i) {
+        const auto row = start + i;
+        if (row % 5 == 0) {
+            REQUIRE(std::isnan(xs[i]));
+            REQUIRE(std::isnan(ys[i]));
+            continue;
+        }
+        REQUIRE(xs[i] == 1.5f * row);
+        if (row % 3 == 0) {
+            REQUIRE(std::isnan(ys[i]));
+        } else {
+            REQUIRE(ys[i] == -2.0 * row);
+        }
+    }
+
+    fs::remove_all(base);
+}
+
+TEST_CASE("SonataWriterRounds", "[sonata]") {
+    MPIFixture fixed;
+    int rank, size;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    const fs::path base = fs::temp_directory_path() / "test_sonata_writer_rounds";
+    const auto parquet_path = base / "data.parquet";
+    const auto sonata_path = base / "data.h5";
+    const auto table = generate_table();
+    if (rank == 0) {
+        fs::create_directories(base);
+        write_parquet(table, parquet_path);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    // Ranks write differing numbers of rows, the first one the most
+    const uint64_t local = NROWS - 7 * (rank % 20);
+    uint64_t offset = 0, total = 0;
+    MPI_Exscan(&local, &offset, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    MPI_Allreduce(&local, &total, 1, MPI_UINT64_T, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+        offset = 0;
+    }
+
+    // Compression requires collective writes, in rounds of 10 rows of the
+    // widest dataset, i.e., three floats
+    DatasetLayout layout;
+    layout.chunk_size = 16;
+    layout.deflate = 1;
+    layout.write_buffer_size = 10 * 3 * sizeof(float);
+
+    {
+        CircuitReaderParquet reader(parquet_path.string());
+        SonataWriter writer(sonata_path.string(), total, {MPI_COMM_WORLD, MPI_INFO_NULL}, offset, POPULATION, layout);
+        writer.set_enumeration("strings", {"even", "odd"});
+        writer.set_nullable_columns({"doubles"});
+        writer.set_local_records(local);
+        writer.setup(reader.schema(), reader.metadata());
+        for (uint64_t start = 0; start < local; start += 33) {
+            CircuitData data{table->Slice(start, std::min<uint64_t>(33, local - start))};
+            writer.write(&data, data.row_group->num_rows());
+        }
+        writer.flush();
+        // Every rank takes part in all rounds of all six datasets
+        CHECK(writer.write_counters().writes == 6 * ((NROWS + 9) / 10));
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+
+    if (rank == 0) {
+        HighFive::File file(sonata_path.string(), HighFive::File::ReadOnly);
+        const auto group = file.getGroup(std::string("edges/") + POPULATION + "/0");
+        std::vector<int32_t> ints;
+        group.getDataSet("ints").read(ints);
+        std::vector<std::vector<float>> lists;
+        group.getDataSet("lists").read(lists);
+        REQUIRE(ints.size() == total);
+        uint64_t row = 0;
+        for (int r = 0; r < size; ++r) {
+            for (int64_t i = 0; i < NROWS - 7 * (r % 20); ++i, ++row) {
+                REQUIRE(ints[row] == i);
+                REQUIRE(lists[row] == std::vector<float>{3.f * i, 3.f * i + 1, 3.f * i + 2});
+            }
+        }
+        fs::remove_all(base);
+    }
+    MPI_Barrier(MPI_COMM_WORLD);
+}
+
+TEST_CASE("SonataWriterAppend", "[sonata]") {
+    MPIFixture fixed;
+
+    const fs::path base = fs::temp_directory_path() / "test_sonata_writer_append";
+    fs::create_directories(base);
+    const auto parquet_path = base / "data.parquet";
+    const auto sonata_path = base / "data.h5";
+
+    const auto append = [&](const std::shared_ptr<arrow::Table>& table, uint64_t records) {
+        write_parquet(table, parquet_path);
+        CircuitReaderParquet reader(parquet_path.string());
+        auto file = SonataFile::open(sonata_path.string(), MPI_COMM_WORLD, MPI_INFO_NULL);
+        SonataWriter writer(file, records, 0, POPULATION);
+        writer.setup(reader.schema(), reader.metadata());
+        CircuitData data{table};
+        writer.write(&data, NROWS);
+        writer.flush();
+    };
+
+    append(generate_edges(0, "ints"), NROWS);
+
+    // The new column is added to the population created above
+    append(generate_edges(0, "more_ints"), NROWS);
+    {
+        HighFive::File file(sonata_path.string(), HighFive::File::ReadOnly);
+        const auto group = file.getGroup(std::string("edges/") + POPULATION + "/0");
+        std::vector<int32_t> expected(NROWS);
+        std::iota(expected.begin(), expected.end(), 0);
+        std::vector<int32_t> ints;
+        group.getDataSet("ints").read(ints);
+        REQUIRE(ints == expected);
+        std::vector<int32_t> more_ints;
+        group.getDataSet("more_ints").read(more_ints);
+        REQUIRE(more_ints == expected);
+    }
+
+    // Appending requires as many edges as stored, with the same node IDs
+    REQUIRE_THROWS(append(generate_edges(0, "other_ints"), NROWS + 1));
+    REQUIRE_THROWS(append(generate_edges(1, "other_ints"), NROWS));
+
+    fs::remove_all(base);
+}